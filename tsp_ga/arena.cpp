@@ -0,0 +1,65 @@
+//
+//  arena.cpp
+//  tsp_ga
+//
+
+#include "arena.h"
+#include <cstdint>
+
+static const size_t line = ScratchArena::line_size;
+
+ScratchArena::ScratchArena()
+:
+	block(nullptr), capacity(0), used(0)
+{
+	// Room for a few retired blocks, so growing does not allocate twice
+	retired.reserve(32);
+}
+
+ScratchArena::~ScratchArena()
+{
+	reset();
+	delete[] block;
+}
+
+void* ScratchArena::alloc_bytes(size_t bytes)
+{
+	bytes = (bytes + line - 1) & ~(line - 1);
+	
+	if (block == nullptr || used + bytes > capacity) {
+		// Keep the current block alive until the next reset
+		if (block != nullptr)
+			retired.push_back(block);
+		
+		size_t size = capacity * 2;
+		if (size < used + bytes)
+			size = used + bytes;
+		if (size < 4096)
+			size = 4096;
+		
+		block = new char[size + line];
+		capacity = size;
+		used = 0;
+	}
+	
+	char* base = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(block) + line - 1) & ~(uintptr_t)(line - 1));
+	void* p = base + used;
+	used += bytes;
+	return p;
+}
+
+void ScratchArena::reserve(size_t bytes)
+{
+	if (bytes > capacity) {
+		alloc_bytes(bytes);
+		reset();
+	}
+}
+
+void ScratchArena::reset()
+{
+	for (size_t i = 0; i < retired.size(); i++)
+		delete[] retired[i];
+	retired.clear();
+	used = 0;
+}
@@ -0,0 +1,72 @@
+//
+//  arena.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__arena__
+#define __tsp_ga__arena__
+
+#include <cstddef>
+#include <vector>
+
+/*
+ Bump allocator for short-lived scratch buffers.
+ 
+ Memory is handed out from one block and released all at once by reset().
+ If a request does not fit, a bigger block is allocated and the old one is
+ kept until the next reset(), which then keeps only the bigger block. Once
+ the block is large enough for the biggest use between two resets, the
+ arena stops touching the heap. Blocks come from operator new, so the
+ counts of heap_count.h include them.
+ */
+class ScratchArena
+{
+public:
+	ScratchArena();
+	~ScratchArena();
+	
+	/*
+	 Returns room for count elements of T, aligned to a cache line
+	 */
+	template<typename T>
+	T* alloc(size_t count)
+	{
+		return static_cast<T*>(alloc_bytes(count * sizeof(T)));
+	}
+	
+	/*
+	 Releases everything handed out since the last reset
+	 */
+	void reset();
+	
+	/*
+	 Grows the block, if needed, so that allocations taking up to bytes of it
+	 fit without touching the heap. Only call it with nothing handed out.
+	 */
+	void reserve(size_t bytes);
+	
+	/*
+	 Bytes of the block that count elements of T take up, with alignment
+	 */
+	template<typename T>
+	static size_t footprint(size_t count)
+	{
+		return (count * sizeof(T) + line_size - 1) & ~(line_size - 1);
+	}
+	
+	static const size_t line_size = 64;
+	
+private:
+	char* block;
+	size_t capacity;
+	size_t used;
+	std::vector<char*> retired;
+	char pad[64];	// Keep arenas of different threads apart
+	
+	void* alloc_bytes(size_t bytes);
+	
+	ScratchArena(const ScratchArena&);
+	ScratchArena& operator=(const ScratchArena&);
+};
+
+#endif /* defined(__tsp_ga__arena__) */
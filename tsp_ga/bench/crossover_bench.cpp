@@ -0,0 +1,120 @@
+/* crossover_bench.cpp
+ 
+ Description   : Compares the bitmap crossover against the nested scan it
+                 replaced, over a range of city counts. Build it with the
+                 engine sources, without main.cpp.
+ */
+
+// Native includes
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+// Program includes
+#include "ga_cpu.h"
+#include "population.h"
+#include "common.h"
+
+using namespace std;
+
+/*
+	The former O(n^2) crossover, for reference
+*/
+static void nested_crossover(const tour_t* const parents[2], tour_t* child, int num_cities, int cross_over)
+{
+	memmove(child, parents[0], (cross_over + 1) * sizeof(tour_t));
+	
+	const tour_t* p = parents[1];
+	int remaining = num_cities - cross_over - 1;
+	int count     = 0;
+	for (int i = 0; i < num_cities; i++)
+	{
+		bool in_child = false;
+		for (int j = 0; j <= cross_over; j++)
+		{
+			if (child[j] == p[i])
+			{
+				in_child = true;
+				break;
+			}
+		}
+		if (!in_child)
+		{
+			count++;
+			child[cross_over+count] = p[i];
+		}
+		if (count == remaining) break;
+	}
+}
+
+/*
+	Parents and crossover point of the c-th child
+*/
+static int pick(const tour_t* tours, int num_parents, int num_cities, long c, const tour_t* parents[2])
+{
+	parents[0] = &tours[(c % num_parents) * num_cities];
+	parents[1] = &tours[((c * 7 + 3) % num_parents) * num_cities];
+	return static_cast<int>((c * 7919) % (num_cities - 1)); // Spread over the whole tour
+}
+
+int main()
+{
+	const int num_parents  = 64;
+	const int city_counts[] = {25, 100, 250, 1000, 5000, 10000};
+	const long genes_per_run = 20000000; // Genes produced per measurement
+	
+	cout << "cities, nested ms/child, bitmap ms/child, nested ns/gene, bitmap ns/gene, speedup" << endl;
+	
+	for (int num_cities : city_counts)
+	{
+		vector<tour_t> tours(num_parents * num_cities);
+		init_tours(tours.data(), num_parents, num_cities, 1234);
+		
+		vector<tour_t> expected(num_cities), child(num_cities);
+		vector<uint32_t> visited(visited_words(num_cities));
+		
+		// The nested scan is quadratic, so measure it over fewer children
+		long counts[2];
+		counts[1] = max(1L, genes_per_run / num_cities);
+		counts[0] = max(1L, counts[1] / max(1, num_cities / 25));
+		
+		float times[2];
+		for (int method = 0; method < 2; method++)
+		{
+			wall_clock::time_point clk = wall_clock::now();
+			for (long c = 0; c < counts[method]; c++)
+			{
+				const tour_t* parents[2];
+				int cross_over = pick(tours.data(), num_parents, num_cities, c, parents);
+				if (method == 0)
+					nested_crossover(parents, expected.data(), num_cities, cross_over);
+				else
+					crossover(parents, child.data(), num_cities, cross_over, visited.data());
+			}
+			times[method] = end_clock(clk);
+		}
+		
+		// Both must give the same children
+		for (long c = 0; c < counts[0]; c++)
+		{
+			const tour_t* parents[2];
+			int cross_over = pick(tours.data(), num_parents, num_cities, c, parents);
+			nested_crossover(parents, expected.data(), num_cities, cross_over);
+			crossover(parents, child.data(), num_cities, cross_over, visited.data());
+			if (memcmp(expected.data(), child.data(), num_cities * sizeof(tour_t)) != 0) {
+				cerr << "Mismatch at " << num_cities << " cities" << endl;
+				return 1;
+			}
+		}
+		
+		float per_child[2] = { times[0] / counts[0], times[1] / counts[1] };
+		cout << num_cities << ", "
+			 << setprecision(4) << per_child[0] << ", " << per_child[1] << ", "
+			 << per_child[0] * 1e6f / num_cities << ", " << per_child[1] * 1e6f / num_cities << ", "
+			 << per_child[0] / per_child[1] << endl;
+	}
+	
+	return 0;
+}
@@ -0,0 +1,117 @@
+/* eval_bench.cpp
+
+ Description   : Times the scalar and vector tour length kernels over a
+                 population, for the squared and euclidean metrics. Build it
+                 with the engine sources, without main.cpp.
+ */
+
+// Native includes
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+// Program includes
+#include "world.h"
+#include "distance.h"
+#include "population.h"
+#include "tour_simd.h"
+#include "common.h"
+
+using namespace std;
+
+enum metric_t
+{
+	sq_table,		// Squared lengths from the dense table (the fitness)
+	sq_coords,		// Squared lengths from the coordinates
+	euclid_table,	// Euclidean lengths from the dense table
+	euclid_path,	// Euclidean length of ordered cities (World::calc_distance)
+	num_metrics
+};
+
+// Keeps the timed results alive
+static volatile double sink;
+
+static const char* metric_names[] = { "sq_table", "sq_coords", "euclid_table", "euclid_path" };
+
+/*
+	Evaluates every tour once; returns a checksum of the results
+*/
+static double run(metric_t metric, simd_t simd, const World& world, const DistanceTable& dist,
+				  const tour_t* tours, const City* paths, int pop_size)
+{
+	int n = world.num_cities;
+	double checksum = 0.0;
+	for (int i = 0; i < pop_size; i++) {
+		const tour_t* tour = &tours[i * n];
+		switch (metric) {
+			case sq_table:     checksum += sq_tour_length(dist.dense_table(), dist.stride(), tour, n, simd); break;
+			case sq_coords:    checksum += sq_tour_length(world.cities, tour, n, simd); break;
+			case euclid_table: checksum += euclid_tour_length(dist.dense_table(), dist.stride(), tour, n, simd); break;
+			default:           checksum += euclid_path_length(&paths[i * n], n, simd); break;
+		}
+	}
+	return checksum;
+}
+
+int main()
+{
+	const int city_counts[] = {25, 100, 250, 1000};
+	const long edges_per_run = 50000000; // Edges evaluated per measurement
+	const int pop_size = 1000;
+
+	simd_t best = detect_simd();
+	cout << "Best instruction set: " << simd_name(best)
+		 << ", engine default: " << simd_name(default_simd()) << endl;
+	cout << "cities, metric, simd, ns/tour, ns/edge, speedup" << endl;
+
+	for (int num_cities : city_counts)
+	{
+		World world(num_cities, 10000, 10000, 12345678);
+		DistanceTable dist(world);
+
+		vector<tour_t> tours(pop_size * num_cities);
+		init_tours(tours.data(), pop_size, num_cities, 87654321);
+
+		// The same tours as ordered cities
+		vector<City> paths(pop_size * num_cities);
+		for (size_t i = 0; i < tours.size(); i++)
+			paths[i] = world.cities[tours[i]];
+
+		int rounds = static_cast<int>(max(1L, edges_per_run / (static_cast<long>(pop_size) * num_cities)));
+
+		for (int m = 0; m < num_metrics; m++)
+		{
+			metric_t metric = static_cast<metric_t>(m);
+			float scalar_ns = 0.0f;
+			double expected = 0.0;
+
+			for (int s = 0; s <= static_cast<int>(best); s++)
+			{
+				simd_t simd = static_cast<simd_t>(s);
+
+				// Every version must give the same lengths
+				double checksum = run(metric, simd, world, dist, tours.data(), paths.data(), pop_size);
+				if (s == 0)
+					expected = checksum;
+				else if (checksum != expected) {
+					cerr << "Mismatch: " << metric_names[m] << " " << simd_name(simd) << endl;
+					return 1;
+				}
+
+				wall_clock::time_point clk = wall_clock::now();
+				for (int r = 0; r < rounds; r++)
+					checksum += run(metric, simd, world, dist, tours.data(), paths.data(), pop_size);
+				float ns = end_clock(clk) * 1e6f / (static_cast<float>(rounds) * pop_size);
+				if (s == 0)
+					scalar_ns = ns;
+
+				cout << num_cities << ", " << metric_names[m] << ", " << simd_name(simd) << ", "
+					 << setprecision(4) << ns << ", " << ns / (num_cities - 1) << ", "
+					 << scalar_ns / ns << endl;
+				sink = checksum;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,141 @@
+/* island_cluster.cpp
+
+ Description   : Runs the island model as one process, then as a cluster of
+                 local worker processes around a coordinator (cluster.h),
+                 and compares their throughput and final tour quality. Both
+                 runs have the same total population and number of islands:
+                 the single process runs those of all the workers together.
+                 Build it with the engine sources, without main.cpp.
+
+ Usage         : island_cluster [workers] [islands per worker] [cities]
+                                [individuals per worker] [generations]
+                                [address]
+ */
+
+// Native includes
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Program includes
+#include "world.h"
+#include "log.h"
+#include "islands.h"
+#include "cluster.h"
+
+using namespace std;
+
+// World parameters
+static const int world_size = 2000;
+static const int world_seed = 12345678;
+static const int ga_seed    = 87654321;
+
+static const float prob_mutation  = 0.15f;
+static const float prob_crossover = 0.8f;
+
+static double seconds_since(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char* label, int processes, double seconds, long long children, float distance)
+{
+	cout << left << setw(12) << label << right
+		 << setw(10) << processes
+		 << setw(12) << fixed << setprecision(2) << seconds
+		 << setw(18) << setprecision(0) << children / seconds
+		 << setw(14) << setprecision(1) << distance << endl;
+}
+
+int main(int argc, const char * argv[])
+{
+	int workers    = argc > 1 ? atoi(argv[1]) : 4;
+	int islands    = argc > 2 ? atoi(argv[2]) : 2;
+	int num_cities = argc > 3 ? atoi(argv[3]) : 60;
+	int pop_size   = argc > 4 ? atoi(argv[4]) : 2000;
+	int max_gen    = argc > 5 ? atoi(argv[5]) : 300;
+	string address = argc > 6 ? argv[6] : "unix:/tmp/tsp_ga_cluster.sock";
+
+	World world(num_cities, world_size, world_size, world_seed);
+	GAOptions options;
+	options.num_islands = islands;
+
+	// The runs print every generation; keep only the results
+	ofstream quiet("/dev/null");
+	streambuf* console = cout.rdbuf();
+
+	cout << left << setw(12) << "run" << right << setw(10) << "processes" << setw(12) << "seconds"
+		 << setw(18) << "children / s" << setw(14) << "distance" << endl;
+
+	// One process, with the islands and individuals of all the workers
+	{
+		GAOptions single = options;
+		single.num_islands = islands * workers;
+		Logger gen_log;
+		gen_log.start("/dev/null", "/dev/null", "/dev/null");
+		vector<tour_t> best_tour(num_cities);
+		IslandPort port = { nullptr, nullptr, best_tour.data(), 0, 0 };
+
+		cout.rdbuf(quiet.rdbuf());
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		execute_islands(pop_size * workers, max_gen, prob_mutation, prob_crossover, world, gen_log,
+						ga_seed, single, &port);
+		double seconds = seconds_since(start);
+		cout.rdbuf(console);
+		gen_log.end();
+
+		World leader(num_cities, world_size, world_size);
+		for (int c = 0; c < num_cities; c++)
+			leader.cities[c] = world.cities[best_tour[c]];
+		report("single", 1, seconds, static_cast<long long>(pop_size) * max_gen * workers,
+			   leader.calc_distance());
+	}
+
+	// The cluster: forked workers around this process as the coordinator
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		vector<pid_t> children;
+		for (int rank = 0; rank < workers; rank++) {
+			pid_t pid = fork();
+			if (pid == 0) {
+				cout.rdbuf(quiet.rdbuf());
+				Logger gen_log;
+				gen_log.start("/dev/null", "/dev/null", "/dev/null");
+				bool ok = run_worker(address, rank, pop_size, max_gen, prob_mutation, prob_crossover,
+									 world, gen_log, ga_seed, options);
+				gen_log.end();
+				_exit(ok ? 0 : 1);
+			}
+			children.push_back(pid);
+		}
+
+		Logger gen_log;
+		gen_log.start("cluster_timing.csv", "cluster_gen.csv", "cluster_stats.csv");
+		World best(num_cities, world_size, world_size);
+		bool ok = run_coordinator(address, workers, world, gen_log, &best, options);
+		gen_log.end();
+
+		int failed = 0;
+		for (pid_t pid : children) {
+			int status = 0;
+			waitpid(pid, &status, 0);
+			failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+		}
+		double seconds = seconds_since(start);
+		if (!ok || failed > 0) {
+			cerr << "The cluster run failed" << endl;
+			return 1;
+		}
+		report("cluster", workers, seconds, static_cast<long long>(pop_size) * max_gen * workers,
+			   best.calc_distance());
+	}
+
+	return 0;
+}
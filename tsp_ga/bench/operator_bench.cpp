@@ -0,0 +1,314 @@
+/* operator_bench.cpp
+
+ Description   : Times every GA operator on its own, on the CPU and as the
+                 matching OpenCL kernels, over a grid of city counts and
+                 population sizes. For each it reports the time, the cycles
+                 and the bytes moved per gene (one city of one tour), and the
+                 bandwidth that makes. A plain copy of the population is
+                 timed the same way: operators near its bandwidth are memory
+                 bound, those far below it compute bound. Build it with the
+                 engine sources, without main.cpp.
+
+                 CPU cycles are those of the time stamp counter, at its
+                 constant reference rate, on x86. Device cycles are derived
+                 from the device's highest clock frequency. Bytes moved come
+                 from what each operator must read and write, not from
+                 hardware counters.
+
+ Usage         : operator_bench [cities,...] [individuals,...] [cpu|gpu|both]
+                                [ms per measurement]
+ */
+
+// Native includes
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Program includes
+#include "world.h"
+#include "distance.h"
+#include "population.h"
+#include "ga_cpu.h"
+#include "g_population.h"
+#include "rng.h"
+#include "common.h"
+
+using namespace std;
+
+static const int ga_seed = 87654321;
+
+// Keeps the timed results alive
+static volatile double sink;
+
+static uint64_t cycle_count()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static vector<int> parse_list(const char* text)
+{
+	vector<int> values;
+	stringstream in(text);
+	string item;
+	while (getline(in, item, ','))
+		values.push_back(atoi(item.c_str()));
+	return values;
+}
+
+/*
+	A measurement: one call of an operator over the whole population
+*/
+struct Sample
+{
+	double ns;			// Per call
+	double cycles;		// Per call, 0 if unknown
+};
+
+static void report(const char* engine, int num_cities, int pop_size, const char* op,
+				   const Sample& sample, double bytes)
+{
+	double genes = static_cast<double>(num_cities) * pop_size;
+	cout << engine << ", " << num_cities << ", " << pop_size << ", " << op << ", "
+		 << fixed << setprecision(3) << sample.ns / genes << ", "
+		 << sample.cycles / genes << ", "
+		 << setprecision(2) << bytes / genes << ", "
+		 << bytes / sample.ns << endl;
+	cout.unsetf(ios::floatfield);
+}
+
+/*
+	Calls an operator once to warm it up, then repeatedly for at least
+	min_ms, and returns the average call
+*/
+template<typename Op>
+static Sample time_host(float min_ms, Op op)
+{
+	op();
+	long calls = 0;
+	wall_clock::time_point start = wall_clock::now();
+	uint64_t start_cycles = cycle_count();
+	float elapsed;
+	do {
+		op();
+		calls++;
+		elapsed = end_clock(start);
+	} while (elapsed < min_ms);
+	uint64_t cycles = cycle_count() - start_cycles;
+	return { elapsed * 1e6 / calls, static_cast<double>(cycles) / calls };
+}
+
+/*
+	The same for device work: the time between markers enqueued around the
+	calls, on a profiling queue, so it only counts the device
+*/
+template<typename Op>
+static Sample time_device(const opencl_env& env, float min_ms, Op op)
+{
+	op();
+	env.queue().finish();
+	long calls = 0;
+	double ns = 0.0;
+	wall_clock::time_point start = wall_clock::now();
+	do {
+		cl::Event first, last;
+		env.queue().enqueueMarkerWithWaitList(nullptr, &first);
+		for (int i = 0; i < 8; i++)
+			op();
+		env.queue().enqueueMarkerWithWaitList(nullptr, &last);
+		last.wait();
+		ns += last.getProfilingInfo<CL_PROFILING_COMMAND_END>() - first.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+		calls += 8;
+	} while (end_clock(start) < min_ms);
+	ns /= calls;
+	return { ns, ns * env.getMaxClockFrequency() / 1000.0 };
+}
+
+/*
+	Bytes a full evaluation reads per city: the tour and the edge costs
+*/
+static double evaluate_bytes(const DistanceTable& distances)
+{
+	return sizeof(tour_t) + (distances.dense_table() != nullptr ? sizeof(int) : 2 * sizeof(City));
+}
+
+static void bench_cpu(const World& world, int pop_size, float min_ms)
+{
+	const int n = world.num_cities;
+	const double tour_bytes = static_cast<double>(n) * pop_size * sizeof(tour_t);
+	DistanceTable distances(world);
+	Population oldPop(pop_size, world, distances);
+	Population newPop(pop_size, world, distances);
+	init_tours(oldPop.tours, pop_size, n, ga_seed);
+	evaluate(oldPop);
+
+	// The random numbers of every child, drawn ahead of the timing
+	vector<ChildRandoms> randoms(pop_size);
+	for (int j = 0; j < pop_size; j++)
+		child_randoms(randoms[j], ga_seed, 1, j, n);
+	vector<uint32_t> visited(visited_words(n));
+	vector<const tour_t*> parents(2 * pop_size);
+
+	// Reference: copying the tours, a read and a write of every gene
+	Sample sample = time_host(min_ms, [&] {
+		memcpy(newPop.tours, oldPop.tours, n * pop_size * sizeof(tour_t));
+	});
+	report("cpu", n, pop_size, "copy", sample, 2 * tour_bytes);
+
+	// Roulette selection: two binary searches over the probabilities
+	sample = time_host(min_ms, [&] {
+		for (int j = 0; j < pop_size; j++)
+			selection(oldPop, &parents[2 * j], randoms[j].prob_select);
+	});
+	double probes = 2.0 * pop_size * ceil(log2(static_cast<double>(pop_size)));
+	report("cpu", n, pop_size, "select", sample, probes * sizeof(float));
+
+	// Crossover: two parents read, a child written
+	sample = time_host(min_ms, [&] {
+		for (int j = 0; j < pop_size; j++)
+			crossover(&parents[2 * j], newPop.GetTour(j), n, randoms[j].cross_loc, visited.data());
+	});
+	report("cpu", n, pop_size, "crossover", sample, 3 * tour_bytes);
+
+	// Mutation: two genes swapped in every child
+	sample = time_host(min_ms, [&] {
+		for (int j = 0; j < pop_size; j++)
+			mutate(newPop.GetTour(j), randoms[j].mutate_loc);
+	});
+	report("cpu", n, pop_size, "mutate", sample, 4.0 * pop_size * sizeof(tour_t));
+
+	// Evaluation: every tour and its edge costs
+	sample = time_host(min_ms, [&] {
+		for (int j = 0; j < pop_size; j++)
+			newPop.CalcFitness(j);
+	});
+	report("cpu", n, pop_size, "evaluate", sample,
+		   static_cast<double>(n) * pop_size * evaluate_bytes(distances) + pop_size * 2 * sizeof(float));
+
+	// Fitness probabilities: a prefix sum of the fitnesses
+	sample = time_host(min_ms, [&] {
+		calc_fit_prob(newPop);
+	});
+	report("cpu", n, pop_size, "fit_prob", sample, 2.0 * pop_size * sizeof(float));
+
+	// The leader: the fitnesses scanned; its tour is only copied out when
+	// it is the best so far, which after the first call it no longer is
+	int leader;
+	BestTour best(n);
+	sample = time_host(min_ms, [&] {
+		sink = newPop.select_leader(leader, best);
+	});
+	report("cpu", n, pop_size, "leader", sample, pop_size * sizeof(float));
+}
+
+static void bench_gpu(const opencl_env& env, const World& world, int pop_size, float min_ms)
+{
+	const int n = world.num_cities;
+	const double tour_bytes = static_cast<double>(n) * pop_size * sizeof(tour_t);
+	DistanceTable distances(world);
+	g_CityTable table(env, world, distances);
+
+	vector<tour_t> tours(static_cast<size_t>(n) * pop_size);
+	init_tours(tours.data(), pop_size, n, ga_seed);
+	g_Population oldPop(env, pop_size, world, table, tours.data());
+	g_Population newPop(env, pop_size, world, table);
+	cl::Buffer sel_ix = env.pool().acquire<int>(2 * pop_size);
+	cl::Buffer visited = env.pool().acquire<cl_uint>(oldPop.visited_bytes() / sizeof(cl_uint) * pop_size);
+	oldPop.bind(newPop, sel_ix, visited, ga_seed, 0.8f, 0.15f, selection_t::roulette, 2);
+	oldPop.evaluate();
+
+	// Reference: copying the tours within the device
+	cl::Buffer from = env.pool().acquire<tour_t>(n * pop_size);
+	cl::Buffer to = env.pool().acquire<tour_t>(n * pop_size);
+	Sample sample = time_device(env, min_ms, [&] {
+		env.queue().enqueueCopyBuffer(from, to, 0, 0, n * pop_size * sizeof(tour_t));
+	});
+	report("gpu", n, pop_size, "copy", sample, 2 * tour_bytes);
+
+	sample = time_device(env, min_ms, [&] {
+		oldPop.select_parents(1);
+	});
+	double probes = 2.0 * pop_size * ceil(log2(static_cast<double>(pop_size)));
+	report("gpu", n, pop_size, "select", sample, probes * sizeof(float) + 2.0 * pop_size * sizeof(int));
+
+	sample = time_device(env, min_ms, [&] {
+		oldPop.crossover(1);
+	});
+	report("gpu", n, pop_size, "crossover", sample, 3 * tour_bytes + 2.0 * pop_size * sizeof(int));
+
+	sample = time_device(env, min_ms, [&] {
+		oldPop.mutate(1);
+	});
+	report("gpu", n, pop_size, "mutate", sample, 4.0 * pop_size * sizeof(tour_t));
+
+	sample = time_device(env, min_ms, [&] {
+		newPop.calc_fitness();
+	});
+	report("gpu", n, pop_size, "evaluate", sample,
+		   static_cast<double>(n) * pop_size * evaluate_bytes(distances) + pop_size * sizeof(float));
+
+	sample = time_device(env, min_ms, [&] {
+		newPop.calc_fit_prob();
+	});
+	report("gpu", n, pop_size, "fit_prob", sample, 2.0 * pop_size * sizeof(float));
+
+	// The fused kernel, all of the above but the selection in one pass
+	if (oldPop.breed_group_size() > 0) {
+		sample = time_device(env, min_ms, [&] {
+			oldPop.breed(1);
+		});
+		report("gpu", n, pop_size, "breed", sample,
+			   3 * tour_bytes + static_cast<double>(n) * pop_size * (evaluate_bytes(distances) - sizeof(tour_t)));
+	}
+
+	// The leader, found and read back; timed on the host, as the engine
+	// waits for it
+	g_Leader leader(env, world);
+	BestTour best(n);
+	sample = time_host(min_ms, [&] {
+		newPop.read_leader(leader);
+		sink = leader.select(best, distances);
+	});
+	report("gpu", n, pop_size, "leader", sample, pop_size * sizeof(float) + n * sizeof(tour_t));
+
+	env.pool().release(from);
+	env.pool().release(to);
+	env.pool().release(sel_ix);
+	env.pool().release(visited);
+}
+
+int main(int argc, const char * argv[])
+{
+	vector<int> city_counts = parse_list(argc > 1 ? argv[1] : "25,100,250,1000");
+	vector<int> pop_sizes = parse_list(argc > 2 ? argv[2] : "1000,10000");
+	string engines = argc > 3 ? argv[3] : "both";
+	float min_ms = argc > 4 ? static_cast<float>(atof(argv[4])) : 200.0f;
+	bool cpu = engines != "gpu", gpu = engines != "cpu";
+
+	opencl_env* env = gpu ? new opencl_env(CL_DEVICE_TYPE_GPU, CL_QUEUE_PROFILING_ENABLE) : nullptr;
+
+	cout << "engine, cities, individuals, operator, ns/gene, cycles/gene, bytes/gene, GB/s" << endl;
+	for (int num_cities : city_counts) {
+		World world(num_cities, 10000, 10000, 12345678);
+		for (int pop_size : pop_sizes) {
+			if (cpu)
+				bench_cpu(world, pop_size, min_ms);
+			if (gpu)
+				bench_gpu(*env, world, pop_size, min_ms);
+		}
+	}
+
+	delete env;
+	return 0;
+}
@@ -0,0 +1,537 @@
+//
+//  benchmark.cpp
+//  tsp_ga
+//
+
+#include "benchmark.h"
+#include "world.h"
+#include "log.h"
+#include "timing.h"
+#include "ga_cpu.h"
+#include "ga_gpu.h"
+#include "islands.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <limits>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char* engine_names[] = { "cpu", "gpu", "gpu-multi", "islands" };
+static const char* selection_names[] = { "roulette", "alias", "tournament" };
+static const char* seeding_names[] = { "random", "nearest-neighbor", "greedy", "hilbert" };
+static const char* device_names[] = { "gpu", "cpu", "any" };
+static const char* topology_names[] = { "ring", "torus", "random" };
+
+BenchmarkConfig::BenchmarkConfig()
+:
+	cities(1, 25), pop_sizes(1, 100000), generations(1, 10),
+	threads(1, 0), warmup(1), repeats(1),
+	prob_mutation(0.15f), prob_crossover(0.8f),
+	world_seed(12345678), ga_seed(87654321), world_size(10000),
+	log_dir("bench_logs"), quiet(false)
+{
+	engines.push_back(engine_t::cpu);
+	engines.push_back(engine_t::gpu);
+}
+
+/*
+	Index of a name in a table of count names, or -1
+*/
+static int find_name(const char* const* names, int count, const string& name)
+{
+	for (int i = 0; i < count; i++)
+		if (name == names[i])
+			return i;
+	return -1;
+}
+
+static bool parse_int(const string& text, int& value)
+{
+	char* end;
+	errno = 0;
+	long v = strtol(text.c_str(), &end, 10);
+	if (text.empty() || *end != '\0' || errno != 0 || v < -2147483647L || v > 2147483647L)
+		return false;
+	value = static_cast<int>(v);
+	return true;
+}
+
+static bool parse_float(const string& text, float& value)
+{
+	char* end;
+	value = strtof(text.c_str(), &end);
+	return !text.empty() && *end == '\0';
+}
+
+static bool parse_bool(const string& text, bool& value)
+{
+	value = text == "1";
+	return text == "0" || text == "1";
+}
+
+/*
+	A string without the spaces around it
+*/
+static string trim(const string& text)
+{
+	size_t first = text.find_first_not_of(" \t\r");
+	size_t last = text.find_last_not_of(" \t\r");
+	return first == string::npos ? "" : text.substr(first, last - first + 1);
+}
+
+/*
+	Splits a comma-separated list, trimming the spaces around its items
+*/
+static vector<string> split_list(const string& text)
+{
+	vector<string> items;
+	stringstream in(text);
+	string item;
+	while (getline(in, item, ','))
+		items.push_back(trim(item));
+	return items;
+}
+
+static bool parse_int_list(const string& text, int min_value, vector<int>& values)
+{
+	vector<int> parsed;
+	for (const string& item : split_list(text)) {
+		int v;
+		if (!parse_int(item, v) || v < min_value)
+			return false;
+		parsed.push_back(v);
+	}
+	if (parsed.empty())
+		return false;
+	values.swap(parsed);
+	return true;
+}
+
+/*
+	Applies one option; returns false if the name or the value is invalid
+*/
+static bool set_option(BenchmarkConfig& config, const string& name, const string& value)
+{
+	if (name == "cities") {
+		vector<int> cities;
+		if (!parse_int_list(value, 3, cities))
+			return false;
+		for (int c : cities)
+			if (c > max_cities) {
+				cerr << c << " cities do not fit the " << max_cities
+					 << " tour indices; build with TSP_GA_WIDE_INDEX" << endl;
+				return false;
+			}
+		config.cities.swap(cities);
+		return true;
+	}
+	if (name == "population")
+		return parse_int_list(value, 2, config.pop_sizes);
+	if (name == "generations")
+		return parse_int_list(value, 1, config.generations);
+	if (name == "threads")
+		return parse_int_list(value, 0, config.threads);
+	if (name == "engines") {
+		vector<engine_t> engines;
+		for (const string& item : split_list(value)) {
+			int e = find_name(engine_names, 4, item);
+			if (e < 0)
+				return false;
+			engines.push_back(static_cast<engine_t>(e));
+		}
+		config.engines.swap(engines);
+		return !config.engines.empty();
+	}
+	if (name == "warmup")
+		return parse_int(value, config.warmup) && config.warmup >= 0;
+	if (name == "repeats")
+		return parse_int(value, config.repeats) && config.repeats >= 1;
+	if (name == "json") {
+		config.json_path = value;
+		return true;
+	}
+	if (name == "csv") {
+		config.csv_path = value;
+		return true;
+	}
+	if (name == "logs") {
+		config.log_dir = value == "none" ? "" : value;
+		return true;
+	}
+	if (name == "config")
+		return read_benchmark_config(value.c_str(), config);
+	if (name == "mutation")
+		return parse_float(value, config.prob_mutation);
+	if (name == "crossover")
+		return parse_float(value, config.prob_crossover);
+	if (name == "world-seed")
+		return parse_int(value, config.world_seed);
+	if (name == "ga-seed")
+		return parse_int(value, config.ga_seed);
+	if (name == "world-size")
+		return parse_int(value, config.world_size) && config.world_size > 0;
+	if (name == "selection") {
+		int s = find_name(selection_names, 3, value);
+		config.options.selection = static_cast<selection_t>(s);
+		return s >= 0;
+	}
+	if (name == "seeding") {
+		int s = find_name(seeding_names, 4, value);
+		config.options.seeding = static_cast<seeding_t>(s);
+		return s >= 0;
+	}
+	if (name == "device") {
+		int d = find_name(device_names, 3, value);
+		config.options.device = static_cast<device_t>(d);
+		return d >= 0;
+	}
+	if (name == "tournament-size")
+		return parse_int(value, config.options.tournament_size) &&
+			config.options.tournament_size >= 2 && config.options.tournament_size <= max_tournament_size;
+	if (name == "elites")
+		return parse_int(value, config.options.num_elites) &&
+			config.options.num_elites >= 0 && config.options.num_elites <= max_elites;
+	if (name == "islands")
+		return parse_int(value, config.options.num_islands) && config.options.num_islands >= 1;
+	if (name == "depth")
+		return parse_int(value, config.options.pipeline_depth) && config.options.pipeline_depth >= 1;
+	if (name == "topology") {
+		int t = find_name(topology_names, 3, value);
+		config.options.topology = static_cast<topology_t>(t);
+		return t >= 0;
+	}
+	if (name == "migration-interval")
+		return parse_int(value, config.options.migration_interval) && config.options.migration_interval >= 1;
+	if (name == "migration-size")
+		return parse_int(value, config.options.migration_size) && config.options.migration_size >= 1;
+	if (name == "improve-prob")
+		return parse_float(value, config.options.improve_prob) &&
+			config.options.improve_prob >= 0.0f && config.options.improve_prob <= 1.0f;
+	if (name == "improve-leader")
+		return parse_bool(value, config.options.improve_leader);
+	if (name == "improve-moves")
+		return parse_int(value, config.options.improve_moves) && config.options.improve_moves >= 0;
+	if (name == "improve-neighbors")
+		return parse_int(value, config.options.improve_neighbors) && config.options.improve_neighbors >= 1;
+	if (name == "distance-budget") {
+		int mb;
+		if (!parse_int(value, mb) || mb < 0)
+			return false;
+		config.options.distance_budget = static_cast<size_t>(mb) << 20;
+		return true;
+	}
+	if (name == "distance-cache")
+		return parse_bool(value, config.options.distance_cache);
+	if (name == "quiet")
+		return parse_bool(value, config.quiet);
+	if (name == "profile")
+		return parse_bool(value, config.options.profile);
+	return false;
+}
+
+bool parse_benchmark_args(int argc, const char* argv[], BenchmarkConfig& config)
+{
+	for (int i = 1; i < argc; i += 2) {
+		string arg = argv[i];
+		if (arg.compare(0, 2, "--") != 0 || i + 1 >= argc) {
+			cerr << "Expected --option value, got " << arg << endl;
+			return false;
+		}
+		if (!set_option(config, arg.substr(2), argv[i + 1])) {
+			cerr << "Invalid option " << arg << " " << argv[i + 1] << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool read_benchmark_config(const char* path, BenchmarkConfig& config)
+{
+	ifstream in(path);
+	if (!in.is_open()) {
+		cerr << "Cannot read " << path << endl;
+		return false;
+	}
+	string line;
+	for (int number = 1; getline(in, line); number++) {
+		line = trim(line.substr(0, line.find('#')));
+		if (line.empty())
+			continue;
+		size_t equals = line.find('=');
+		if (equals == string::npos ||
+			!set_option(config, trim(line.substr(0, equals)), trim(line.substr(equals + 1)))) {
+			cerr << path << ":" << number << ": invalid line" << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+	Nearest-rank percentile of some values, 0 if there are none
+*/
+static float percentile(vector<float> values, float p)
+{
+	if (values.empty())
+		return 0.0f;
+	size_t rank = static_cast<size_t>(p / 100.0f * values.size() + 0.999f);
+	rank = min(max<size_t>(rank, 1), values.size());
+	nth_element(values.begin(), values.begin() + (rank - 1), values.end());
+	return values[rank - 1];
+}
+
+/*
+	Runs an engine once; the GPU engines run on env
+*/
+static void run_engine(engine_t engine, int pop_size, int max_gen, const BenchmarkConfig& config,
+					   const World& world, Logger& gen_log, const GAOptions& options,
+					   const opencl_env* env)
+{
+	GAOptions engine_options = options;
+	switch (engine) {
+		case engine_t::cpu:
+			execute(pop_size, max_gen, config.prob_mutation, config.prob_crossover, world,
+					gen_log, config.ga_seed, engine_options);
+			break;
+		case engine_t::gpu:
+		case engine_t::gpu_multi:
+			engine_options.fused = engine == engine_t::gpu;
+			g_execute(pop_size, max_gen, config.prob_mutation, config.prob_crossover, world,
+					  gen_log, config.ga_seed, engine_options, env);
+			break;
+		case engine_t::islands:
+			execute_islands(pop_size, max_gen, config.prob_mutation, config.prob_crossover, world,
+							gen_log, config.ga_seed, engine_options);
+			break;
+	}
+}
+
+/*
+	Runs a case: the warmup runs, then the measured ones, logging those
+*/
+static BenchmarkResult run_case(const BenchmarkConfig& config, int num_cities, int pop_size,
+								int max_gen, engine_t engine, int threads, const opencl_env* env)
+{
+	BenchmarkResult result;
+	result.num_cities = num_cities;
+	result.pop_size = pop_size;
+	result.max_gen = max_gen;
+	result.engine = engine;
+	result.threads = threads;
+	result.best_distance = numeric_limits<float>::quiet_NaN();
+
+	World world(num_cities, config.world_size, config.world_size, config.world_seed);
+	RunStats stats;
+	GAOptions options = config.options;
+	options.num_threads = threads;
+	options.stats = &stats;
+
+	// The engines print every generation
+	ofstream quiet("/dev/null");
+	streambuf* console = cout.rdbuf();
+	if (config.quiet)
+		cout.rdbuf(quiet.rdbuf());
+
+	Logger gen_log;
+	for (int w = 0; w < config.warmup; w++) {
+		gen_log.start("/dev/null", "/dev/null", "/dev/null");
+		run_engine(engine, pop_size, max_gen, config, world, gen_log, options, env);
+		gen_log.end();
+	}
+
+	const char* label = engine_names[static_cast<int>(engine)];
+	if (config.log_dir.empty()) {
+		gen_log.start("/dev/null", "/dev/null", "/dev/null");
+	} else {
+		string prefix = config.log_dir + "/" + to_string(num_cities) + "_" + to_string(pop_size) + "_" +
+			to_string(max_gen) + "-" + label + "-t" + to_string(threads);
+		gen_log.start(prefix + "_timing.csv", prefix + "_gen.csv", prefix + "_stats.csv");
+	}
+
+	vector<float> gen_times, run_times;
+	PhaseTimes total_phases;
+	wall_clock::time_point total_time = wall_clock::now();
+	for (int r = 0; r < config.repeats; r++) {
+		wall_clock::time_point run_time = wall_clock::now();
+		run_engine(engine, pop_size, max_gen, config, world, gen_log, options, env);
+		run_times.push_back(end_clock(run_time));
+		total_phases += stats.phases;
+		gen_log.write_stats(r + 1, label, run_times.back(), config.prob_mutation, config.prob_crossover,
+							pop_size, max_gen, config.world_seed, config.ga_seed, config.world_size,
+							config.world_size, num_cities, &stats.phases);
+
+		float elapsed = 0.0f, best = 0.0f;
+		for (const GenerationSample& sample : stats.generations) {
+			gen_times.push_back(sample.time_ms);
+			elapsed += sample.time_ms;
+			if (r == 0 && (result.quality.empty() || sample.best_distance < best)) {
+				best = sample.best_distance;
+				result.quality.push_back(make_pair(elapsed, best));
+			}
+		}
+		if (r == 0 && !stats.generations.empty())
+			result.best_distance = best;
+	}
+	gen_log.write_stats(-1, label, end_clock(total_time), config.prob_mutation, config.prob_crossover,
+						pop_size, max_gen, config.world_seed, config.ga_seed, config.world_size,
+						config.world_size, num_cities, &total_phases);
+	gen_log.end();
+	cout.rdbuf(console);
+
+	result.median_gen_ms = percentile(gen_times, 50.0f);
+	result.p95_gen_ms = percentile(gen_times, 95.0f);
+	result.median_run_ms = percentile(run_times, 50.0f);
+	
+	// The islands breed side by side at their own pace, and a generation's
+	// time is only what the slowest of them spent breeding it, not when all
+	// of them were done with it, so their throughput is the whole run's
+	double gen_s = engine == engine_t::islands ? result.median_run_ms / 1000.0 / max_gen
+		: result.median_gen_ms / 1000.0;
+	result.individuals_per_s = gen_s > 0.0 ? pop_size / gen_s : 0.0;
+	result.edges_per_s = result.individuals_per_s * num_cities;
+	return result;
+}
+
+static void print_header()
+{
+	cout << setw(7) << "cities" << setw(11) << "population" << setw(7) << "gens"
+		 << setw(11) << "engine" << setw(8) << "threads"
+		 << setw(11) << "gen ms" << setw(11) << "p95 ms" << setw(12) << "run ms"
+		 << setw(14) << "indiv / s" << setw(14) << "edges / s" << setw(13) << "distance" << endl;
+}
+
+static void print_result(const BenchmarkResult& r)
+{
+	cout << setw(7) << r.num_cities << setw(11) << r.pop_size << setw(7) << r.max_gen
+		 << setw(11) << engine_names[static_cast<int>(r.engine)] << setw(8) << r.threads
+		 << fixed << setprecision(3)
+		 << setw(11) << r.median_gen_ms << setw(11) << r.p95_gen_ms
+		 << setprecision(1) << setw(12) << r.median_run_ms
+		 << setprecision(0) << setw(14) << r.individuals_per_s << setw(14) << r.edges_per_s
+		 << setprecision(1) << setw(13);
+	if (std::isnan(r.best_distance))
+		cout << "-" << endl;
+	else
+		cout << r.best_distance << endl;
+	cout.unsetf(ios::floatfield);
+	cout << setprecision(6);
+}
+
+vector<BenchmarkResult> run_benchmarks(const BenchmarkConfig& config)
+{
+	vector<BenchmarkResult> results;
+	if (!config.log_dir.empty() && mkdir(config.log_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+		cerr << "Cannot create " << config.log_dir << ": " << strerror(errno) << endl;
+		exit(1);
+	}
+	if (config.quiet)
+		print_header();
+	
+	// One device for every GPU run, so that the runs after the first reuse
+	// its program and buffers
+	opencl_env* env = nullptr;
+	for (engine_t engine : config.engines)
+		if (env == nullptr && (engine == engine_t::gpu || engine == engine_t::gpu_multi))
+			env = g_create_env(config.options);
+	
+	for (int num_cities : config.cities)
+		for (int pop_size : config.pop_sizes)
+			for (int max_gen : config.generations)
+				for (engine_t engine : config.engines)
+					for (size_t t = 0; t < config.threads.size(); t++) {
+						// The GPU engines only use threads to seed the first generation
+						if (t > 0 && (engine == engine_t::gpu || engine == engine_t::gpu_multi))
+							break;
+						results.push_back(run_case(config, num_cities, pop_size, max_gen, engine,
+												   config.threads[t], env));
+						if (!config.quiet)
+							print_header();
+						print_result(results.back());
+					}
+	delete env;
+	return results;
+}
+
+bool write_benchmark_json(const char* path, const BenchmarkConfig& config,
+						  const vector<BenchmarkResult>& results)
+{
+	ofstream out(path);
+	if (!out.is_open())
+		return false;
+	out << setprecision(9);
+
+	out << "{\n"
+		<< "  \"build\": { \"compiler\": \"" << __VERSION__ << "\", \"date\": \"" << __DATE__ << " " << __TIME__ << "\""
+#ifdef TSP_GA_WIDE_INDEX
+		<< ", \"wide_index\": true"
+#endif
+		<< " },\n"
+		<< "  \"settings\": { \"warmup\": " << config.warmup << ", \"repeats\": " << config.repeats
+		<< ", \"mutation\": " << config.prob_mutation << ", \"crossover\": " << config.prob_crossover
+		<< ", \"world_seed\": " << config.world_seed << ", \"ga_seed\": " << config.ga_seed
+		<< ", \"world_size\": " << config.world_size
+		<< ", \"selection\": \"" << selection_names[static_cast<int>(config.options.selection)] << "\""
+		<< ", \"seeding\": \"" << seeding_names[static_cast<int>(config.options.seeding)] << "\""
+		<< ", \"elites\": " << config.options.num_elites << ", \"islands\": " << config.options.num_islands
+		<< ", \"pipeline_depth\": " << config.options.pipeline_depth
+		<< ", \"tournament_size\": " << config.options.tournament_size
+		<< ", \"topology\": \"" << topology_names[static_cast<int>(config.options.topology)] << "\""
+		<< ", \"migration_interval\": " << config.options.migration_interval
+		<< ", \"migration_size\": " << config.options.migration_size
+		<< ", \"improve_prob\": " << config.options.improve_prob
+		<< ", \"improve_leader\": " << (config.options.improve_leader ? "true" : "false")
+		<< ", \"improve_moves\": " << config.options.improve_moves
+		<< ", \"improve_neighbors\": " << config.options.improve_neighbors << " },\n"
+		<< "  \"results\": [";
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchmarkResult& r = results[i];
+		out << (i > 0 ? "," : "") << "\n    { \"cities\": " << r.num_cities
+			<< ", \"population\": " << r.pop_size << ", \"generations\": " << r.max_gen
+			<< ", \"engine\": \"" << engine_names[static_cast<int>(r.engine)] << "\""
+			<< ", \"threads\": " << r.threads
+			<< ", \"median_gen_ms\": " << r.median_gen_ms << ", \"p95_gen_ms\": " << r.p95_gen_ms
+			<< ", \"median_run_ms\": " << r.median_run_ms
+			<< ", \"individuals_per_s\": " << r.individuals_per_s << ", \"edges_per_s\": " << r.edges_per_s
+			<< ", \"best_distance\": ";
+		if (std::isnan(r.best_distance))
+			out << "null";
+		else
+			out << r.best_distance;
+		out << ",\n      \"quality\": [";
+		for (size_t q = 0; q < r.quality.size(); q++)
+			out << (q > 0 ? ", " : "") << "[" << r.quality[q].first << ", " << r.quality[q].second << "]";
+		out << "] }";
+	}
+	out << "\n  ]\n}\n";
+	return out.good();
+}
+
+bool write_benchmark_csv(const char* path, const vector<BenchmarkResult>& results)
+{
+	ofstream out(path);
+	if (!out.is_open())
+		return false;
+	out << setprecision(9);
+
+	out << "Cities,Population,Generations,Engine,Threads,Median Generation [ms],P95 Generation [ms],"
+		"Median Run [ms],Individuals / s,Edges / s,Best Distance" << endl;
+	for (const BenchmarkResult& r : results) {
+		out << r.num_cities << "," << r.pop_size << "," << r.max_gen << ","
+			<< engine_names[static_cast<int>(r.engine)] << "," << r.threads << ","
+			<< r.median_gen_ms << "," << r.p95_gen_ms << "," << r.median_run_ms << ","
+			<< r.individuals_per_s << "," << r.edges_per_s << ",";
+		if (!std::isnan(r.best_distance))
+			out << r.best_distance;
+		out << endl;
+	}
+	return out.good();
+}
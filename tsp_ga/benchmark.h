@@ -0,0 +1,149 @@
+//
+//  benchmark.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__benchmark__
+#define __tsp_ga__benchmark__
+
+#include <string>
+#include <vector>
+
+#include "options.h"
+
+/*
+ Benchmark suite of the engines, driven by the command line or a
+ configuration file instead of a table compiled into main().
+
+ Every combination of the city counts, population sizes, generation counts,
+ engines and thread counts is a case. A case runs warmup times unmeasured,
+ then repeats times measured, with the same seeds every time, so the runs
+ only differ in their timing (apart from the island model's migrations, see
+ islands.h). The results go to the console and, if asked for, to JSON and
+ CSV files, to compare builds.
+
+ Options, each as "--name value" on the command line or as "name = value"
+ on a line of a configuration file ('#' starts a comment):
+
+   cities, population, generations : Comma-separated lists of sizes
+   engines     : Comma-separated list of cpu, gpu, gpu-multi (the GPU engine
+                 without the fused breed kernel) and islands
+   threads     : Comma-separated list of CPU thread counts, 0 for all; the
+                 GPU engines only run with the first
+   warmup, repeats : Unmeasured and measured runs of every case
+   json, csv   : Paths of the result files
+   logs        : Directory of the timing, generation and stats logs of every
+                 case, created if missing (bench_logs by default), or "none"
+   config      : A configuration file, read in place
+   mutation, crossover : GA probabilities
+   world-seed, ga-seed, world-size : The world and the GA's random numbers
+   selection   : roulette, tournament or alias
+   tournament-size : Competitors per tournament
+   seeding     : random, nearest-neighbor, greedy or hilbert
+   elites, islands, depth : GAOptions::num_elites, num_islands and
+                 pipeline_depth
+   topology    : ring, torus or random, the island model's migration links
+   migration-interval, migration-size : Generations between migrations and
+                 migrants per link
+   improve-prob, improve-leader, improve-moves, improve-neighbors : Local
+                 search of the CPU engines, as GAOptions::improve_*
+   distance-budget : MB the distance table may use, 0 to compute every
+                 distance from the coordinates
+   distance-cache : 1 to cache the distances of worlds over the budget
+                 instead of computing them (distance.h)
+   device      : gpu, cpu or any, the OpenCL device of the GPU engines
+   quiet       : 1 to hide the progress of the runs
+   profile     : 1 to time the phases of the generations into the stats log
+ */
+
+/*
+ An engine the suite can run
+ */
+enum class engine_t
+{
+	cpu,		// execute()
+	gpu,		// g_execute()
+	gpu_multi,	// g_execute() with the multi-kernel breeding path
+	islands		// execute_islands()
+};
+
+struct BenchmarkConfig
+{
+	std::vector<int> cities;
+	std::vector<int> pop_sizes;
+	std::vector<int> generations;
+	std::vector<engine_t> engines;
+	std::vector<int> threads;
+	int warmup;
+	int repeats;
+
+	float prob_mutation;
+	float prob_crossover;
+	int world_seed;
+	int ga_seed;
+	int world_size;
+	GAOptions options;
+
+	std::string json_path;		// Empty for no file
+	std::string csv_path;
+	std::string log_dir;		// Empty for no logs
+	bool quiet;
+
+	// The case main() used to run: 25 cities, 100000 individuals, 10
+	// generations, on the CPU then the GPU
+	BenchmarkConfig();
+};
+
+/*
+ The measurements of a case
+ */
+struct BenchmarkResult
+{
+	int num_cities;
+	int pop_size;
+	int max_gen;
+	engine_t engine;
+	int threads;
+
+	float median_gen_ms;	// Over every generation of every measured run
+	float p95_gen_ms;
+	float median_run_ms;	// Whole runs, setup included
+	double individuals_per_s;	// Children bred, at the median generation time
+								// (from the run time for the island model)
+	double edges_per_s;		// Tour edges evaluated, one per city of every child
+	float best_distance;	// At the end of the first measured run, NaN if it
+							// logged no generation
+
+	// Quality against time in the first measured run: the time since its
+	// first generation, summed from the generation times, at which the best
+	// distance improved, and that distance
+	std::vector<std::pair<float, float>> quality;
+};
+
+/*
+ Applies the options of the command line, after the program name, on top of
+ the defaults. Returns false, printing the reason, on an unknown option or
+ an invalid value.
+ */
+bool parse_benchmark_args(int argc, const char* argv[], BenchmarkConfig& config);
+
+/*
+ Applies the options of a configuration file. Returns false, printing the
+ reason, if it cannot be read or has an invalid line.
+ */
+bool read_benchmark_config(const char* path, BenchmarkConfig& config);
+
+/*
+ Runs every case of the suite, printing a line of results per case
+ */
+std::vector<BenchmarkResult> run_benchmarks(const BenchmarkConfig& config);
+
+/*
+ Writes the results, with the settings they were measured with, for
+ tracking them across builds. Returns false if the file cannot be written.
+ */
+bool write_benchmark_json(const char* path, const BenchmarkConfig& config,
+						  const std::vector<BenchmarkResult>& results);
+bool write_benchmark_csv(const char* path, const std::vector<BenchmarkResult>& results);
+
+#endif /* defined(__tsp_ga__benchmark__) */
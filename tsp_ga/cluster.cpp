@@ -0,0 +1,456 @@
+//
+//  cluster.cpp
+//  tsp_ga
+//
+
+#include "cluster.h"
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "islands.h"
+#include "migration.h"
+#include "distance.h"
+#include "wire.h"
+#include "rng.h"
+
+using namespace std;
+
+// Migrant batches a worker's links to the network hold
+static const int port_capacity = 4;
+
+// Unsent bytes the coordinator keeps for a worker before dropping migrants
+static const size_t max_pending_bytes = 1 << 20;
+
+// Largest payload accepted, to catch corrupt streams
+static const uint32_t max_payload_bytes = 1 << 26;
+
+// How long a worker keeps trying to reach the coordinator
+static const int connect_attempts = 500;
+static const int connect_retry_ms = 10;
+
+// How long the coordinator waits for all the workers to connect
+static const int accept_timeout_ms = 60000;
+
+// Poll timeout of a worker's I/O thread
+static const int poll_ms = 1;
+
+/*
+ Opens a listening or a connected socket for an address; returns -1 on
+ failure
+ */
+static int open_socket(const string& address, bool listening)
+{
+	if (address.compare(0, 5, "unix:") == 0) {
+		string path = address.substr(5);
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path))
+			return -1;
+		strcpy(addr.sun_path, path.c_str());
+
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+		bool ok;
+		if (listening) {
+			unlink(path.c_str());
+			ok = bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 && listen(fd, SOMAXCONN) == 0;
+		} else {
+			ok = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+		}
+		if (!ok) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	if (address.compare(0, 4, "tcp:") == 0) {
+		size_t colon = address.rfind(':');
+		if (colon < 4)
+			return -1;
+		string host = address.substr(4, colon - 4);
+		string port = address.substr(colon + 1);
+
+		addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = listening ? AI_PASSIVE : 0;
+		addrinfo* found;
+		if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found) != 0)
+			return -1;
+
+		int fd = -1;
+		for (addrinfo* ai = found; ai != nullptr && fd < 0; ai = ai->ai_next) {
+			fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+			if (fd < 0)
+				continue;
+			int one = 1;
+			bool ok;
+			if (listening) {
+				setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+				ok = bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0;
+			} else {
+				ok = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+				if (ok)
+					setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			}
+			if (!ok) {
+				close(fd);
+				fd = -1;
+			}
+		}
+		freeaddrinfo(found);
+		return fd;
+	}
+
+	return -1;
+}
+
+/*
+ A non-blocking socket with its unparsed input and unsent output
+ */
+struct Connection
+{
+	int fd;
+	int rank;			// Rank of the worker at the other end, once known
+	bool open;
+	vector<uint8_t> in;
+	vector<uint8_t> out;
+	size_t sent;		// Bytes of out already sent
+
+	explicit Connection(int fd)
+	:
+		fd(fd), rank(-1), open(true), sent(0)
+	{
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	}
+
+	size_t pending() const
+	{
+		return out.size() - sent;
+	}
+
+	/*
+	 Reads whatever has arrived; the connection closes at the end of the
+	 stream
+	 */
+	void receive()
+	{
+		uint8_t buffer[65536];
+		while (open) {
+			ssize_t got = recv(fd, buffer, sizeof(buffer), 0);
+			if (got > 0)
+				in.insert(in.end(), buffer, buffer + got);
+			else if (got < 0 && errno == EINTR)
+				continue;
+			else if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				break;
+			else
+				open = false;
+		}
+	}
+
+	/*
+	 Takes the next complete message, header included, off the input
+	 */
+	bool next(MessageHeader& header, vector<uint8_t>& message)
+	{
+		if (in.size() < message_header_bytes)
+			return false;
+		if (!decode_header(in.data(), header) || header.payload_bytes > max_payload_bytes) {
+			open = false;
+			in.clear();
+			return false;
+		}
+		size_t total = message_header_bytes + header.payload_bytes;
+		if (in.size() < total)
+			return false;
+		message.assign(in.begin(), in.begin() + total);
+		in.erase(in.begin(), in.begin() + total);
+		return true;
+	}
+
+	/*
+	 Sends as much of the output as the socket takes
+	 */
+	void flush()
+	{
+		while (open && pending() > 0) {
+			ssize_t put = send(fd, out.data() + sent, pending(), MSG_NOSIGNAL);
+			if (put > 0)
+				sent += put;
+			else if (put < 0 && errno == EINTR)
+				continue;
+			else if (put < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				break;
+			else
+				open = false;
+		}
+		if (sent == out.size()) {
+			out.clear();
+			sent = 0;
+		}
+	}
+
+	/*
+	 Sends all of the output, waiting for the socket
+	 */
+	void drain()
+	{
+		flush();
+		while (open && pending() > 0) {
+			pollfd p = { fd, POLLOUT, 0 };
+			poll(&p, 1, -1);
+			flush();
+		}
+	}
+};
+
+bool run_coordinator(const string& address, int num_workers, const World& baseWorld,
+					 Logger& gen_log, World* best, const GAOptions& options)
+{
+	int listener = open_socket(address, true);
+	if (listener < 0) {
+		cerr << "Cannot listen on " << address << ": " << strerror(errno) << endl;
+		return false;
+	}
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	int n = baseWorld.num_cities;
+	DistanceTable distances(baseWorld);
+
+	// Wait for every worker, for a while
+	vector<Connection> workers;
+	while (static_cast<int>(workers.size()) < num_workers) {
+		int waited = static_cast<int>(chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count());
+		pollfd p = { listener, POLLIN, 0 };
+		int ready = waited < accept_timeout_ms ? poll(&p, 1, accept_timeout_ms - waited) : 0;
+		if (ready < 0 && errno == EINTR)
+			continue;
+		if (ready <= 0)
+			break;
+		int fd = accept(listener, nullptr, nullptr);
+		if (fd >= 0)
+			workers.push_back(Connection(fd));
+		else if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+			break;
+	}
+	close(listener);
+	if (address.compare(0, 5, "unix:") == 0)
+		unlink(address.substr(5).c_str());
+	if (static_cast<int>(workers.size()) < num_workers)
+		cerr << "Only " << workers.size() << " of " << num_workers << " workers connected" << endl;
+	
+	// Most tours a message may hold: migrants, or a single leader
+	const int max_tours = max(options.migration_size, 1);
+
+	vector<int> by_rank(num_workers, -1);
+	vector<tour_t> tours;
+	vector<int> lengths;
+	vector<uint8_t> message;
+	MessageHeader header;
+
+	// The global best
+	World bestLeader(n, baseWorld.height, baseWorld.width);
+	int best_rank = -1, best_generation = 0;
+
+	long long batches_routed = 0, batches_dropped = 0, bytes_received = 0;
+
+	vector<pollfd> fds(workers.size());
+	while (true) {
+		int num_open = 0;
+		for (size_t w = 0; w < workers.size(); w++) {
+			Connection& worker = workers[w];
+			fds[w].fd = worker.open ? worker.fd : -1;
+			fds[w].events = POLLIN | (worker.pending() > 0 ? POLLOUT : 0);
+			fds[w].revents = 0;
+			num_open += worker.open;
+		}
+		if (num_open == 0)
+			break;
+		if (poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR)
+			break;
+
+		for (size_t w = 0; w < workers.size(); w++) {
+			Connection& worker = workers[w];
+			if (fds[w].revents & POLLOUT)
+				worker.flush();
+			if (!(fds[w].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+
+			worker.receive();
+			while (worker.next(header, message)) {
+				bytes_received += message.size();
+				if (header.type == message_t::hello) {
+					worker.rank = header.sender;
+					if (header.sender >= 0 && header.sender < num_workers)
+						by_rank[header.sender] = static_cast<int>(w);
+					continue;
+				}
+				if (header.type == message_t::bye) {
+					worker.open = false;
+					break;
+				}
+
+				// Migrants and leaders: check for a new global best. The count
+				// is bounded before the buffers are sized from it.
+				const uint8_t* payload = &message[message_header_bytes];
+				long long claimed = decode_tour_count(payload, header.payload_bytes);
+				int count = -1;
+				if (claimed >= 0 && claimed <= max_tours) {
+					tours.resize(static_cast<size_t>(claimed) * n);
+					lengths.resize(claimed);
+					count = decode_tours(payload, header.payload_bytes, n, static_cast<int>(claimed),
+										 tours.data(), lengths.data());
+				}
+				if (count < 0) {
+					cerr << "Worker " << worker.rank << " sent malformed tours" << endl;
+					continue;
+				}
+				for (int k = 0; k < count; k++) {
+					const tour_t* tour = &tours[static_cast<size_t>(k) * n];
+					float fitness = (baseWorld.width * baseWorld.height) / static_cast<float>(distances.tour_length(tour, n));
+					if (fitness > bestLeader.fitness) {
+						for (int c = 0; c < n; c++)
+							bestLeader.cities[c] = baseWorld.cities[tour[c]];
+						bestLeader.fitness = fitness;
+						best_rank = header.sender;
+						best_generation = header.generation;
+						chrono::duration<float, milli> elapsed = chrono::steady_clock::now() - start;
+						gen_log.write_log(header.generation, elapsed.count(), fitness, tour, baseWorld.cities, n);
+					}
+				}
+
+				// Pass migrants on to the next worker
+				if (header.type == message_t::migrants && num_workers > 1) {
+					int target = by_rank[(header.sender + 1) % num_workers];
+					if (target < 0 || !workers[target].open || workers[target].pending() > max_pending_bytes) {
+						batches_dropped++;
+					} else {
+						workers[target].out.insert(workers[target].out.end(), message.begin(), message.end());
+						workers[target].flush();
+						batches_routed++;
+					}
+				}
+			}
+		}
+	}
+	for (Connection& worker : workers)
+		close(worker.fd);
+
+	if (best != nullptr)
+		*best = bestLeader;
+
+	cout << "Coordinator: " << workers.size() << " workers, " << batches_routed
+		 << " migrant batches routed, " << batches_dropped << " dropped, "
+		 << bytes_received / 1024 << " KB received" << endl
+		 << "Global best distance " << bestLeader.calc_distance() << " from worker "
+		 << best_rank << ", generation " << best_generation << endl;
+	return static_cast<int>(workers.size()) == num_workers;
+}
+
+bool run_worker(const string& address, int rank,
+				int pop_size, int max_gen,
+				float prob_mutation, float prob_crossover,
+				const World& baseWorld,
+				Logger& gen_log,
+				int seed,
+				const GAOptions& options)
+{
+	int fd = -1;
+	for (int attempt = 0; attempt < connect_attempts && fd < 0; attempt++) {
+		fd = open_socket(address, false);
+		if (fd < 0)
+			this_thread::sleep_for(chrono::milliseconds(connect_retry_ms));
+	}
+	if (fd < 0) {
+		cerr << "Worker " << rank << " cannot reach " << address << endl;
+		return false;
+	}
+
+	int n = baseWorld.num_cities;
+	Connection coordinator(fd);
+	encode_message(coordinator.out, message_t::hello, rank, 0);
+
+	// Island 0's links to the network
+	MigrantQueue exports(port_capacity, options.migration_size, n);
+	MigrantQueue imports(port_capacity, options.migration_size, n);
+	vector<tour_t> best_tour(n);
+	IslandPort port = { &exports, &imports, best_tour.data(), 0, 0 };
+
+	// Moves migrants between the queues and the socket while the islands run
+	atomic<bool> finished(false);
+	int received = 0, dropped = 0;
+	thread io([&]() {
+		vector<uint8_t> message;
+		MessageHeader header;
+		while (coordinator.open) {
+			bool done = finished.load(memory_order_acquire);
+			while (const MigrantBatch* batch = exports.front()) {
+				encode_message(coordinator.out, message_t::migrants, rank, batch->generation,
+							   batch->tours, batch->lengths, batch->count, n);
+				exports.release();
+			}
+			coordinator.flush();
+			if (done)
+				break;
+
+			pollfd p = { fd, static_cast<short>(POLLIN | (coordinator.pending() > 0 ? POLLOUT : 0)), 0 };
+			if (poll(&p, 1, poll_ms) > 0 && (p.revents & (POLLIN | POLLHUP | POLLERR)))
+				coordinator.receive();
+			while (coordinator.next(header, message)) {
+				if (header.type != message_t::migrants)
+					continue;
+				MigrantBatch* batch = imports.slot();
+				int count = batch == nullptr ? -1
+					: decode_tours(&message[message_header_bytes], header.payload_bytes, n,
+								   options.migration_size, batch->tours, batch->lengths);
+				if (count < 0) {
+					dropped++;
+					continue;
+				}
+				batch->count = count;
+				batch->generation = header.generation;
+				imports.publish();
+				received += count;
+			}
+		}
+	});
+
+	uint32_t worker_seed = rank == 0 ? static_cast<uint32_t>(seed)
+		: philox4x32(seed, static_cast<uint32_t>(rng_stream::migration), 0, 0, rank, 0).v[0];
+	execute_islands(pop_size, max_gen, prob_mutation, prob_crossover, baseWorld, gen_log,
+					static_cast<int>(worker_seed), options, &port);
+
+	finished.store(true, memory_order_release);
+	io.join();
+
+	// Report the best tour and leave
+	encode_message(coordinator.out, message_t::leader, rank, port.best_generation,
+				   best_tour.data(), &port.best_length, 1, n);
+	encode_message(coordinator.out, message_t::bye, rank, max_gen);
+	coordinator.drain();
+	close(fd);
+
+	cout << "Worker " << rank << ": " << received << " migrants received, "
+		 << dropped << " batches dropped" << endl;
+	return true;
+}
@@ -0,0 +1,66 @@
+//
+//  cluster.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__cluster__
+#define __tsp_ga__cluster__
+
+#include <string>
+
+#include "world.h"
+#include "options.h"
+#include "log.h"
+
+/*
+ Island model spread over several processes.
+
+ Every worker process runs execute_islands() with its own islands. Its
+ island 0 also exports the migrants of every migration it makes to the
+ coordinator, whatever island the topology sends them to. The coordinator
+ forwards them to the next worker by rank (a ring of processes), and the
+ worker imports the migrants forwarded to it. Messages use the binary format of wire.h. A worker's
+ socket I/O runs on a thread of its own, behind the same lock-free queues
+ as the links between islands, so the islands never wait on the network.
+ The coordinator drops migrants for a worker that is not keeping up
+ instead of blocking.
+
+ Addresses are "unix:<path>" for a Unix domain socket or "tcp:<host>:<port>".
+ */
+
+/*
+ Runs the coordinator: waits for num_workers workers, routes their
+ migrants and tracks the global best tour from the migrants and the final
+ leaders the workers report, logging every improvement of it.
+
+ address   : Where to listen
+ baseWorld : The world the workers solve
+ gen_log   : Logs the global best each time it improves
+ best      : Set to the global best, if not null
+ options   : The workers' options; messages with more tours than their
+             migration_size are rejected
+ returns false if the socket could not be set up, or if not every worker
+ connected within a minute
+ */
+bool run_coordinator(const std::string& address, int num_workers, const World& baseWorld,
+					 Logger& gen_log, World* best = nullptr,
+					 const GAOptions& options = GAOptions());
+
+/*
+ Runs a worker: connects to the coordinator and runs execute_islands() with
+ a seed derived from the run's seed and the rank.
+
+ address : The coordinator's address
+ rank    : Index of the worker, 0 to num_workers - 1
+ The other parameters are those of execute_islands().
+ returns false if the coordinator could not be reached
+ */
+bool run_worker(const std::string& address, int rank,
+				int pop_size, int max_gen,
+				float prob_mutation, float prob_crossover,
+				const World& baseWorld,
+				Logger& gen_log,
+				int seed,
+				const GAOptions& options = GAOptions());
+
+#endif /* defined(__tsp_ga__cluster__) */
@@ -13,16 +13,9 @@
 #define __COMMON_H__
 
 #include <fstream>
-#include <ctime>
 
 #include "g_type.h"
-
-/*
-	Stops a clocks timer and returns the elapsed time in ms.
-	
-	clk - The clk to work with.
-*/
-float end_clock(clock_t clk);
+#include "timing.h"
 
 /*
 	Utility function for dumping a GPU buffer to a file
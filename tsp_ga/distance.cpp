@@ -0,0 +1,149 @@
+//
+//  distance.cpp
+//  tsp_ga
+//
+
+#include "distance.h"
+#include <iostream>
+#include <cstdlib>
+#include <new>
+
+// Number of bits needed to represent values up to max_value
+static int bit_width(uint64_t max_value)
+{
+	int bits = 0;
+	while (bits < 64 && (max_value >> bits) != 0)
+		bits++;
+	return bits;
+}
+
+DistanceTable::DistanceTable(const World& world, size_t budget, bool count, bool use_cache)
+:
+	cities(world.cities), num_cities(world.num_cities),
+	storage_mode(mode_t::direct), simd(default_simd()), bytes(0),
+	dense(nullptr), row_stride(0), dense_block(nullptr),
+	cache(nullptr), cache_shift(0), value_bits(0),
+	counting(count), lookups(0), misses(0)
+{
+	const size_t line = 64;
+	const int per_line = line / sizeof(int);
+	
+	// Dense table: pad every row to a whole number of cache lines
+	int stride = (num_cities + per_line - 1) / per_line * per_line;
+	size_t dense_bytes = static_cast<size_t>(stride) * num_cities * sizeof(int);
+	if (dense_bytes <= budget)
+		dense_block = malloc(dense_bytes + line);
+	if (dense_block != nullptr)
+	{
+		storage_mode = mode_t::dense;
+		row_stride = stride;
+		bytes = dense_bytes;
+		dense = reinterpret_cast<int*>((reinterpret_cast<uintptr_t>(dense_block) + line - 1) & ~(uintptr_t)(line - 1));
+		
+		for (int a = 0; a < num_cities; a++) {
+			int* row = &dense[a * row_stride];
+			for (int b = 0; b < num_cities; b++)
+				row[b] = calc_sq(a, b);
+			for (int b = num_cities; b < row_stride; b++)
+				row[b] = 0;
+		}
+		return;
+	}
+	if (!use_cache)
+		return;
+	
+	// Cached table: the key and the distance must share a 64 bit entry
+	uint64_t max_key = static_cast<uint64_t>(num_cities) * num_cities;
+	uint64_t max_sq = static_cast<uint64_t>(world.width) * world.width
+					+ static_cast<uint64_t>(world.height) * world.height;
+	int key_bits = bit_width(max_key);
+	value_bits = bit_width(max_sq);
+	
+	size_t entries = 1;
+	while (entries * 2 * sizeof(uint64_t) <= budget && entries < max_key)
+		entries *= 2;
+	
+	if (key_bits + value_bits <= 64 && entries >= 1024)
+		cache = new (std::nothrow) std::atomic<uint64_t>[entries];
+	if (cache != nullptr)
+	{
+		storage_mode = mode_t::cached;
+		cache_shift = 64 - bit_width(entries - 1);
+		bytes = entries * sizeof(uint64_t);
+		for (size_t i = 0; i < entries; i++)
+			cache[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+DistanceTable::~DistanceTable()
+{
+	free(dense_block);
+	delete[] cache;
+}
+
+int DistanceTable::cached_sq(int a, int b) const
+{
+	// The table is symmetric, store each pair once
+	uint64_t lo = a < b ? a : b;
+	uint64_t hi = a < b ? b : a;
+	uint64_t key = lo * num_cities + hi + 1;
+	uint64_t slot = (key * 0x9E3779B97F4A7C15ull) >> cache_shift;
+	if (counting)
+		lookups.fetch_add(1, std::memory_order_relaxed);
+	
+	uint64_t entry = cache[slot].load(std::memory_order_relaxed);
+	if ((entry >> value_bits) == key)
+		return static_cast<int>(entry & ((1ull << value_bits) - 1));
+	
+	// Miss, compute and replace whatever was in the slot
+	if (counting)
+		misses.fetch_add(1, std::memory_order_relaxed);
+	int d = calc_sq(a, b);
+	cache[slot].store((key << value_bits) | static_cast<uint64_t>(d), std::memory_order_relaxed);
+	return d;
+}
+
+int DistanceTable::tour_length(const tour_t* tour, int length) const
+{
+	if (storage_mode == mode_t::cached) {
+		unsigned distance = 0;
+		for (int i = 0; i < length - 1; i++)
+			distance += static_cast<unsigned>(cached_sq(tour[i], tour[i + 1]));
+		return static_cast<int>(distance);
+	}
+	
+	if (counting)
+		lookups.fetch_add(length - 1, std::memory_order_relaxed);
+	if (storage_mode == mode_t::dense)
+		return sq_tour_length(dense, row_stride, tour, length, simd);
+	return sq_tour_length(cities, tour, length, simd);
+}
+
+float DistanceTable::tour_distance(const tour_t* tour, int length) const
+{
+	if (storage_mode == mode_t::dense)
+		return euclid_tour_length(dense, row_stride, tour, length, simd);
+	
+	float distance = 0.0f;
+	for (int i = 0; i < length - 1; i++)
+		distance += euclid(tour[i], tour[i + 1]);
+	return distance;
+}
+
+void DistanceTable::print_stats() const
+{
+	static const char* names[] = { "direct", "dense", "cached" };
+	
+	uint64_t n_lookups = lookups.load();
+	uint64_t n_misses = misses.load();
+	
+	cout << "Distance table: " << names[static_cast<int>(storage_mode)]
+		 << ", " << bytes / 1024 << " KB";
+	if (storage_mode == mode_t::cached && n_lookups > 0) {
+		cout << ", " << n_lookups - n_misses << "/" << n_lookups << " hits ("
+			 << 100.0 * (n_lookups - n_misses) / n_lookups << "%)";
+	} else if (n_lookups > 0) {
+		cout << ", " << n_lookups << " lookups";
+	}
+	cout << endl;
+}
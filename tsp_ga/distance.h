@@ -0,0 +1,154 @@
+//
+//  distance.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__distance__
+#define __tsp_ga__distance__
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include "world.h"
+#include "tour_simd.h"
+
+/*
+ Squared distances between the cities of a world, keyed by city index.
+ 
+ The storage is picked from the city count and a memory budget:
+  - dense  : full N x N table, rows padded to 64 bytes
+  - direct : no storage, every distance is computed from the coordinates,
+             for worlds too large for a dense table
+  - cached : direct-mapped cache filled on demand, instead of direct if
+             asked for. A lookup hashes the pair and loads a random entry
+             of a large table, which usually costs more than the squared
+             distance it saves, and tours then skip the SIMD kernels.
+ 
+ There is no neighbor-limited form: a lookup in a city's list of nearest
+ neighbors takes longer than computing a squared distance from the
+ coordinates, which it would have to fall back to for every other edge.
+ 
+ Lookups and cache hits are only counted if asked for, as every thread
+ evaluating tours would otherwise contend on the counters.
+ */
+class DistanceTable
+{
+public:
+	enum class mode_t
+	{
+		direct,
+		dense,
+		cached
+	};
+	
+	static const size_t default_budget = 64 << 20;	// 64 MB
+	
+	/*
+	 Builds the table for a world
+	 
+	 world     : The world whose cities will be indexed
+	 budget    : The maximum number of bytes the table may use
+	 count     : Count the lookups and cache hits, for print_stats()
+	 use_cache : Cache the distances of a world too large for a dense table
+	             rather than compute each from the coordinates
+	 
+	 Falls back to direct if the memory cannot be allocated.
+	 */
+	DistanceTable(const World& world, size_t budget = default_budget, bool count = false,
+				  bool use_cache = false);
+	~DistanceTable();
+	
+	/*
+	 Squared distance between two cities
+	 */
+	int sq(int a, int b) const
+	{
+		if (storage_mode == mode_t::dense)
+			return dense[a * row_stride + b];
+		if (storage_mode == mode_t::cached)
+			return cached_sq(a, b);
+		return calc_sq(a, b);
+	}
+	
+	/*
+	 Euclidean distance between two cities
+	 */
+	float euclid(int a, int b) const
+	{
+		return sqrtf(static_cast<float>(sq(a, b)));
+	}
+	
+	/*
+	 Sum of the squared distances along an open tour
+	 */
+	int tour_length(const tour_t* tour, int length) const;
+	
+	/*
+	 Sum of the euclidean distances along an open tour
+	 */
+	float tour_distance(const tour_t* tour, int length) const;
+	
+	mode_t mode() const
+	{
+		return storage_mode;
+	}
+	
+	// Dense table and its row stride (in elements), or nullptr / 0
+	const int* dense_table() const
+	{
+		return dense;
+	}
+	
+	int stride() const
+	{
+		return row_stride;
+	}
+	
+	size_t memory_bytes() const
+	{
+		return bytes;
+	}
+	
+	/*
+	 Prints the storage mode, memory use and, if counted, the lookups and
+	 cache hit rate to stdout
+	 */
+	void print_stats() const;
+	
+private:
+	const City* cities;
+	int num_cities;
+	mode_t storage_mode;
+	simd_t simd;	// Instruction set of the tour length kernels
+	size_t bytes;
+	
+	// Dense storage
+	int* dense;
+	int row_stride;
+	void* dense_block;
+	
+	// Cached storage: each entry packs (key << value_bits) | value, key 0 is empty
+	std::atomic<uint64_t>* cache;
+	int cache_shift;
+	int value_bits;
+	
+	// Statistics, if counting
+	bool counting;
+	mutable std::atomic<uint64_t> lookups;
+	mutable std::atomic<uint64_t> misses;
+	
+	int calc_sq(int a, int b) const
+	{
+		int dx = cities[a].x - cities[b].x;
+		int dy = cities[a].y - cities[b].y;
+		return dx*dx + dy*dy;
+	}
+	
+	int cached_sq(int a, int b) const;
+	
+	DistanceTable(const DistanceTable&);
+	DistanceTable& operator=(const DistanceTable&);
+};
+
+#endif /* defined(__tsp_ga__distance__) */
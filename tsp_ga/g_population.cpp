@@ -6,254 +6,485 @@
 //  Copyright (c) 2015 waz
 //
 
+#include <cassert>
+#include <algorithm>
+
 #include "common.h"
 #include "g_population.h"
+#include "population.h"
+#include "scan.h"
 
-g_Population::g_Population(
-	const opencl_env& env,
-	int numIndividuals, int numCitiesPerWorld,
-	int height, int width)
+// Largest work-group of the breed kernel
+static const int breed_max_group_size = 64;
+
+g_CityTable::g_CityTable(const opencl_env& env, const World& baseWorld, const DistanceTable& dist)
+{
+	cities = cl::Buffer(env.context(), CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+						baseWorld.num_cities * sizeof(City), baseWorld.cities);
+	
+	// Only a dense table is worth uploading, otherwise the kernels compute the
+	// distances from the coordinates
+	if (dist.mode() == DistanceTable::mode_t::dense) {
+		dist_stride = dist.stride();
+		distances = cl::Buffer(env.context(), CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+							   dist.memory_bytes(), const_cast<int*>(dist.dense_table()));
+	} else {
+		dist_stride = 0;
+		distances = cl::Buffer(env.context(), CL_MEM_READ_ONLY, sizeof(int));
+	}
+}
+
+g_Leader::g_Leader(const opencl_env& env, const World& baseWorld)
 :
 	env(env),
-	numIndividuals(numIndividuals), numCitiesPerWorld(numCitiesPerWorld),
-	height(height), width(width)
+	numCitiesPerWorld(baseWorld.num_cities),
+	pending(false)
 {
-	cl::Context& context = env.context();
+	d_tour = env.pool().acquire<tour_t>(numCitiesPerWorld);
+	d_values = env.pool().acquire<float>(2);
 	
-	int totalCities = numCitiesPerWorld * numIndividuals;
-	this->cities_xcoord = cl::Buffer(context, CL_MEM_READ_WRITE, totalCities * sizeof(int));
-	this->cities_ycoord = cl::Buffer(context, CL_MEM_READ_WRITE, totalCities * sizeof(int));
-	this->fitness = cl::Buffer(context, CL_MEM_READ_WRITE, numIndividuals * sizeof(float));
-	this->fit_prob = cl::Buffer(context, CL_MEM_READ_WRITE, numIndividuals * sizeof(float));
+	// Memory the runtime allocates itself is page-locked on most devices,
+	// which lets the reads run as DMA transfers without a staging copy
+	size_t bytes = 2 * sizeof(float) + numCitiesPerWorld * sizeof(tour_t);
+	pinned = cl::Buffer(env.context(), CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes);
+	h_values = static_cast<float*>(env.queue().enqueueMapBuffer(pinned, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+																0, bytes));
+	h_tour = reinterpret_cast<tour_t*>(h_values + 2);
+}
+
+g_Leader::~g_Leader()
+{
+	if (pending)
+		ready.wait();
+	env.transfer_queue().finish();
+	env.queue().enqueueUnmapMemObject(pinned, h_values);
+	env.queue().finish();
+	env.pool().release(d_tour);
+	env.pool().release(d_values);
+}
+
+int g_Leader::select(BestTour& best, const DistanceTable& distances)
+{
+	assert(pending);
+	ready.wait();
+	pending = false;
+	
+	// Update best leader
+	return best.update(h_tour, h_values[0], distances);
 }
 
 g_Population::g_Population(
 	const opencl_env& env,
 	int numIndividuals,
 	const World& baseWorld,
-	int seed)
+	const g_CityTable& table)
 :
 	env(env),
 	numIndividuals(numIndividuals), numCitiesPerWorld(baseWorld.num_cities),
-	height(baseWorld.height), width(baseWorld.width)
+	height(baseWorld.height), width(baseWorld.width),
+	host_cities(baseWorld.cities), table(table),
+	host_alias(nullptr), alias_selection(false), bound_pop(nullptr)
 {
-	cl::Context& context = env.context();
+	g_BufferPool& pool = env.pool();
 	
 	int totalCities = numCitiesPerWorld * numIndividuals;
-	this->cities_xcoord = cl::Buffer(context, CL_MEM_READ_WRITE, totalCities * sizeof(int));
-	this->cities_ycoord = cl::Buffer(context, CL_MEM_READ_WRITE, totalCities * sizeof(int));
-	this->fitness = cl::Buffer(context, CL_MEM_READ_WRITE, numIndividuals * sizeof(float));
-	this->fit_prob = cl::Buffer(context, CL_MEM_READ_WRITE, numIndividuals * sizeof(float));
+	this->tours = pool.acquire<tour_t>(totalCities);
+	this->fitness = pool.acquire<float>(numIndividuals);
+	this->fit_prob = pool.acquire<float>(numIndividuals);
 	
-	// Set the seed for random number generation
-	srand(seed);
+	// Candidates of every work-group of the top-k reduction
+	top_groups = env.getNumComputeUnits() * 4;
+	top_val = pool.acquire<float>(top_groups * max_elites);
+	top_inx = pool.acquire<int>(top_groups * max_elites);
 	
-	int* x_coord = new int[totalCities];
-	int* y_coord = new int[totalCities];
-	City* cities = new City[numCitiesPerWorld];
-	memmove(cities, baseWorld.cities, numCitiesPerWorld*sizeof(City));
+	// One buffer of block totals per level of the prefix sum
+	int n = numIndividuals;
+	do {
+		n = (n + scan_block - 1) / scan_block;
+		scan_sums.push_back(pool.acquire<float>(n));
+	} while (n > 1);
 	
-	for (int i = 0; i < numIndividuals; i++)
-	{
-		int baseOffset = i * numCitiesPerWorld;
-		random_shuffle(cities, &cities[numCitiesPerWorld]);
-		
-		for (int j = 0; j < numCitiesPerWorld; j++) {
-			x_coord[baseOffset + j] = cities[j].x;
-			y_coord[baseOffset + j] = cities[j].y;
-		}
-	}
+	// Bind the kernels that only involve this population
+	k_fitness = env.createKernel(kernel_t::fitness);
+	k_fitness.setArg(0, numIndividuals);
+	k_fitness.setArg(1, numCitiesPerWorld);
+	k_fitness.setArg(2, width*height);
+	k_fitness.setArg(3, table.cities);
+	k_fitness.setArg(4, table.distances);
+	k_fitness.setArg(5, table.dist_stride);
+	k_fitness.setArg(6, tours);
+	k_fitness.setArg(7, fitness);
 	
-	env.queue().enqueueWriteBuffer(cities_xcoord, CL_FALSE, 0, totalCities*sizeof(int), x_coord);
-	env.queue().enqueueWriteBuffer(cities_ycoord, CL_FALSE, 0, totalCities*sizeof(int), y_coord);
+	// The probabilities are a normalized prefix sum of the fitnesses
+	bind_scan(fitness, fit_prob, numIndividuals, 0, true);
+	
+	const int grpSize = 256;
+	k_top_0 = env.createKernel(kernel_t::max_fit_phase_0);
+	k_top_0.setArg(0, numIndividuals);
+	k_top_0.setArg(2, fitness);
+	k_top_0.setArg(3, cl::Local(grpSize*sizeof(float)));
+	k_top_0.setArg(4, cl::Local(grpSize*sizeof(int)));
+	k_top_0.setArg(5, top_val);
+	k_top_0.setArg(6, top_inx);
 	
-	delete[] cities;
-	delete[] x_coord;
-	delete[] y_coord;
+	k_top_1 = env.createKernel(kernel_t::max_fit_phase_1);
+	k_top_1.setArg(0, top_groups);
+	k_top_1.setArg(2, cl::Local(grpSize*sizeof(float)));
+	k_top_1.setArg(3, cl::Local(grpSize*sizeof(int)));
+	k_top_1.setArg(4, top_val);
+	k_top_1.setArg(5, top_inx);
+	
+	k_gather = env.createKernel(kernel_t::gather_leader);
+	k_gather.setArg(0, numCitiesPerWorld);
+	k_gather.setArg(1, top_inx);
+	k_gather.setArg(2, tours);
+	k_gather.setArg(3, fitness);
+	k_gather.setArg(4, fit_prob);
+}
+
+g_Population::g_Population(
+	const opencl_env& env,
+	int numIndividuals,
+	const World& baseWorld,
+	const g_CityTable& table,
+	const tour_t* h_tours)
+:
+	g_Population(env, numIndividuals, baseWorld, table)
+{
+	int totalCities = numCitiesPerWorld * numIndividuals;
+	env.queue().enqueueWriteBuffer(tours, CL_TRUE, 0, totalCities*sizeof(tour_t), h_tours);
+}
+
+g_Population::~g_Population()
+{
+	// Kernels still queued may use the buffers
+	env.queue().finish();
+	
+	g_BufferPool& pool = env.pool();
+	pool.release(tours);
+	pool.release(fitness);
+	pool.release(fit_prob);
+	for (const cl::Buffer& sums : scan_sums)
+		pool.release(sums);
+	pool.release(alias_prob);
+	pool.release(alias_inx);
+	delete host_alias;
+	pool.release(top_val);
+	pool.release(top_inx);
 }
 
 void g_Population::evaluate()
 {
-	cl::Kernel& k_fitness = env.getKernel(kernel_t::fitness);
-	cl::Kernel& k_fit_sum = env.getKernel(kernel_t::fit_sum);
-	cl::Kernel& k_fit_prob = env.getKernel(kernel_t::fit_prob);
-	cl::Buffer d_fit_sum = cl::Buffer(env.context(), CL_MEM_READ_WRITE, sizeof(float));
-	cl::NDRange globalws(numIndividuals);
-	float fit_sum;
+	calc_fitness();
+	calc_fit_prob();
+}
+
+void g_Population::calc_fitness()
+{
+	env.queue().enqueueNDRangeKernel(k_fitness, cl::NullRange, cl::NDRange(numIndividuals));
+}
+
+void g_Population::calc_fit_prob()
+{
+	scan(0);
+}
+
+void g_Population::bind_scan(const cl::Buffer& in, const cl::Buffer& out, int n, int level, bool normalize)
+{
+	int groups = (n + scan_block - 1) / scan_block;
+	scan_levels.push_back(ScanLevel());
+	scan_levels[level].groups = groups;
 	
-	// Calculate the fitnesses
-	k_fitness.setArg(0, numIndividuals);
-	k_fitness.setArg(1, numCitiesPerWorld);
-	k_fitness.setArg(2, width*height);
-	k_fitness.setArg(3, cities_xcoord);
-	k_fitness.setArg(4, cities_ycoord);
-	k_fitness.setArg(5, fitness);
-	env.queue().enqueueNDRangeKernel(k_fitness, cl::NullRange, globalws);
-	
-	// Calculate the total sum and compute the partial probabilities
-	k_fit_sum.setArg(0, numIndividuals);
-	k_fit_sum.setArg(1, fitness);
-	k_fit_sum.setArg(2, fit_prob);
-	k_fit_sum.setArg(3, d_fit_sum);
-	env.queue().enqueueNDRangeKernel(k_fit_sum, cl::NullRange, globalws);
-	env.queue().enqueueReadBuffer(d_fit_sum, CL_TRUE, 0, sizeof(float), &fit_sum);
-	
-	// Compute the full probabilities
-	k_fit_prob.setArg(0, numIndividuals);
-	k_fit_prob.setArg(1, fit_prob);
-	k_fit_prob.setArg(2, fit_sum);
-	env.queue().enqueueNDRangeKernel(k_fit_prob, cl::NullRange, globalws);
+	// Scan every block
+	cl::Kernel& k_block = scan_levels[level].block;
+	k_block = env.createKernel(kernel_t::scan_block);
+	k_block.setArg(0, n);
+	k_block.setArg(1, in);
+	k_block.setArg(2, out);
+	k_block.setArg(3, scan_sums[level]);
+	k_block.setArg(4, groups == 1 && normalize ? 1 : 0);
+	k_block.setArg(5, cl::Local((scan_block + 1) * sizeof(float)));
+	
+	if (groups > 1) {
+		// Scan the block totals, then add them to the following blocks
+		bind_scan(scan_sums[level], scan_sums[level], groups, level + 1, false);
+		
+		cl::Kernel& k_add = scan_levels[level].add;
+		k_add = env.createKernel(kernel_t::scan_add);
+		k_add.setArg(0, n);
+		k_add.setArg(1, out);
+		k_add.setArg(2, scan_sums[level]);
+		k_add.setArg(3, groups);
+		k_add.setArg(4, normalize ? 1 : 0);
+	}
 }
 
-int g_Population::select_leader(World& generation_leader, World& best_leader) const
+void g_Population::scan(int level)
 {
-	/*
-		Updates the generation and global best leaders
-	 
-		generation_leader : The world with the max fitness for this generation
-		best_leader       : The world with the best global fitness across all generations
-	 
-		return 1 if this generation is the best, 0 if not, and -1 for error
-	 */
-	
-	// Calculate the max fitness
-	extract_max_fit(generation_leader);
+	ScanLevel& scan_level = scan_levels[level];
+	cl::NDRange localws(scan_group_size);
+	cl::NDRange globalws(scan_level.groups * scan_group_size);
 	
-	// Update best leader
-	if (generation_leader.fitness > best_leader.fitness)
-	{
-		best_leader = generation_leader;
-		return 1;
+	env.queue().enqueueNDRangeKernel(scan_level.block, cl::NullRange, globalws, localws);
+	if (scan_level.groups > 1) {
+		scan(level + 1);
+		env.queue().enqueueNDRangeKernel(scan_level.add, cl::NullRange, globalws, localws);
 	}
+}
+
+void g_Population::download(Population& host) const
+{
+	assert(host.numIndividuals == numIndividuals && host.numCitiesPerWorld == numCitiesPerWorld);
 	
-	return 0;
+	env.queue().enqueueReadBuffer(tours, CL_FALSE, 0, numIndividuals*numCitiesPerWorld*sizeof(tour_t), host.tours);
+	env.queue().enqueueReadBuffer(fitness, CL_FALSE, 0, numIndividuals*sizeof(float), host.fitness);
+	env.queue().enqueueReadBuffer(fit_prob, CL_TRUE, 0, numIndividuals*sizeof(float), host.fit_prob);
 }
 
-void g_Population::extract_max_fit(World& res_world) const
+void g_Population::top_k(int k)
 {
-	cl::Kernel& k0 = env.getKernel(kernel_t::max_fit_phase_0);
-	cl::Kernel& k1 = env.getKernel(kernel_t::max_fit_phase_1);
+	assert(k >= 1 && k <= max_elites && k <= numIndividuals);
 	
 	const int grpSize = 256;
-	const int nofGroups = env.getNumComputeUnits()*4;
-	cl::Buffer result_val = cl::Buffer(env.context(), CL_MEM_READ_WRITE, nofGroups*sizeof(float));
-	cl::Buffer result_inx = cl::Buffer(env.context(), CL_MEM_READ_WRITE, nofGroups*sizeof(int));
-	k0.setArg(0, numIndividuals);
-	k0.setArg(1, fitness);
-	k0.setArg(2, cl::Local(grpSize*sizeof(float)));
-	k0.setArg(3, cl::Local(grpSize*sizeof(int)));
-	k0.setArg(4, result_val);
-	k0.setArg(5, result_inx);
-	
-	cl::NDRange localws(grpSize);
-	cl::NDRange globalws(nofGroups*grpSize);
-	env.queue().enqueueNDRangeKernel(k0, cl::NullRange, globalws, localws);
-	
-	k1.setArg(0, nofGroups);
-	k1.setArg(1, result_val);
-	k1.setArg(2, result_inx);
-	env.queue().enqueueNDRangeKernel(k1, cl::NullRange, cl::NDRange(1));
-	
-	int max_inx;
-	env.queue().enqueueReadBuffer(result_inx, CL_TRUE, 0, sizeof(int), &max_inx);
-	
-	env.queue().enqueueReadBuffer(fitness, CL_FALSE, max_inx*sizeof(float), sizeof(float), &res_world.fitness);
-	env.queue().enqueueReadBuffer(fit_prob, CL_FALSE, max_inx*sizeof(float), sizeof(float), &res_world.fit_prob);
-	
-	int* xcoord = new int[numCitiesPerWorld];
-	int* ycoord = new int[numCitiesPerWorld];
-	int base_offset = max_inx * numCitiesPerWorld * sizeof(int);
-	env.queue().enqueueReadBuffer(cities_xcoord, CL_FALSE, base_offset, numCitiesPerWorld*sizeof(int), xcoord);
-	env.queue().enqueueReadBuffer(cities_ycoord, CL_TRUE, base_offset, numCitiesPerWorld*sizeof(int), ycoord);
-	
-	for (int i = 0; i < numCitiesPerWorld; i++) {
-		res_world.cities[i].x = xcoord[i];
-		res_world.cities[i].y = ycoord[i];
-	}
+	k_top_0.setArg(1, k);
+	env.queue().enqueueNDRangeKernel(k_top_0, cl::NullRange, cl::NDRange(top_groups*grpSize), cl::NDRange(grpSize));
 	
-	delete[] xcoord;
-	delete[] ycoord;
+	k_top_1.setArg(1, k);
+	env.queue().enqueueNDRangeKernel(k_top_1, cl::NullRange, cl::NDRange(grpSize), cl::NDRange(grpSize));
 }
 
-void g_Population::select_parents(cl::Buffer& selected_inx, cl::Buffer& probs) const
+void g_Population::read_leader(g_Leader& leader)
 {
-	cl::Kernel& k = env.getKernel(kernel_t::select_parents);
-	k.setArg(0, 2 * numIndividuals);
-	k.setArg(1, fit_prob);
-	k.setArg(2, probs);
-	k.setArg(3, selected_inx);
-	cl::NDRange globalws(2 * numIndividuals);
-	env.queue().enqueueNDRangeKernel(k, cl::NullRange, globalws);
+	assert(!leader.pending && leader.numCitiesPerWorld == numCitiesPerWorld);
+	
+	top_k(1);
+	
+	// The leader is the slot of one of the generations in flight, which the
+	// run cycles through (GAOptions::pipeline_depth of them)
+	k_gather.setArg(5, leader.d_tour);
+	k_gather.setArg(6, leader.d_values);
+	env.queue().enqueueNDRangeKernel(k_gather, cl::NullRange, cl::NDRange(numCitiesPerWorld),
+									 cl::NullRange, nullptr, &leader.gathered);
+	env.queue().flush();
+	
+	// Read on the transfer queue once gathered, leaving the compute queue
+	// free for the next generation. That queue is in order too, so the last
+	// read completing means both did.
+	std::vector<cl::Event> after_gather(1, leader.gathered);
+	const cl::CommandQueue& transfer = env.transfer_queue();
+	transfer.enqueueReadBuffer(leader.d_values, CL_FALSE, 0, 2*sizeof(float), leader.h_values,
+							   &after_gather, &leader.reading);
+	transfer.enqueueReadBuffer(leader.d_tour, CL_FALSE, 0, numCitiesPerWorld*sizeof(tour_t), leader.h_tour,
+							   nullptr, &leader.ready);
+	transfer.flush();
+	leader.pending = true;
 }
 
-void g_Population::next_generation(g_Population& new_pop,
-								   const cl::Buffer& d_selected_parents_inx,
-								   float prob_crossover,
-								   const cl::Buffer d_rnd_prob_cross, const cl::Buffer d_cross_loc,
-								   float prob_mutation,
-								   const cl::Buffer d_rnd_prob_mutate, const cl::Buffer d_mutate_loc) const
+void g_Population::bind(g_Population& new_pop,
+						const cl::Buffer& selected_inx,
+						const cl::Buffer& d_visited,
+						uint32_t seed,
+						float prob_crossover, float prob_mutation,
+						selection_t method, int tournament_size)
 {
-	cl::Kernel& k_crossover = env.getKernel(kernel_t::crossover);
-	cl::Kernel& k_clone_parent = env.getKernel(kernel_t::clone_parent);
-	cl::Kernel& k_mutate = env.getKernel(kernel_t::mutate);
+	assert(&new_pop != this && new_pop.numIndividuals == numIndividuals);
+	assert(method != selection_t::tournament ||
+		   (tournament_size >= 2 && tournament_size <= max_tournament_size));
+	bound_pop = &new_pop;
+	alias_selection = false;
 	
-	cl::NDRange globalws(numIndividuals);
+	// Selection
+	if (method == selection_t::roulette)
+	{
+		k_select = env.createKernel(kernel_t::select_parents);
+		k_select.setArg(0, numIndividuals);
+		k_select.setArg(1, fit_prob);
+		k_select.setArg(2, seed);
+		k_select.setArg(4, selected_inx);
+		select_generation_arg = 3;
+	}
+	else if (method == selection_t::alias)
+	{
+		if (host_alias == nullptr) {
+			alias_prob = env.pool().acquire<float>(numIndividuals);
+			alias_inx = env.pool().acquire<int>(numIndividuals);
+			host_alias = new AliasTable(numIndividuals);
+			host_fitness.resize(numIndividuals);
+		}
+		
+		k_select = env.createKernel(kernel_t::select_parents_alias);
+		k_select.setArg(0, numIndividuals);
+		k_select.setArg(1, alias_prob);
+		k_select.setArg(2, alias_inx);
+		k_select.setArg(3, seed);
+		k_select.setArg(5, selected_inx);
+		select_generation_arg = 4;
+		alias_selection = true;
+	}
+	else
+	{
+		k_select = env.createKernel(kernel_t::select_parents_tournament);
+		k_select.setArg(0, numIndividuals);
+		k_select.setArg(1, tournament_size);
+		k_select.setArg(2, fitness);
+		k_select.setArg(3, seed);
+		k_select.setArg(5, selected_inx);
+		select_generation_arg = 4;
+	}
 	
 //	int pop_len,
 //	int num_cities,
-//	__global const int* old_x_coord,
-//	__global const int* old_y_coord,
-//	__global int* new_x_coord,
-//	__global int* new_y_coord,
+//	__global const tour_t* old_tours,
+//	__global tour_t* new_tours,
 //	__global int* selected_parents_inx,
 //	float prob_crossover,
-//	__global float* rnd_prob_cross,
-//	__global int* cross_loc
+//	uint seed,
+//	int generation,
+//	__global uint* visited
+	k_crossover = env.createKernel(kernel_t::crossover);
 	k_crossover.setArg(0, numIndividuals);
 	k_crossover.setArg(1, numCitiesPerWorld);
-	k_crossover.setArg(2, cities_xcoord);
-	k_crossover.setArg(3, cities_ycoord);
-	k_crossover.setArg(4, new_pop.cities_xcoord);
-	k_crossover.setArg(5, new_pop.cities_ycoord);
-	k_crossover.setArg(6, d_selected_parents_inx);
-	k_crossover.setArg(7, prob_crossover);
-	k_crossover.setArg(8, d_rnd_prob_cross);
-	k_crossover.setArg(9, d_cross_loc);
-	env.queue().enqueueNDRangeKernel(k_crossover, cl::NullRange, globalws);
+	k_crossover.setArg(2, tours);
+	k_crossover.setArg(3, new_pop.tours);
+	k_crossover.setArg(4, selected_inx);
+	k_crossover.setArg(5, prob_crossover);
+	k_crossover.setArg(6, seed);
+	k_crossover.setArg(8, d_visited);
 	
 //	int pop_len,
 //	int num_cities,
-//	__global const int* old_x_coord,
-//	__global const int* old_y_coord,
-//	__global int* new_x_coord,
-//	__global int* new_y_coord,
+//	__global const tour_t* old_tours,
+//	__global tour_t* new_tours,
 //	float prob_crossover,
-//	__global const float* rnd_prob_cross,
+//	uint seed,
+//	int generation,
 //	__global const int* selected_parents_inx
+	k_clone_parent = env.createKernel(kernel_t::clone_parent);
 	k_clone_parent.setArg(0, numIndividuals);
 	k_clone_parent.setArg(1, numCitiesPerWorld);
-	k_clone_parent.setArg(2, cities_xcoord);
-	k_clone_parent.setArg(3, cities_ycoord);
-	k_clone_parent.setArg(4, new_pop.cities_xcoord);
-	k_clone_parent.setArg(5, new_pop.cities_ycoord);
-	k_clone_parent.setArg(6, prob_crossover);
-	k_clone_parent.setArg(7, d_rnd_prob_cross);
-	k_clone_parent.setArg(8, d_selected_parents_inx);
-	env.queue().enqueueNDRangeKernel(k_clone_parent, cl::NullRange, globalws);
+	k_clone_parent.setArg(2, tours);
+	k_clone_parent.setArg(3, new_pop.tours);
+	k_clone_parent.setArg(4, prob_crossover);
+	k_clone_parent.setArg(5, seed);
+	k_clone_parent.setArg(7, selected_inx);
 	
 //	int pop_len,
 //	int num_cities,
-//	__global int* x_coord,
-//	__global int* y_coord,
+//	__global tour_t* tours,
 //	float prob_mutation,
-//	__global const float* rnd_prob_mutation,
-//	__global const int* rnd_mutate_loc
+//	uint seed,
+//	int generation
+	k_mutate = env.createKernel(kernel_t::mutate);
 	k_mutate.setArg(0, numIndividuals);
 	k_mutate.setArg(1, numCitiesPerWorld);
-	k_mutate.setArg(2, new_pop.cities_xcoord);
-	k_mutate.setArg(3, new_pop.cities_ycoord);
-	k_mutate.setArg(4, prob_mutation);
-	k_mutate.setArg(5, d_rnd_prob_mutate);
-	k_mutate.setArg(6, d_mutate_loc);
-	env.queue().enqueueNDRangeKernel(k_mutate, cl::NullRange, globalws);
+	k_mutate.setArg(2, new_pop.tours);
+	k_mutate.setArg(3, prob_mutation);
+	k_mutate.setArg(4, seed);
+	
+	// The fused kernel, if a child fits in local memory
+	int group_size = breed_group_size();
+	if (group_size > 0) {
+		k_breed = env.createKernel(kernel_t::breed);
+		k_breed.setArg(0, numIndividuals);
+		k_breed.setArg(1, numCitiesPerWorld);
+		k_breed.setArg(2, width*height);
+		k_breed.setArg(3, table.cities);
+		k_breed.setArg(4, table.distances);
+		k_breed.setArg(5, table.dist_stride);
+		k_breed.setArg(6, tours);
+		k_breed.setArg(7, new_pop.tours);
+		k_breed.setArg(8, selected_inx);
+		k_breed.setArg(9, prob_crossover);
+		k_breed.setArg(10, prob_mutation);
+		k_breed.setArg(11, seed);
+		k_breed.setArg(13, new_pop.fitness);
+		k_breed.setArg(14, cl::Local(group_size * numCitiesPerWorld * sizeof(tour_t)));
+		k_breed.setArg(15, cl::Local(group_size * visited_bytes()));
+	}
+	
+	k_copy_elites = env.createKernel(kernel_t::copy_elites);
+	k_copy_elites.setArg(1, numCitiesPerWorld);
+	k_copy_elites.setArg(2, top_inx);
+	k_copy_elites.setArg(3, tours);
+	k_copy_elites.setArg(4, fitness);
+	k_copy_elites.setArg(5, new_pop.tours);
+	k_copy_elites.setArg(6, new_pop.fitness);
+}
+
+void g_Population::select_parents(int generation)
+{
+	assert(bound_pop != nullptr);
+	
+	// The alias table is built on the host. The blocking read also completes
+	// the previous generation's writes, so the table can be reused.
+	if (alias_selection) {
+		env.queue().enqueueReadBuffer(fitness, CL_TRUE, 0, numIndividuals*sizeof(float), host_fitness.data());
+		host_alias->build(host_fitness.data());
+		env.queue().enqueueWriteBuffer(alias_prob, CL_FALSE, 0, numIndividuals*sizeof(float), host_alias->prob);
+		env.queue().enqueueWriteBuffer(alias_inx, CL_FALSE, 0, numIndividuals*sizeof(int), host_alias->alias);
+	}
+	
+	k_select.setArg(select_generation_arg, generation);
+	env.queue().enqueueNDRangeKernel(k_select, cl::NullRange, cl::NDRange(2 * numIndividuals));
+}
+
+void g_Population::next_generation(int generation)
+{
+	crossover(generation);
+	mutate(generation);
+}
+
+void g_Population::crossover(int generation)
+{
+	assert(bound_pop != nullptr);
+	cl::NDRange globalws(numIndividuals);
+	
+	k_crossover.setArg(7, generation);
+	env.queue().enqueueNDRangeKernel(k_crossover, cl::NullRange, globalws);
+	
+	k_clone_parent.setArg(6, generation);
+	env.queue().enqueueNDRangeKernel(k_clone_parent, cl::NullRange, globalws);
+}
+
+void g_Population::mutate(int generation)
+{
+	assert(bound_pop != nullptr);
+	
+	k_mutate.setArg(5, generation);
+	env.queue().enqueueNDRangeKernel(k_mutate, cl::NullRange, cl::NDRange(numIndividuals));
+}
+
+size_t g_Population::visited_bytes() const
+{
+	return ((numCitiesPerWorld + 31) / 32) * sizeof(cl_uint);
+}
+
+int g_Population::breed_group_size() const
+{
+	size_t child_bytes = numCitiesPerWorld * sizeof(tour_t) + visited_bytes();
+	size_t fit = env.getLocalMemSize() / child_bytes;
+	return static_cast<int>(std::min<size_t>(fit, breed_max_group_size));
+}
+
+void g_Population::breed(int generation)
+{
+	assert(bound_pop != nullptr);
+	
+	int group_size = breed_group_size();
+	assert(group_size > 0);
+	int groups = (numIndividuals + group_size - 1) / group_size;
+	
+	k_breed.setArg(12, generation);
+	env.queue().enqueueNDRangeKernel(k_breed, cl::NullRange,
+									 cl::NDRange(groups * group_size), cl::NDRange(group_size));
+}
+
+void g_Population::preserve_elites(int num_elites)
+{
+	assert(bound_pop != nullptr);
+	
+	top_k(num_elites);
+	
+	k_copy_elites.setArg(0, num_elites);
+	env.queue().enqueueNDRangeKernel(k_copy_elites, cl::NullRange, cl::NDRange(num_elites * numCitiesPerWorld));
 }
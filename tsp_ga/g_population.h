@@ -9,8 +9,91 @@
 #ifndef __tsp_ga__g_population__
 #define __tsp_ga__g_population__
 
+#include <vector>
+
 #include "g_type.h"
 #include "world.h"
+#include "distance.h"
+#include "selection.h"
+#include "population.h"
+
+/*
+ Read-only city data in device memory, shared by all the populations of a run
+ */
+struct g_CityTable
+{
+	cl::Buffer cities;		// City coordinates
+	cl::Buffer distances;	// Dense squared distance table, if the host built one
+	int dist_stride;		// Row stride of the distance table, 0 if there is none
+	
+	g_CityTable(const opencl_env& env, const World& baseWorld, const DistanceTable& dist);
+};
+
+/*
+ The leader of a generation, gathered on the device and read back into
+ pinned host memory without blocking (g_Population::read_leader), so the
+ host can log one generation's leader while the device breeds the next.
+ The reads go through the device's transfer queue, after the gather kernel,
+ so they also overlap with the kernels enqueued after them. All the buffers
+ are allocated once, for the whole run.
+ */
+class g_Leader
+{
+private:
+	const opencl_env& env;
+	int numCitiesPerWorld;
+	cl::Buffer d_tour;			// The leader's tour, gathered on the device
+	cl::Buffer d_values;		// Its fitness and fitness probability
+	cl::Buffer pinned;			// Host staging memory, mapped for the lifetime of the leader
+	float* h_values;			// Mapped copies of d_values and d_tour
+	tour_t* h_tour;
+	cl::Event gathered;			// The gather kernel
+	cl::Event reading;			// The first read back
+	cl::Event ready;			// The last read back, done when all are
+	bool pending;				// A read back was started and not consumed yet
+	
+	g_Leader(const g_Leader&);
+	g_Leader& operator=(const g_Leader&);
+	friend class g_Population;
+public:
+	g_Leader(const opencl_env& env, const World& baseWorld);
+	~g_Leader();
+	
+	/*
+	 Waits for the read back started by read_leader, then updates the global
+	 best leader from it
+	 
+	 best      : The best tour across all generations
+	 distances : Edge costs of the base world, to measure a new best
+	 
+	 return 1 if this generation is the best, else 0
+	 */
+	int select(BestTour& best, const DistanceTable& distances);
+	
+	/*
+	 The leader read back, once selected, until the next read back
+	 */
+	float fitness() const {
+		return h_values[0];
+	}
+	const tour_t* tour() const {
+		return h_tour;
+	}
+	
+	/*
+	 Events of the last read back, for profiling: the gather kernel, then the
+	 reads from the start of the first to the end of the last
+	 */
+	const cl::Event& gather_event() const {
+		return gathered;
+	}
+	const cl::Event& first_read_event() const {
+		return reading;
+	}
+	const cl::Event& last_read_event() const {
+		return ready;
+	}
+};
 
 class g_Population
 {
@@ -19,21 +102,149 @@ private:
 	int numIndividuals;
 	int numCitiesPerWorld;
 	int height, width;
-	cl::Buffer cities_xcoord;
-	cl::Buffer cities_ycoord;
+	const City* host_cities;	// Coordinate table of the base world
+	const g_CityTable& table;
+	cl::Buffer tours;
 	cl::Buffer fitness;
 	cl::Buffer fit_prob;
-	void extract_max_fit(World& world) const;
+	std::vector<cl::Buffer> scan_sums;	// Block totals of every level of the prefix sum
+	cl::Buffer alias_prob;		// Alias table, allocated by bind() if used
+	cl::Buffer alias_inx;
+	AliasTable* host_alias;		// The same table, built on the host
+	std::vector<float> host_fitness;	// The fitnesses it is built from
+	cl::Buffer top_val;			// Results of the top-k reduction
+	cl::Buffer top_inx;
+	int top_groups;				// Work-groups of its first phase
+	
+	// The population's own kernel instances. The arguments that stay fixed
+	// are bound once, by the constructor or by bind(), so a generation only
+	// sets its index and the other population's buffers never change.
+	struct ScanLevel
+	{
+		cl::Kernel block;
+		cl::Kernel add;			// Only used if there is more than one block
+		int groups;
+	};
+	std::vector<ScanLevel> scan_levels;
+	cl::Kernel k_fitness;
+	cl::Kernel k_top_0, k_top_1;
+	cl::Kernel k_gather;
+	bool alias_selection;		// The alias table is built and uploaded before k_select
+	cl::Kernel k_select;
+	int select_generation_arg;	// Index of the generation argument of k_select
+	cl::Kernel k_crossover, k_clone_parent, k_mutate;
+	cl::Kernel k_breed;
+	cl::Kernel k_copy_elites;
+	g_Population* bound_pop;	// The new population of bind(), or null
+	
+	void top_k(int k);
+	void bind_scan(const cl::Buffer& in, const cl::Buffer& out, int n, int level, bool normalize);
+	void scan(int level);
+	
+	g_Population(const g_Population&);
+	g_Population& operator=(const g_Population&);
 public:
-	g_Population(const opencl_env& env, int numIndividuals, int numCitiesPerWorld, int height, int width);
-	g_Population(const opencl_env& env, int numIndividuals, const World& baseWorld, int seed);
+	g_Population(const opencl_env& env, int numIndividuals, const World& baseWorld, const g_CityTable& table);
+	g_Population(const opencl_env& env, int numIndividuals, const World& baseWorld, const g_CityTable& table, const tour_t* tours);
+	~g_Population();
+	
+	/*
+	 Calculates the fitnesses and the fitness probabilities, entirely on the
+	 device
+	 */
 	void evaluate();
-	int select_leader(World& generation_leader, World& best_leader) const;
-	void select_parents(cl::Buffer& selected_parents_inx, cl::Buffer& probs) const;
-	void next_generation(g_Population& new_pop,
-						 const cl::Buffer& d_sel_ix,
-						 float prob_crossover, const cl::Buffer d_prob_cross, const cl::Buffer d_cross_loc,
-						 float prob_mutation, const cl::Buffer d_prob_mutate, const cl::Buffer d_mutate_loc) const;
+	
+	/*
+	 The two halves of evaluate(): the fitnesses, then the fitness
+	 probabilities from them
+	 */
+	void calc_fitness();
+	void calc_fit_prob();
+	
+	/*
+	 Copies the tours, fitnesses and fitness probabilities to a host population
+	 of the same size, for checking the device results
+	 */
+	void download(Population& host) const;
+	
+	/*
+	 Finds the fittest individual and starts reading it back into leader,
+	 without waiting for the device. leader.select() consumes it.
+	 */
+	void read_leader(g_Leader& leader);
+	
+	/*
+	 Binds the arguments of the breeding kernels that stay the same for the
+	 whole run. With two populations, each is bound once to the other, and
+	 swapping them is then all a generation takes.
+	 
+	 new_pop              : The population the children go to
+	 selected_parents_inx : Receives the indices of the parents
+	 d_visited            : Crossover bitmaps, visited_bytes() per individual,
+	                        for next_generation
+	 seed                 : Seed of the run
+	 prob_crossover       : The probability of a crossover occurring
+	 prob_mutation        : The probability of a mutation occurring
+	 method               : The selection method
+	 tournament_size      : The number of competitors per tournament
+	 */
+	void bind(g_Population& new_pop,
+			  const cl::Buffer& selected_parents_inx,
+			  const cl::Buffer& d_visited,
+			  uint32_t seed,
+			  float prob_crossover, float prob_mutation,
+			  selection_t method, int tournament_size);
+	
+	/*
+	 Selects two parents for every child. The kernels draw their own random
+	 numbers, the same as child_randoms and selection_words on the host.
+	 
+	 Alias selection builds its table on the host, with the CPU engine's
+	 AliasTable: Vose's method is sequential, and a single work-item builds
+	 it far slower than the host. This waits for the fitnesses, so the host
+	 cannot run ahead of the device.
+	 
+	 generation : Index of the generation being produced
+	 */
+	void select_parents(int generation);
+	
+	/*
+	 Breeds the children of the selected parents into the bound population,
+	 drawing the random numbers of every child on the device
+	 */
+	void next_generation(int generation);
+	
+	/*
+	 The two halves of next_generation(): the crossovers, with the children
+	 that are copies of their first parent, then the mutations
+	 */
+	void crossover(int generation);
+	void mutate(int generation);
+	
+	/*
+	 Breeds, mutates and evaluates the children into the bound population in
+	 one pass of the fused breed kernel. Same results as next_generation
+	 followed by calc_fitness() on the bound population.
+	 */
+	void breed(int generation);
+	
+	/*
+	 Copies the num_elites fittest individuals, found by a top-k reduction on
+	 the device, unchanged into the first slots of the bound population, over
+	 the children bred there. Same elites as preserve_elites on the host.
+	 */
+	void preserve_elites(int num_elites);
+	
+	/*
+	 Work-items per group of the breed kernel, or 0 if a child tour does not
+	 fit in the device's local memory
+	 */
+	int breed_group_size() const;
+	
+	/*
+	 Size of the crossover bitmap of one child, one bit per city
+	 */
+	size_t visited_bytes() const;
 };
 
 #endif /* defined(__tsp_ga__g_population__) */
@@ -7,24 +7,67 @@
 //
 
 #include "g_type.h"
+#include "world.h"
 #include <iostream>
 #include <fstream>
 #include <cstdlib>
+#include <cstring>
+#include <cassert>
 
 static const char *kernelsrcpath { "kernel.cl" };
 
-opencl_env::opencl_env()
+// Names of the kernels in kernel.cl, by kernel_t
+static const char* kernel_names[] = {
+	"fitness",
+	"scan_block",
+	"scan_add",
+	"max_fit_phase_0",
+	"max_fit_phase_1",
+	"select_parents",
+	"select_parents_alias",
+	"select_parents_tournament",
+	"crossover",
+	"clone_parent",
+	"mutate",
+	"breed",
+	"copy_elites",
+	"gather_leader"
+};
+static_assert(sizeof(kernel_names) / sizeof(kernel_names[0]) == static_cast<size_t>(kernel_t::LENGTH),
+			  "one name per kernel_t");
+
+opencl_env::opencl_env(cl_device_type type, cl_command_queue_properties properties)
+:
+	queueProperties(properties)
 {
 	try {
 		cl::Platform::get(&platforms);
 		
-		static cl_context_properties cps[3] = {
-			CL_CONTEXT_PLATFORM, cl_context_properties(platforms[0]()), 0
+		// Use the first platform offering a device of the requested type
+		size_t p = 0;
+		for (; p < platforms.size(); p++) {
+			std::vector<cl::Device> found;
+			try {
+				platforms[p].getDevices(type, &found);
+			} catch (const cl::Error&) {
+				continue;
+			}
+			if (!found.empty())
+				break;
+		}
+		if (p == platforms.size()) {
+			std::cerr << "No OpenCL device of the requested type" << std::endl;
+			exit(1);
+		}
+		
+		cl_context_properties cps[3] = {
+			CL_CONTEXT_PLATFORM, cl_context_properties(platforms[p]()), 0
 		};
 		
-		_context = new cl::Context(CL_DEVICE_TYPE_GPU, cps);
+		_context = new cl::Context(type, cps);
 		devices = _context->getInfo<CL_CONTEXT_DEVICES>();
-		_queue = cl::CommandQueue(context(), devices[0], 0);
+		_queue = cl::CommandQueue(context(), devices[0], properties);
+		_transfer_queue = cl::CommandQueue(context(), devices[0], properties);
 		
 		std::ifstream kernelSrcFile(kernelsrcpath);
 		std::string kernelSrcText((std::istreambuf_iterator<char>(kernelSrcFile)), std::istreambuf_iterator<char>());
@@ -32,9 +75,19 @@ opencl_env::opencl_env()
 		cl::Program::Sources kernelSrc(1, std::make_pair(kernelSrcText.c_str(), kernelSrcText.length()+1));
 		program = new cl::Program(context(), kernelSrc);
 		
+		// Match the kernels' tour element type to the host's
+		std::string options = sizeof(tour_t) == 2 ? "-D TOUR_T=ushort" : "-D TOUR_T=uint";
+		
+		// The fitnesses and probabilities are quotients. OpenCL only rounds
+		// them like the host if asked to, and only on devices that can.
+		cl_device_fp_config fp_config = devices[0].getInfo<CL_DEVICE_SINGLE_FP_CONFIG>();
+		exactDivide = (fp_config & CL_FP_CORRECTLY_ROUNDED_DIVIDE_SQRT) != 0;
+		if (exactDivide)
+			options += " -cl-fp32-correctly-rounded-divide-sqrt";
+		
 		try {
-			program->build(devices);
-		} catch (cl::Error error) {
+			program->build(devices, options.c_str());
+		} catch (const cl::Error& error) {
 			if (strcmp(error.what(), "clBuildProgram") == 0) {
 				std::cerr << "Error while building:" << std::endl;
 				std::cerr << program->getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0]) << std::endl;
@@ -45,17 +98,16 @@ opencl_env::opencl_env()
 		}
 		
 		numComputeUnits = devices[0].getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+		localMemSize = static_cast<size_t>(devices[0].getInfo<CL_DEVICE_LOCAL_MEM_SIZE>());
+		maxClockFrequency = static_cast<int>(devices[0].getInfo<CL_DEVICE_MAX_CLOCK_FREQUENCY>());
+		
+		// Fail now rather than at the first use if a kernel is missing
+		for (int i = 0; i < static_cast<int>(kernel_t::LENGTH); i++) {
+			cl::Kernel check(*program, kernel_names[i]);
+		}
 		
-		krnl_table[static_cast<int>(kernel_t::fitness)] = new cl::Kernel(*program, "fitness");
-		krnl_table[static_cast<int>(kernel_t::fit_sum)] = new cl::Kernel(*program, "fit_sum");
-		krnl_table[static_cast<int>(kernel_t::fit_prob)] = new cl::Kernel(*program, "fit_prob");
-		krnl_table[static_cast<int>(kernel_t::max_fit_phase_0)] = new cl::Kernel(*program, "max_fit_phase_0");
-		krnl_table[static_cast<int>(kernel_t::max_fit_phase_1)] = new cl::Kernel(*program, "max_fit_phase_1");
-		krnl_table[static_cast<int>(kernel_t::select_parents)] = new cl::Kernel(*program, "select_parents");
-		krnl_table[static_cast<int>(kernel_t::crossover)] = new cl::Kernel(*program, "crossover");
-		krnl_table[static_cast<int>(kernel_t::clone_parent)] = new cl::Kernel(*program, "clone_parent");
-		krnl_table[static_cast<int>(kernel_t::mutate)] = new cl::Kernel(*program, "mutate");
-	} catch (cl::Error error) {
+		_pool = new g_BufferPool(context());
+	} catch (const cl::Error& error) {
 		std::cerr << error.what() << "(" << error.err() << ")" << std::endl;
 		exit(1);
 	}
@@ -63,14 +115,62 @@ opencl_env::opencl_env()
 
 opencl_env::~opencl_env()
 {
-	for (int i = 0; i < static_cast<int>(kernel_t::LENGTH); i++) {
-		delete krnl_table[i];
-	}
+	delete _pool;
 	delete program;
 	delete _context;
 }
 
-cl::Kernel& opencl_env:: getKernel(kernel_t id) const
+cl::Kernel opencl_env::createKernel(kernel_t id) const
+{
+	return cl::Kernel(*program, kernel_names[static_cast<int>(id)]);
+}
+
+g_BufferPool::g_BufferPool(const cl::Context& context)
+:
+	context(&context), num_allocations(0)
+{
+}
+
+/*
+ Rounds a size up to its bucket: a multiple of an eighth of the power of two
+ just below it, which wastes at most an eighth of the buffer
+ */
+static size_t bucket_size(size_t bytes)
+{
+	size_t min_bucket = 256;
+	if (bytes <= min_bucket)
+		return min_bucket;
+	size_t top = 1;
+	while (top * 2 <= bytes)
+		top *= 2;
+	size_t step = top / 8;
+	return (bytes + step - 1) / step * step;
+}
+
+cl::Buffer g_BufferPool::acquire_bytes(size_t bytes)
+{
+	size_t bucket = bucket_size(bytes);
+	
+	cl::Buffer buffer;
+	std::vector<cl::Buffer>& free = free_buffers[bucket];
+	if (!free.empty()) {
+		buffer = free.back();
+		free.pop_back();
+	} else {
+		buffer = cl::Buffer(*context, CL_MEM_READ_WRITE, bucket);
+		num_allocations++;
+	}
+	in_use[buffer()] = bucket;
+	return buffer;
+}
+
+void g_BufferPool::release(const cl::Buffer& buffer)
 {
-	return *krnl_table[static_cast<int>(id)];
+	if (buffer() == nullptr)
+		return;
+	
+	auto it = in_use.find(buffer());
+	assert(it != in_use.end());
+	free_buffers[it->second].push_back(buffer);
+	in_use.erase(it);
 }
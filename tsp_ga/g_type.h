@@ -10,6 +10,8 @@
 #define tsp_ga_g_type_h
 
 #include <vector>
+#include <map>
+#include <unordered_map>
 
 #define __CL_ENABLE_EXCEPTIONS
 #ifdef __APPLE__
@@ -21,30 +23,88 @@
 enum class kernel_t
 {
 	fitness,
-	fit_sum,
-	fit_prob,
+	scan_block,
+	scan_add,
 	max_fit_phase_0,
 	max_fit_phase_1,
 	select_parents,
+	select_parents_alias,
+	select_parents_tournament,
 	crossover,
 	clone_parent,
 	mutate,
-	LENGTH = mutate+1
+	breed,
+	copy_elites,
+	gather_leader,
+	LENGTH = gather_leader+1
+};
+
+/*
+ Device buffers kept for reuse, so that populations and work buffers created
+ again on the same device do not allocate again. Sizes are rounded up to
+ buckets of an eighth of a power of two, and a buffer only ever goes back to
+ the bucket it came from.
+ */
+class g_BufferPool
+{
+private:
+	const cl::Context* context;
+	std::map<size_t, std::vector<cl::Buffer>> free_buffers;	// By bucket size
+	std::unordered_map<const void*, size_t> in_use;			// Bucket of every buffer handed out
+	size_t num_allocations;
+	cl::Buffer acquire_bytes(size_t bytes);
+public:
+	g_BufferPool(const cl::Context& context);
+	
+	/*
+	 Returns a read-write buffer of at least count elements of type T,
+	 reusing a released one of the same bucket if there is one
+	 */
+	template <typename T>
+	cl::Buffer acquire(size_t count)
+	{
+		return acquire_bytes(count * sizeof(T));
+	}
+	
+	/*
+	 Gives a buffer from acquire() back to the pool. Releasing a null buffer
+	 does nothing.
+	 */
+	void release(const cl::Buffer& buffer);
+	
+	/*
+	 Device allocations made so far
+	 */
+	size_t allocations() const {
+		return num_allocations;
+	}
 };
 
 class opencl_env
 {
 private:
-	cl::Kernel* krnl_table[static_cast<int>(kernel_t::LENGTH)];
 	std::vector<cl::Platform> platforms;
 	cl::Context* _context;
 	std::vector<cl::Device> devices;
 	cl::CommandQueue _queue;
+	cl::CommandQueue _transfer_queue;
 	cl::Program* program;
 	cl::NDRange globalRange;
 	int numComputeUnits;
+	size_t localMemSize;
+	int maxClockFrequency;
+	bool exactDivide;
+	cl_command_queue_properties queueProperties;
+	g_BufferPool* _pool;
 public:
-	opencl_env();
+	/*
+	 Sets up the first device of the given type, searching every platform
+	 
+	 type       : CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_CPU (e.g. PoCL), ...
+	 properties : Properties of the command queues, e.g.
+	              CL_QUEUE_PROFILING_ENABLE to time the commands
+	 */
+	opencl_env(cl_device_type type = CL_DEVICE_TYPE_GPU, cl_command_queue_properties properties = 0);
 	~opencl_env();
 	
 	cl::Context& context() const {
@@ -55,11 +115,55 @@ public:
 		return _queue;
 	}
 	
+	/*
+	 Second in-order queue on the same device, for reads back to the host.
+	 Its commands wait on events of queue() rather than on its order, so
+	 they overlap with the kernels enqueued after them there.
+	 */
+	const cl::CommandQueue& transfer_queue() const {
+		return _transfer_queue;
+	}
+	
 	int getNumComputeUnits() const {
 		return numComputeUnits;
 	}
 	
-	cl::Kernel& getKernel(kernel_t) const;
+	size_t getLocalMemSize() const {
+		return localMemSize;
+	}
+	
+	/*
+	 Whether single precision divisions are correctly rounded, as on the
+	 host. Otherwise OpenCL allows them 2.5 ulp of error.
+	 */
+	bool hasExactDivide() const {
+		return exactDivide;
+	}
+	
+	/*
+	 Whether the queues time their commands (CL_QUEUE_PROFILING_ENABLE)
+	 */
+	bool isProfiling() const {
+		return (queueProperties & CL_QUEUE_PROFILING_ENABLE) != 0;
+	}
+	
+	/*
+	 Highest clock frequency of the device, in MHz
+	 */
+	int getMaxClockFrequency() const {
+		return maxClockFrequency;
+	}
+	
+	g_BufferPool& pool() const {
+		return *_pool;
+	}
+	
+	/*
+	 Creates an instance of a kernel of its own. Each user of a kernel keeps
+	 its instance, binds the arguments that stay fixed once, and only sets
+	 the ones that change before enqueuing it.
+	 */
+	cl::Kernel createKernel(kernel_t) const;
 };
 
 #endif
@@ -12,94 +12,257 @@
 // Native includes
 #include <iostream>
 #include <algorithm>
-#include <random>
 #include <utility>
 #include <cstring>
 #include <cassert>
+#include <atomic>
+#include <functional>
 
 // Program includes
 #include "ga_cpu.h"
 #include "population.h"
+#include "selection.h"
+#include "local_search.h"
+#include "seeding.h"
+#include "scan.h"
+#include "rng.h"
 #include "common.h"
 #include "log.h"
+#include "heap_count.h"
 
 using namespace std;
 
-void evaluate(Population& pop)
+// Children bred and individuals evaluated per work item of the thread pool
+static const int breed_grain = 64;
+static const int eval_grain  = 256;
+
+void calc_fit_prob(Population& pop)
 {
-	// Sum of all fitness
-	float fit_sum = 0.0f;
+	scan(pop.fitness, pop.fit_prob, pop.numIndividuals, true, pop.scan_scratch);
+}
 
-	// Calculate fitnesses and total sum; compute partial prob
+void evaluate(Population& pop)
+{
+	// Calculate fitnesses
 	for (int i = 0; i < pop.numIndividuals; i++)
-	{
-		fit_sum += pop.CalcFitness(i);
-		pop.fit_prob[i] = fit_sum;
-	}
+		pop.CalcFitness(i);
 
-	// Compute the full probabilities
-	for (int i = 0; i < pop.numIndividuals; i++)
-		pop.fit_prob[i] /= fit_sum;
+	calc_fit_prob(pop);
 }
 
-void selection(const Population& pop, int* parent_xcoord[], int* parent_ycoord[], float rand_nums[2])
+void evaluate(Population& pop, ThreadPool& pool)
 {
-	// Select the parents
+	// Calculate fitnesses
+	pool.parallel_for(0, pop.numIndividuals, eval_grain, [&pop](int begin, int end, int) {
+		for (int i = begin; i < end; i++)
+			pop.CalcFitness(i);
+	});
+
+	calc_fit_prob(pop);
+}
+
+void selection(const Population& pop, const tour_t* parents[2], const float rand_nums[2])
+{
+	// Select the parents: the first individual whose cumulative probability
+	// reaches the random number
+	const float* first = pop.fit_prob;
+	const float* last  = pop.fit_prob + pop.numIndividuals;
 	for (int i = 0; i < 2; i++) {
-		float prob = rand_nums[i];
-		for (int j = 0; j < pop.numIndividuals; j++) {
-			if (prob <= pop.fit_prob[j]) {
-				pop.GetCities(parent_xcoord[i], parent_ycoord[i], j);
-				break;
-			}
-		}
+		const float* pos = lower_bound(first, last, rand_nums[i]);
+		int j = pos != last ? static_cast<int>(pos - first) : pop.numIndividuals - 1;
+		parents[i] = pop.GetTour(j);
 	}
 }
 
-void crossover(int* parents_xcoord[2], int* parents_ycoord[2], int* child_xcoord, int* child_ycoord, int num_cities, int cross_over)
+void crossover(const tour_t* const parents[2], tour_t* child, int num_cities, int cross_over,
+			   uint32_t* visited)
 {
+	memset(visited, 0, visited_words(num_cities) * sizeof(uint32_t));
+	
 	// Select elements in first parent from start up through crossover point
-	memmove(child_xcoord, parents_xcoord[0], (cross_over + 1) * sizeof(int));
-	memmove(child_ycoord, parents_ycoord[0], (cross_over + 1) * sizeof(int));
+	memmove(child, parents[0], (cross_over + 1) * sizeof(tour_t));
+	for (int j = 0; j <= cross_over; j++)
+		visited[child[j] >> 5] |= 1u << (child[j] & 31);
 	
 	// Add remaining elements from second parent to child, preserving order
-	int* p_xcoord = parents_xcoord[1];
-	int* p_ycoord = parents_ycoord[1];
+	const tour_t* p = parents[1];
 	int remaining = num_cities - cross_over - 1; // The number of cities to add
 	int count     = 0; // The number of cities that have been added
-	for (int i = 0; i < num_cities; i++) // Loop parent
+	for (int i = 0; i < num_cities && count < remaining; i++) // Loop parent
 	{
-		bool in_child = false;
-		for (int j = 0; j <= cross_over; j++) // Loop child
-		{
-			// If the city is in the child, exit this loop
-			if (child_xcoord[j] == p_xcoord[i] && child_ycoord[j] == p_ycoord[i])
-			{
-				in_child = true;
-				break;
-			}
-		}
-			
-		// If the city was not found in the child, add it to the child
-		if (!in_child)
+		// If the city was not taken from the first parent, add it to the child
+		if (!(visited[p[i] >> 5] & (1u << (p[i] & 31))))
 		{
 			count++;
-			child_xcoord[cross_over+count] = p_xcoord[i];
-			child_ycoord[cross_over+count] = p_ycoord[i];
+			child[cross_over+count] = p[i];
 		}
-			
-		// Stop once all of the cities have been added
-		if (count == remaining) break;
 	}
 }
 
-void mutate(int* child_xcoord, int* child_ycoord, int rand_nums[2])
+void mutate(tour_t* child, const int rand_nums[2])
 {
 	// Swap the elements
 	int indx0 = rand_nums[0];
 	int indx1 = rand_nums[1];
-	std::swap(child_xcoord[indx0], child_xcoord[indx1]);
-	std::swap(child_ycoord[indx0], child_ycoord[indx1]);
+	std::swap(child[indx0], child[indx1]);
+}
+
+/*
+	Swaps two cities of a child and returns its new squared length, from the
+	old one and the change of the at most four edges touching the swapped
+	cities. The sums wrap around like the full evaluation, so both agree.
+*/
+static int mutate_tracked(const DistanceTable& distances, tour_t* child, int num_cities,
+						  const int locs[2], int length)
+{
+	// Start of every edge touching a swapped city, without repeats
+	int candidates[4] = { locs[0] - 1, locs[0], locs[1] - 1, locs[1] };
+	int edges[4];
+	int count = 0;
+	for (int e : candidates)
+		if (e >= 0 && e < num_cities - 1 && find(edges, edges + count, e) == edges + count)
+			edges[count++] = e;
+	
+	unsigned tracked = static_cast<unsigned>(length);
+	for (int k = 0; k < count; k++)
+		tracked -= distances.sq(child[edges[k]], child[edges[k] + 1]);
+	mutate(child, locs);
+	for (int k = 0; k < count; k++)
+		tracked += distances.sq(child[edges[k]], child[edges[k] + 1]);
+	return static_cast<int>(tracked);
+}
+
+size_t breed_scratch_bytes(int num_cities, const GAOptions& options)
+{
+	size_t bytes = ScratchArena::footprint<uint32_t>(visited_words(num_cities));
+	if (options.improve_prob > 0.0f)
+		bytes += improve_scratch_bytes(num_cities);
+	return bytes;
+}
+
+/*
+	Produces every child of a generation. The random numbers of each child
+	only depend on its slot, so the result does not depend on the number of
+	threads or on which thread produced which child.
+	
+	Parents are read in place from oldPop and every child is built directly
+	in its slot of newPop, so breeding does not allocate; any scratch memory
+	comes from the arena of the running thread.
+*/
+void breed(const Population& oldPop, Population& newPop, int generation,
+		   float prob_mutation, float prob_crossover, uint32_t seed,
+		   const GAOptions& options, const AliasTable* alias,
+		   const NeighborLists* neighbors,
+		   ThreadPool& pool, ScratchArena* arenas, std::atomic<int>& mismatches,
+		   PhaseTimes* thread_phases, size_t* thread_allocations)
+{
+	const DistanceTable& distances = *oldPop.distances;
+	const int individual_size = oldPop.numCitiesPerWorld;
+
+	auto body = [&](int begin, int end, int thread) {
+		size_t heap_allocations = thread_heap_allocations();
+		ScratchArena& scratch = arenas[thread];
+		PhaseLap lap(thread_phases != nullptr ? &thread_phases[thread] : nullptr);
+		
+		for (int j = begin; j < end; j++)
+		{
+			scratch.reset();
+			
+			// Parents and children
+			const tour_t* parents[2];
+			tour_t* child = newPop.GetTour(j);
+			
+			// Generate all probabilities ahead of time
+			ChildRandoms r;
+			child_randoms(r, seed, generation, j, individual_size);
+
+			// Select two parents
+			if (options.selection == selection_t::roulette)
+			{
+				selection(oldPop, parents, r.prob_select);
+			}
+			else
+			{
+				uint32_t words[8];
+				selection_words(words, seed, generation, j);
+				for (int p = 0; p < 2; p++) {
+					int ix = options.selection == selection_t::alias
+						? alias->draw(&words[4 * p])
+						: tournament_selection(oldPop, options.tournament_size, &words[4 * p]);
+					parents[p] = oldPop.GetTour(ix);
+				}
+			}
+			lap.mark(phase_t::select);
+			
+			// Determine how many children are born
+			int length;
+			if (r.prob_cross < prob_crossover)
+			{
+				// Perform crossover
+				uint32_t* visited = scratch.alloc<uint32_t>(visited_words(individual_size));
+				crossover(parents, child, individual_size, r.cross_loc, visited);
+				lap.mark(phase_t::crossover);
+				length = distances.tour_length(child, individual_size);
+				lap.mark(phase_t::evaluate);
+			}
+			else // Select the first parent
+			{
+				memcpy(child, parents[0], individual_size * sizeof(tour_t));
+				length = oldPop.lengths[(parents[0] - oldPop.tours) / individual_size];
+				lap.mark(phase_t::crossover);
+			}
+			
+			// Perform mutation
+			if (r.prob_mutate < prob_mutation) {
+				length = mutate_tracked(distances, child, individual_size, r.mutate_loc, length);
+				lap.mark(phase_t::mutate);
+			}
+			
+			// Improve the child by local search
+			if (neighbors != nullptr && r.prob_improve < options.improve_prob) {
+				length = improve_tour(distances, *neighbors, child, individual_size, length,
+									  options.improve_moves, scratch);
+				lap.mark(phase_t::improve);
+			}
+			
+			if (options.verify) {
+				if (length != distances.tour_length(child, individual_size))
+					mismatches.fetch_add(1, std::memory_order_relaxed);
+				lap.mark(phase_t::evaluate);
+			}
+			
+			newPop.SetLength(j, length);
+		}
+		
+		if (thread_allocations != nullptr && thread != 0)
+			thread_allocations[thread] += thread_heap_allocations() - heap_allocations;
+	};
+	
+	// By reference, as a std::function would allocate a copy of the lambda
+	pool.parallel_for(0, newPop.numIndividuals, breed_grain, std::ref(body));
+}
+
+void preserve_elites(const Population& oldPop, Population& newPop, int num_elites,
+					 ScratchArena& scratch)
+{
+	scratch.reset();
+	int* order = scratch.alloc<int>(oldPop.numIndividuals);
+	oldPop.top_k(num_elites, order);
+	for (int e = 0; e < num_elites; e++) {
+		newPop.SetTour(e, oldPop.GetTour(order[e]));
+		newPop.SetLength(e, oldPop.lengths[order[e]]);
+	}
+}
+
+void improve_leader(Population& pop, const NeighborLists& neighbors,
+					const GAOptions& options, ScratchArena& scratch)
+{
+	int ix = static_cast<int>(max_element(pop.fitness, pop.fitness + pop.numIndividuals) - pop.fitness);
+	
+	scratch.reset();
+	int length = improve_tour(*pop.distances, neighbors, pop.GetTour(ix), pop.numCitiesPerWorld,
+							  pop.lengths[ix], options.improve_moves, scratch);
+	pop.SetLength(ix, length);
 }
 
 void execute(int pop_size,
@@ -107,114 +270,153 @@ void execute(int pop_size,
 			 float prob_mutation, float prob_crossover,
 			 const World& baseWorld,
 			 Logger& gen_log,
-			 int seed)
+			 int seed,
+			 const GAOptions& options)
 {
 	// Timing
-	clock_t gen_clock;
-
-	// Random number generation
-	std::mt19937::result_type rseed = seed;
-	auto rgen = bind(uniform_real_distribution<>(0, 1), mt19937(rseed));
+	wall_clock::time_point gen_clock;
 
-	// The fitness for the current generation
-	const int individual_size = baseWorld.num_cities;
+	if (!options.valid(pop_size))
+		return;
+	
+	// Worker threads and their scratch memory, kept across generations
+	ThreadPool pool(options.num_threads);
+	ScratchArena* arenas = new ScratchArena[pool.size()];
+	for (int t = 0; t < pool.size(); t++)
+		arenas[t].reserve(breed_scratch_bytes(baseWorld.num_cities, options));
+	
+	// Heap allocations of the worker threads while breeding, see breed()
+	size_t* thread_allocations = new size_t[pool.size()]();
+	
+	if (options.stats != nullptr) {
+		*options.stats = RunStats();
+		options.stats->generations.reserve(max_gen);
+	}
+	
+	// Time of the phases, with the children's summed over every thread
+	PhaseTimes* phases = options.profile && options.stats != nullptr ? &options.stats->phases : nullptr;
+	PhaseTimes* thread_phases = phases != nullptr ? new PhaseTimes[pool.size()] : nullptr;
 
 	// The best individuals
 	int best_generation = 0;
-	World bestLeader(baseWorld.num_cities, baseWorld.height, baseWorld.width);
-	World generationLeader(baseWorld.num_cities, baseWorld.height, baseWorld.width);
+	BestTour best(baseWorld.num_cities);
+	int leader;		// Of the current generation
+	
+	// Edge costs shared by both populations
+	DistanceTable distances(baseWorld, options.distance_budget, options.distance_stats,
+							 options.distance_cache);
 	
 	// Initialize the populations
-	Population* oldPop = new Population(pop_size, baseWorld, seed);
-	Population* newPop = new Population(pop_size, baseWorld.num_cities, baseWorld.height, baseWorld.width);
+	Population* oldPop = new Population(pop_size, baseWorld, distances);
+	Population* newPop = new Population(pop_size, baseWorld, distances);
+	seed_tours(oldPop->tours, pop_size, baseWorld, seed,
+			   options.seeding, options.seed_random_fraction, pool);
 	
 	// Calculate the fitnesses
-	evaluate(*oldPop);
+	evaluate(*oldPop, pool);
+	
+	// Candidate lists of the local search, if used
+	NeighborLists* neighbors = nullptr;
+	if (options.improve_prob > 0.0f || options.improve_leader)
+		neighbors = new NeighborLists(baseWorld, options.improve_neighbors);
+	
+	// Alias table for the selection, if used
+	AliasTable* alias = nullptr;
+	if (options.selection == selection_t::alias)
+		alias = new AliasTable(pop_size);
 	
 	// Initialize the best leader
-	oldPop->select_leader(generationLeader, bestLeader);
-	print_status(generationLeader, bestLeader, 0);
-	gen_log.write_log(0, 0, generationLeader);
+	oldPop->select_leader(leader, best);
+	print_status(oldPop->fitness[leader], best.fitness, 0);
+	gen_log.write_log(0, 0, oldPop->fitness[leader], oldPop->GetTour(leader),
+					  baseWorld.cities, baseWorld.num_cities);
 
 	// Continue through all generations
 	for (int i = 0; i < max_gen; i++)
 	{
 		// Start the generation clock
-		gen_clock = clock();
+		gen_clock = wall_clock::now();
+		
+		// Allocations so far, of this thread and of the workers' breeding
+		size_t heap_allocations = thread_heap_allocations();
+		for (int t = 0; t < pool.size(); t++)
+			heap_allocations += thread_allocations[t];
 
 		// Create a new population
-		for (int j = 0; j < pop_size; j++)
-		{
-			// Parents and children
-			int* parents_xcoord[2];
-			int* parents_ycoord[2];
-			int* child_xcoord = new int[individual_size];
-			int* child_ycoord = new int[individual_size];
-			parents_xcoord[0] = new int[individual_size];
-			parents_xcoord[1] = new int[individual_size];
-			parents_ycoord[0] = new int[individual_size];
-			parents_ycoord[1] = new int[individual_size];
-			
-			// Generate all probabilities ahead of time
-			float prob_select[2] = {static_cast<float>(rgen()), static_cast<float>(rgen())};
-			float prob_cross     = static_cast<float>(rgen());
-			int   cross_loc      = static_cast<int>(rgen() * (baseWorld.num_cities - 1));
-			float prob_mutate    = static_cast<float>(rgen());
-			int   mutate_loc[2]  = {
-				static_cast<int>(rgen() * baseWorld.num_cities),
-				static_cast<int>(rgen() * baseWorld.num_cities)
-			};
-			while (mutate_loc[1] == mutate_loc[0])
-				mutate_loc[1] = static_cast<int>(rgen() * baseWorld.num_cities);
-
-			// Select two parents
-			selection(*oldPop, parents_xcoord, parents_ycoord, prob_select);
-			
-			// Determine how many children are born
-			if (prob_cross <= prob_crossover)
-			{
-				// Perform crossover
-				crossover(parents_xcoord, parents_ycoord, child_xcoord, child_ycoord, baseWorld.num_cities, cross_loc);
-
-				// Perform mutation
-				if (prob_mutate <= prob_mutation)
-					mutate(child_xcoord, child_ycoord, mutate_loc);
-
-				// Add child to new population
-				newPop->SetCities(j, child_xcoord, child_ycoord);
-			}
-			else // Select the first parent
-			{
-				// Perform mutation
-				if (prob_mutate <= prob_mutation)
-					mutate(parents_xcoord[0], parents_ycoord[0], mutate_loc);
-
-				// Add child to new population
-				newPop->SetCities(j, parents_xcoord[0], parents_ycoord[0]);
-			}
-
-			// Cleanup
-			delete[] parents_xcoord[0]; delete[] parents_xcoord[1];
-			delete[] parents_ycoord[0]; delete[] parents_ycoord[1];
-			delete[] child_xcoord; delete[] child_ycoord;
-		} // Population creation
+		if (alias != nullptr) {
+			ScopedPhase timer(phases, phase_t::select);
+			alias->build(*oldPop);
+		}
+		std::atomic<int> mismatches(0);
+		breed(*oldPop, *newPop, i + 1, prob_mutation, prob_crossover, seed, options, alias,
+			  neighbors, pool, arenas, mismatches, thread_phases, thread_allocations);
+		if (options.num_elites > 0) {
+			ScopedPhase timer(phases, phase_t::elites);
+			preserve_elites(*oldPop, *newPop, options.num_elites, arenas[0]);
+		}
+		if (options.improve_leader) {
+			ScopedPhase timer(phases, phase_t::improve);
+			improve_leader(*newPop, *neighbors, options, arenas[0]);
+		}
+		
+		// Count what breeding allocated. Only the first generation may, while
+		// the arenas grow to the size breeding needs; the reporting below
+		// may allocate and is left out.
+		size_t gen_allocations = thread_heap_allocations() - heap_allocations;
+		for (int t = 0; t < pool.size(); t++)
+			gen_allocations += thread_allocations[t];
+		assert(i == 0 || gen_allocations == 0);
+		if (options.stats != nullptr) {
+			options.stats->allocations += gen_allocations;
+			options.stats->last_gen_allocations = gen_allocations;
+		}
+		
+		if (mismatches > 0)
+			cerr << "Generation " << i + 1 << ": " << mismatches
+				 << " incremental fitness values differ from a full evaluation" << endl;
 
-		// Calculate the fitnesses
-		evaluate(*newPop);
+		// Calculate the fitness probabilities; breeding set the fitnesses
+		{
+			ScopedPhase timer(phases, phase_t::evaluate);
+			calc_fit_prob(*newPop);
+		}
 
 		// Swap the populations
 		std::swap(oldPop, newPop);
-
+		
 		// Select the new leaders
-		if (oldPop->select_leader(generationLeader, bestLeader))
-			best_generation = i + 1;
-		print_status(generationLeader, bestLeader, i + 1);
-		gen_log.write_log(i + 1, end_clock(gen_clock), generationLeader);
+		{
+			ScopedPhase timer(phases, phase_t::leader);
+			if (oldPop->select_leader(leader, best))
+				best_generation = i + 1;
+		}
+		
+		// Report the generation
+		{
+			ScopedPhase timer(phases, phase_t::log);
+			print_status(oldPop->fitness[leader], best.fitness, i + 1);
+			float gen_time = end_clock(gen_clock);
+			gen_log.write_log(i + 1, gen_time, oldPop->fitness[leader], oldPop->GetTour(leader),
+							  baseWorld.cities, baseWorld.num_cities);
+			if (options.stats != nullptr)
+				options.stats->generations.push_back({ gen_time, best.distance });
+		}
 	} // Generations
 	
+	if (phases != nullptr) {
+		for (int t = 0; t < pool.size(); t++)
+			*phases += thread_phases[t];
+		delete[] thread_phases;
+	}
+	
 	delete oldPop; delete newPop;
+	delete[] arenas;
+	delete[] thread_allocations;
+	delete alias;
+	delete neighbors;
 	
 	cout << endl
 		 << "Best generation found at " << best_generation << " generations"
 		 << endl;
+	distances.print_stats();
 }
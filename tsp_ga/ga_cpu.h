@@ -12,9 +12,17 @@
 #ifndef __GA_CPU_H__
 #define __GA_CPU_H__
 
+// Native includes
+#include <atomic>
+
 // Program includes
 #include "world.h"
 #include "population.h"
+#include "thread_pool.h"
+#include "options.h"
+#include "arena.h"
+#include "selection.h"
+#include "neighbors.h"
 #include "log.h"
 
 /*
@@ -23,36 +31,118 @@
 */
 void evaluate(Population& pop);
 
+/*
+	Evaluate the fitness function and calculate the
+	fitness probabilities, spreading the fitness
+	evaluation across the threads of a pool.
+*/
+void evaluate(Population& pop, ThreadPool& pool);
+
+/*
+	Turns the fitnesses into cumulative probabilities, summing them in the
+	same order as the OpenCL scan kernels.
+*/
+void calc_fit_prob(Population& pop);
+
 /*
 	Perform the selection algorithm on the CPU.
-	This selection algorithm uses Roulette Wheel Selection.
+	This selection algorithm uses Roulette Wheel Selection, with a binary
+	search over the cumulative fitness probabilities.
 	Two parents will be selected at a time, from the population.
 
 	pop       : The population to select from
-	parents_* : The cities for two worlds
+	parents   : Set to the tours of the two selected worlds, inside pop
 	rand_nums : The random numbers to use
 */
-void selection(const Population& pop, int* parent_xcoord[], int* parent_ycoord[], float rand_nums[2]);
+void selection(const Population& pop, const tour_t* parents[2], const float rand_nums[2]);
 
 /*
 	Perform the crossover algorithm on the CPU.
 	This crossover algorithm uses the Single Point Crossover method.
 	
-	parents_*  : The cities for two worlds
-	child_*    : The child to create
+	The cities already taken from the first parent are marked in a bitmap,
+	so each child costs O(num_cities).
+	
+	parents    : The tours for two worlds
+	child      : The child to create
 	num_cities : The number of cities in the world
 	cross_over : The location to perform crossover
+	visited    : Scratch bitmap of visited_words(num_cities) words
 */
-void crossover(int* parents_xcoord[2], int* parents_ycoord[2], int* child_xcoord, int* child_ycoord, int num_cities, int cross_over);
+void crossover(const tour_t* const parents[2], tour_t* child, int num_cities, int cross_over,
+			   uint32_t* visited);
+
+/*
+	Size of the crossover bitmap, in 32 bit words
+*/
+inline int visited_words(int num_cities)
+{
+	return (num_cities + 31) / 32;
+}
 
 /*
 	Perform the mutation algorithm on the CPU.
 	This mutation algorithm uses the order changing permutation method.
 	
-	child_*    : The child to mutate
+	child      : The child to mutate
 	rand_nums  : The random numbers to use
 */
-void mutate(int* child_xcoord, int* child_ycoord, int rand_nums[2]);
+void mutate(tour_t* child, const int rand_nums[2]);
+
+/*
+	Scratch memory breed() needs from the arena of every thread. Reserving it
+	up front keeps breeding off the heap even on the threads that only get
+	their first children in a later generation.
+*/
+size_t breed_scratch_bytes(int num_cities, const GAOptions& options);
+
+/*
+	Breeds the new population and sets the fitness of every child. Only
+	crossover children are evaluated in full; clones inherit their parent's
+	length and mutations apply the change of the edges they touch. The fitness
+	probabilities are left to the caller (calc_fit_prob).
+	
+	oldPop         : The population to breed from
+	newPop         : The population to fill
+	generation     : Index of the generation being produced
+	prob_mutation  : The probability of a mutation occurring
+	prob_crossover : The probability of a crossover occurring
+	seed           : Seed of the breeding random numbers
+	options        : Engine settings
+	alias          : Alias table built for oldPop, if options.selection is alias
+	neighbors      : Candidate lists of the local search, if enabled
+	pool           : Threads to breed on
+	arenas         : Scratch memory, one arena per thread of the pool
+	mismatches     : Counts the incremental lengths that differ from a full
+	                 evaluation, when options.verify is set
+	thread_phases  : Receives the time of each phase of the children, one
+	                 PhaseTimes per thread of the pool, if not null
+	thread_allocations : Receives the heap allocations (heap_count.h) of the
+	                 pool's worker threads while breeding, one count per thread
+	                 of the pool, if not null. Thread 0 is the caller's, whose
+	                 allocations its own count already includes, and is left
+	                 alone.
+*/
+void breed(const Population& oldPop, Population& newPop, int generation,
+		   float prob_mutation, float prob_crossover, uint32_t seed,
+		   const GAOptions& options, const AliasTable* alias,
+		   const NeighborLists* neighbors,
+		   ThreadPool& pool, ScratchArena* arenas, std::atomic<int>& mismatches,
+		   PhaseTimes* thread_phases = nullptr, size_t* thread_allocations = nullptr);
+
+/*
+	Copies the num_elites fittest individuals of oldPop unchanged into the
+	first slots of newPop, over the children bred there. Ties go to the lower
+	index, as on the device.
+*/
+void preserve_elites(const Population& oldPop, Population& newPop, int num_elites,
+					 ScratchArena& scratch);
+
+/*
+	Improves the fittest individual of a population by local search
+*/
+void improve_leader(Population& pop, const NeighborLists& neighbors,
+					const GAOptions& options, ScratchArena& scratch);
 
 /*
 	Runs the genetic algorithm on the CPU.
@@ -64,12 +154,14 @@ void mutate(int* child_xcoord, int* child_ycoord, int rand_nums[2]);
 	baseWorld      : The seed world, containing all of the desired cities
 	gen_log        : A pointer a logger to be used for logging the generation statistics
 	seed           : Seed for all random numbers
+	options        : Engine settings, such as the number of threads
 */
 void execute(int pop_size,
 			 int max_gen,
 			 float prob_mutation, float prob_crossover,
 			 const World& baseWorld,
 			 Logger& gen_log,
-			 int seed);
+			 int seed,
+			 const GAOptions& options = GAOptions());
 
 #endif
\ No newline at end of file
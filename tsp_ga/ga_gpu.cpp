@@ -12,145 +12,461 @@
 // Native includes
 #include <iostream>
 #include <algorithm>
-#include <random>
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
+#include <vector>
+#include <fstream>
+#include <chrono>
 
 // Program includes
 #include "g_type.h"
 #include "g_population.h"
 #include "ga_gpu.h"
+#include "ga_cpu.h"
+#include "rng.h"
+#include "seeding.h"
+#include "thread_pool.h"
 #include "common.h"
 #include "log.h"
 
-void g_execute(int pop_size,
-			   int max_gen,
-			   float prob_mutation, float prob_crossover,
-			   const World& baseWorld,
-			   Logger& gen_log,
-			   int seed)
+/*
+	Distance in units in the last place between two positive floats, which
+	order like their bit patterns
+*/
+static uint32_t ulp_distance(float a, float b)
 {
-	// Timing
-	clock_t gen_clock;
+	uint32_t x, y;
+	memcpy(&x, &a, sizeof(x));
+	memcpy(&y, &b, sizeof(y));
+	return x > y ? x - y : y - x;
+}
+
+/*
+	Checks a device evaluation against the CPU's evaluate() on the same tours.
+	
+	Where the device divides like the host, the values must be identical.
+	Elsewhere OpenCL allows a division 2.5 ulp of error, so a fitness may be 3
+	ulp off; the probabilities add the errors of the fitnesses summed before
+	them to that of their own division, and get a wider bound.
+	
+	pop      : The population evaluated on the device
+	host     : A host population of the same size, overwritten
+	expected : Room for pop_size floats
+	exact    : Whether the device's divisions are correctly rounded
+	
+	returns the number of fitnesses and probabilities that differ
+*/
+static int verify_evaluation(const g_Population& pop, Population& host, float* expected, bool exact)
+{
+	const uint32_t fitness_ulps = exact ? 0 : 3;
+	const uint32_t prob_ulps = exact ? 0 : 16;
+	
+	pop.download(host);
+	
+	int n = host.numIndividuals;
+	memcpy(expected, host.fitness, n * sizeof(float));
+	memcpy(&expected[n], host.fit_prob, n * sizeof(float));
+	
+	evaluate(host);
+	
+	int mismatches = 0;
+	for (int i = 0; i < n; i++) {
+		if (ulp_distance(host.fitness[i], expected[i]) > fitness_ulps)
+			mismatches++;
+		if (ulp_distance(host.fit_prob[i], expected[n + i]) > prob_ulps)
+			mismatches++;
+	}
+	return mismatches;
+}
+
+/*
+	Timeline of the GPU engine's pipeline, as spans of time on lanes: the
+	host enqueuing a generation and logging it, the device computing it and
+	reading its leader back. Device times come from the profiling events of
+	DevicePhases and g_Leader, moved onto the host clock by a marker the
+	device completes when the trace starts, so the overlap between the lanes
+	shows in a single time line.
+*/
+class PipelineTrace
+{
+private:
+	struct Span
+	{
+		int generation;
+		const char* lane;
+		double start, end;	// Microseconds since the start of the trace
+	};
+	std::vector<Span> spans;
+	std::chrono::steady_clock::time_point origin;
+	double device_origin;	// Device time of the start, in nanoseconds
+	
+public:
+	PipelineTrace(const opencl_env& env)
+	{
+		cl::Event marker;
+		env.queue().enqueueMarkerWithWaitList(nullptr, &marker);
+		marker.wait();
+		origin = std::chrono::steady_clock::now();
+		device_origin = static_cast<double>(marker.getProfilingInfo<CL_PROFILING_COMMAND_END>());
+	}
+	
+	double now() const
+	{
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+	}
 	
-	// Random number generation
-	std::mt19937::result_type rseed = seed;
-	auto rgen = bind(uniform_real_distribution<float>(0, 1), mt19937(rseed));
+	// Records a span of the host, ending now
+	void host(int generation, const char* lane, double start)
+	{
+		spans.push_back({ generation, lane, start, now() });
+	}
+	
+	// Records a span of the device, from the start of one completed event to
+	// the end of another
+	void device(int generation, const char* lane, const cl::Event& first, const cl::Event& last)
+	{
+		double start = first.getProfilingInfo<CL_PROFILING_COMMAND_START>() - device_origin;
+		double end = last.getProfilingInfo<CL_PROFILING_COMMAND_END>() - device_origin;
+		spans.push_back({ generation, lane, start / 1000.0, end / 1000.0 });
+	}
+	
+	void write(const char* path) const
+	{
+		std::ofstream out(path);
+		out << "Generation,Lane,Start [us],End [us]" << std::endl;
+		for (const Span& span : spans)
+			out << span.generation << "," << span.lane << "," << span.start << "," << span.end << std::endl;
+	}
+};
+
+/*
+	Device time of each phase of the generations in flight, from markers
+	enqueued between the phases. The queue runs in order, so a marker
+	completes once everything enqueued before it has, and the time between
+	two markers is the time of the phase between them.
+*/
+class DevicePhases
+{
+private:
+	struct Mark
+	{
+		phase_t phase;		// Of the commands enqueued before the marker
+		cl::Event event;
+	};
+	const opencl_env& env;
+	std::vector<std::vector<Mark>> slots;	// One per generation in flight
+	
+public:
+	DevicePhases(const opencl_env& env, int depth)
+	:
+		env(env), slots(depth)
+	{
+	}
+	
+	// Marks the start of a generation
+	void start(int generation)
+	{
+		std::vector<Mark>& marks = slots[generation % slots.size()];
+		marks.resize(1);
+		env.queue().enqueueMarkerWithWaitList(nullptr, &marks[0].event);
+	}
+	
+	// The marker at the start of a generation
+	const cl::Event& start_event(int generation) const
+	{
+		return slots[generation % slots.size()][0].event;
+	}
+	
+	// Marks the end of a phase of a generation
+	void mark(int generation, phase_t phase)
+	{
+		std::vector<Mark>& marks = slots[generation % slots.size()];
+		marks.push_back({ phase, cl::Event() });
+		env.queue().enqueueMarkerWithWaitList(nullptr, &marks.back().event);
+	}
+	
+	// Adds up the phases of a generation, once its leader was read back, as
+	// the gather kernel and the reads run after all of them
+	void collect(int generation, const g_Leader& leader, PhaseTimes& times) const
+	{
+		const std::vector<Mark>& marks = slots[generation % slots.size()];
+		for (size_t m = 1; m < marks.size(); m++) {
+			cl_ulong start = marks[m - 1].event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+			cl_ulong end = marks[m].event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+			times.add_device(marks[m].phase, (end - start) / 1e6);
+		}
+		cl_ulong gather = leader.gather_event().getProfilingInfo<CL_PROFILING_COMMAND_END>() -
+						  leader.gather_event().getProfilingInfo<CL_PROFILING_COMMAND_START>();
+		cl_ulong read = leader.last_read_event().getProfilingInfo<CL_PROFILING_COMMAND_END>() -
+						leader.first_read_event().getProfilingInfo<CL_PROFILING_COMMAND_START>();
+		times.add_device(phase_t::leader, (gather + read) / 1e6);
+	}
+};
+
+/*
+	OpenCL device type for a device_t setting
+*/
+static cl_device_type cl_type(device_t device)
+{
+	switch (device) {
+		case device_t::cpu: return CL_DEVICE_TYPE_CPU;
+		case device_t::any: return CL_DEVICE_TYPE_ALL;
+		default:            return CL_DEVICE_TYPE_GPU;
+	}
+}
+
+opencl_env* g_create_env(const GAOptions& options)
+{
+	bool profiling = options.profile || options.timeline != nullptr;
+	return new opencl_env(cl_type(options.device), profiling ? CL_QUEUE_PROFILING_ENABLE : 0);
+}
+
+/*
+	The run of g_execute, on a device set up beforehand
+*/
+static void run(int pop_size,
+				int max_gen,
+				float prob_mutation, float prob_crossover,
+				const World& baseWorld,
+				Logger& gen_log,
+				int seed,
+				const GAOptions& options,
+				const opencl_env& env)
+{
+	// Timing
+	wall_clock::time_point gen_clock;
 	
 	// The populations
 	g_Population* old_pop;
 	g_Population* new_pop;
 	
-	// Random numbers
-	float *prob_select = new float[2 * pop_size];
-	float *prob_cross  = new float[pop_size];
-	float *prob_mutate = new float[pop_size];
-	int   *cross_loc   = new int[pop_size];
-	int   *mutate_loc  = new int[2 * pop_size];
-	
 	// Best individual parameters
-	int   sel;
 	int   best_generation = 0;
-	World best_leader(baseWorld.num_cities, baseWorld.height, baseWorld.width);
-	World generation_leader(baseWorld.num_cities, baseWorld.height, baseWorld.width);
+	BestTour best(baseWorld.num_cities);
+	
+	// Time of the phases, on the host and on the device
+	PhaseTimes* phases = nullptr;
+	if (options.stats != nullptr) {
+		*options.stats = RunStats();
+		if (options.profile)
+			phases = &options.stats->phases;
+	}
 	
 	///////// CPU Initializations
-	opencl_env env;
+	bool profiling = options.timeline != nullptr || phases != nullptr;
+	if (profiling && !env.isProfiling()) {
+		std::cerr << "Profiling needs a device set up with profiling queues" << std::endl;
+		return;
+	}
+	
+	// Edge costs
+	DistanceTable distances(baseWorld, options.distance_budget, options.distance_stats,
+							 options.distance_cache);
 	
 	///////// GPU Allocations
+	// City coordinates and distances, shared by both populations
+	g_CityTable table(env, baseWorld, distances);
+	
 	// Populations
-	old_pop = new g_Population(env, pop_size, baseWorld, seed);
-	new_pop = new g_Population(env, pop_size, baseWorld.num_cities, baseWorld.height, baseWorld.width);
-	
-	// Random numbers
-	cl::Buffer d_prob_select = cl::Buffer(env.context(), CL_MEM_READ_ONLY, sizeof(float) * 2 * pop_size);
-	cl::Buffer d_prob_cross = cl::Buffer(env.context(), CL_MEM_READ_ONLY, sizeof(float) * pop_size);
-	cl::Buffer d_prob_mutate = cl::Buffer(env.context(), CL_MEM_READ_ONLY, sizeof(float) * pop_size);
-	cl::Buffer d_cross_loc = cl::Buffer(env.context(), CL_MEM_READ_ONLY, sizeof(int) * pop_size);
-	cl::Buffer d_mutate_loc = cl::Buffer(env.context(), CL_MEM_READ_ONLY, sizeof(int) * 2 * pop_size);
-
+	tour_t* h_tours = new tour_t[pop_size * baseWorld.num_cities];
+	{
+		ThreadPool pool(options.num_threads);
+		seed_tours(h_tours, pop_size, baseWorld, seed,
+				   options.seeding, options.seed_random_fraction, pool);
+	}
+	old_pop = new g_Population(env, pop_size, baseWorld, table, h_tours);
+	delete[] h_tours;
+	new_pop = new g_Population(env, pop_size, baseWorld, table);
+	
+	// Host population to check the device evaluation against
+	Population* check_pop = nullptr;
+	float* check_values = nullptr;
+	if (options.verify) {
+		check_pop = new Population(pop_size, baseWorld, distances);
+		check_values = new float[2 * pop_size];
+	}
+	
+	// Breed each child in one pass when its tour fits in local memory, or with
+	// the separate crossover, mutation and fitness kernels otherwise
+	bool fused = options.fused && old_pop->breed_group_size() > 0;
+	
 	// Other parameters
-	cl::Buffer d_sel_ix = cl::Buffer(env.context(), CL_MEM_READ_WRITE, sizeof(int) * 2 * pop_size);
+	cl::Buffer d_sel_ix = env.pool().acquire<int>(2 * pop_size);
+	cl::Buffer d_visited = env.pool().acquire<cl_uint>(fused ? 1 : old_pop->visited_bytes() / sizeof(cl_uint) * pop_size);
 	
 	///////// GPU Initializations
 	
+	// The kernels draw the random numbers of every child from the same
+	// counter-based generator as the CPU, keyed by the seed, the generation
+	// and the child's slot, to ensure the results will match the CPU.
+	uint32_t rng_seed = static_cast<uint32_t>(seed);
+	
+	// Bind each population's kernels to the other once; a generation then
+	// only swaps the two
+	old_pop->bind(*new_pop, d_sel_ix, d_visited, rng_seed, prob_crossover, prob_mutation,
+				  options.selection, options.tournament_size);
+	new_pop->bind(*old_pop, d_sel_ix, d_visited, rng_seed, prob_crossover, prob_mutation,
+				  options.selection, options.tournament_size);
+	
 	// Calculate the fitnesses
 	old_pop->evaluate();
 	
+	// The leaders are read back without blocking, into one slot per
+	// generation in flight: the host logs the leader of generation i while
+	// the device computes the generations up to i + pipeline_depth - 1
+	int depth = options.pipeline_depth;
+	std::vector<g_Leader*> leaders(depth);
+	for (int d = 0; d < depth; d++)
+		leaders[d] = new g_Leader(env, baseWorld);
+	old_pop->read_leader(*leaders[0]);
+	
 	// Initialize the best leader
-	old_pop->select_leader(generation_leader, best_leader);
-	print_status(generation_leader, best_leader, 0);
-	gen_log.write_log(0, 0, generation_leader);
+	leaders[0]->select(best, distances);
+	print_status(leaders[0]->fitness(), best.fitness, 0);
+	gen_log.write_log(0, 0, leaders[0]->fitness(), leaders[0]->tour(), baseWorld.cities, baseWorld.num_cities);
 	
-	// Continue through all generations
-	for (int i = 0; i < max_gen; i++)
-	{
-		// Start the generation clock
-		gen_clock = clock();
-		
-		// Generate all probabilities for each step
-		//
-		// The order the random numbers are generated must be consistent to
-		// ensure the results will match the CPU.
-		for (int j = 0; j < pop_size; j++)
+	// Device time of the phases, for the stats and the timeline of the
+	// pipeline, if asked for
+	DevicePhases* device_phases = profiling ? new DevicePhases(env, depth) : nullptr;
+	PipelineTrace* trace = options.timeline != nullptr ? new PipelineTrace(env) : nullptr;
+	
+	// Logs a generation's leader once read back. The time of a generation
+	// runs from the previous leader being logged to its own, which is the
+	// rate the pipeline sustains.
+	gen_clock = wall_clock::now();
+	auto log_leader = [&](int generation) {
+		g_Leader& leader = *leaders[generation % depth];
+		double start = trace != nullptr ? trace->now() : 0.0;
+		{
+			ScopedPhase timer(phases, phase_t::leader);
+			if (leader.select(best, distances) == 1)
+				best_generation = generation;
+		}
 		{
-			prob_select[2*j] = rgen();
-			prob_select[2*j + 1] = rgen();
-			prob_cross[j] = rgen();
-			prob_mutate[j] = rgen();
-			
-			cross_loc[j] = static_cast<int>(rgen() * (baseWorld.num_cities - 1));
-			
-			int mut_loc_0 = static_cast<int>(rgen() * (baseWorld.num_cities));
-			int mut_loc_1 = static_cast<int>(rgen() * (baseWorld.num_cities));
-			while (mut_loc_1 == mut_loc_0) {
-				mut_loc_1 = static_cast<int>(rgen() * baseWorld.num_cities);
-			}
-			mutate_loc[2*j]      = mut_loc_0;
-			mutate_loc[2*j + 1]  = mut_loc_1;
+			ScopedPhase timer(phases, phase_t::log);
+			print_status(leader.fitness(), best.fitness, generation);
+			float gen_time = end_clock(gen_clock);
+			gen_log.write_log(generation, gen_time, leader.fitness(), leader.tour(),
+							  baseWorld.cities, baseWorld.num_cities);
+			gen_clock = wall_clock::now();
+			if (options.stats != nullptr)
+				options.stats->generations.push_back({ gen_time, best.distance });
 		}
 		
-		// Copy random numbers to device
-		env.queue().enqueueWriteBuffer(d_prob_select, CL_FALSE, 0, 2*pop_size*sizeof(float), prob_select);
-		env.queue().enqueueWriteBuffer(d_prob_cross, CL_FALSE, 0, pop_size*sizeof(float), prob_cross);
-		env.queue().enqueueWriteBuffer(d_prob_mutate, CL_FALSE, 0, pop_size*sizeof(float), prob_mutate);
-		env.queue().enqueueWriteBuffer(d_cross_loc, CL_FALSE, 0, pop_size*sizeof(int), cross_loc);
-		env.queue().enqueueWriteBuffer(d_mutate_loc, CL_FALSE, 0, 2*pop_size*sizeof(int), mutate_loc);
+		if (phases != nullptr)
+			device_phases->collect(generation, leader, *phases);
+		if (trace != nullptr) {
+			trace->host(generation, "host log", start);
+			trace->device(generation, "device compute", device_phases->start_event(generation),
+						  leader.gather_event());
+			trace->device(generation, "device read back", leader.first_read_event(), leader.last_read_event());
+		}
+	};
+	
+	// Continue through all generations
+	for (int i = 0; i < max_gen; i++)
+	{
+		int generation = i + 1;
+		double start = trace != nullptr ? trace->now() : 0.0;
+		auto mark = [&](phase_t phase) {
+			if (device_phases != nullptr)
+				device_phases->mark(generation, phase);
+		};
+		if (device_phases != nullptr)
+			device_phases->start(generation);
 		
 		// Select the parents
-		old_pop->select_parents(d_sel_ix, d_prob_select);
+		old_pop->select_parents(generation);
+		mark(phase_t::select);
 		
 		// Create the children (form the new population entirely on the GPU!)
-		old_pop->next_generation(*new_pop,
-								 d_sel_ix,
-								 prob_crossover, d_prob_cross, d_cross_loc,
-								 prob_mutation, d_prob_mutate, d_mutate_loc);
+		// and calculate their fitnesses
+		if (fused) {
+			old_pop->breed(generation);
+			mark(phase_t::breed);
+		} else {
+			old_pop->crossover(generation);
+			mark(phase_t::crossover);
+			old_pop->mutate(generation);
+			mark(phase_t::mutate);
+			new_pop->calc_fitness();
+			mark(phase_t::evaluate);
+		}
 		
-		// Calculate the fitnesses on the new population
-		new_pop->evaluate();
+		// Carry the fittest parents over, then compute the probabilities
+		if (options.num_elites > 0) {
+			old_pop->preserve_elites(options.num_elites);
+			mark(phase_t::elites);
+		}
+		new_pop->calc_fit_prob();
+		mark(phase_t::evaluate);
+		
+		if (check_pop != nullptr) {
+			int mismatches = verify_evaluation(*new_pop, *check_pop, check_values, env.hasExactDivide());
+			if (mismatches > 0)
+				std::cerr << "Generation " << generation << ": " << mismatches
+						  << " device fitness values differ from the CPU's" << std::endl;
+		}
 		
 		// Swap the populations
 		std::swap(old_pop, new_pop);
 		
-		// Select the new leaders
-		sel = old_pop->select_leader(generation_leader, best_leader);
-		if (sel == 1)
-		{
-			best_generation = i + 1;
-		}
-		print_status(generation_leader, best_leader, i + 1);
-		gen_log.write_log(i + 1, end_clock(gen_clock), generation_leader);
+		// Start reading the new leader back
+		old_pop->read_leader(*leaders[generation % depth]);
+		if (trace != nullptr)
+			trace->host(generation, "host enqueue", start);
+		
+		// Log the oldest generation in flight once the pipeline is full,
+		// which frees its slot for the next one
+		if (generation - depth + 1 >= 1)
+			log_leader(generation - depth + 1);
 	} // Generations
 	
+	// Drain the pipeline
+	for (int generation = std::max(1, max_gen - depth + 2); generation <= max_gen; generation++)
+		log_leader(generation);
+	
+	if (trace != nullptr) {
+		trace->write(options.timeline);
+		delete trace;
+	}
+	delete device_phases;
+	for (g_Leader* leader : leaders)
+		delete leader;
+	
 	std::cout
 		<< std::endl
 		<< "Best generation found at " << best_generation << " generations"
 		<< std::endl;
+	distances.print_stats();
 	
 	// Cleanup and success!
 	delete old_pop;
 	delete new_pop;
-	delete[] prob_select; delete[] prob_cross; delete[] prob_mutate;
-	delete[] cross_loc; delete[] mutate_loc;
+	env.pool().release(d_sel_ix);
+	env.pool().release(d_visited);
+	delete check_pop;
+	delete[] check_values;
+}
+
+void g_execute(int pop_size,
+			   int max_gen,
+			   float prob_mutation, float prob_crossover,
+			   const World& baseWorld,
+			   Logger& gen_log,
+			   int seed,
+			   const GAOptions& options,
+			   const opencl_env* env)
+{
+	if (!options.valid(pop_size))
+		return;
+	
+	if (env != nullptr) {
+		run(pop_size, max_gen, prob_mutation, prob_crossover, baseWorld, gen_log, seed, options, *env);
+	} else {
+		opencl_env* own_env = g_create_env(options);
+		run(pop_size, max_gen, prob_mutation, prob_crossover, baseWorld, gen_log, seed, options, *own_env);
+		delete own_env;
+	}
 }
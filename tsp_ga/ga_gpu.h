@@ -14,7 +14,16 @@
 
 // Program includes
 #include "world.h"
+#include "options.h"
 #include "log.h"
+#include "g_type.h"
+
+/*
+	Sets up the OpenCL device of options.device, with profiling queues if
+	options.profile or options.timeline asks for them. Runs on the same
+	environment share its program, kernels and buffer pool.
+*/
+opencl_env* g_create_env(const GAOptions& options);
 
 /*
 	Runs the genetic algorithm on the GPU.
@@ -26,12 +35,18 @@
 	baseWorld      : The seed world, containing all of the desired cities
 	gen_log        : A pointer a logger to be used for logging the generation statistics
 	seed           : Seed for all random numbers
+	options        : Engine settings, such as the selection method
+	env            : Device to run on, from g_create_env(), so that its buffers
+	                 serve the runs after this one; if null, the run sets up
+	                 and tears down a device of its own
 */
 void g_execute(int pop_size,
 			   int max_gen,
 			   float prob_mutation, float prob_crossover,
 			   const World& baseWorld,
 			   Logger& gen_log,
-			   int seed);
+			   int seed,
+			   const GAOptions& options = GAOptions(),
+			   const opencl_env* env = nullptr);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,113 @@
+//
+//  heap_count.cpp
+//  tsp_ga
+//
+
+#include "heap_count.h"
+
+#ifdef TSP_GA_COUNT_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+
+// A plain counter: it needs no construction, so it is safe to use from the
+// first allocation of a thread to its last
+static thread_local size_t thread_count = 0;
+
+static void* counted_alloc(std::size_t size, std::size_t align)
+{
+	thread_count++;
+	if (size == 0)
+		size = 1;
+	if (align <= alignof(std::max_align_t))
+		return std::malloc(size);
+	void* p = nullptr;
+	if (align < sizeof(void*))
+		align = sizeof(void*);
+	return posix_memalign(&p, align, size) == 0 ? p : nullptr;
+}
+
+static void* counted_new(std::size_t size, std::size_t align)
+{
+	void* p = counted_alloc(size, align);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(std::size_t size)
+{
+	return counted_new(size, 0);
+}
+
+void* operator new[](std::size_t size)
+{
+	return counted_new(size, 0);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return counted_alloc(size, 0);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return counted_alloc(size, 0);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+// The over-aligned forms, from C++17
+#ifdef __cpp_aligned_new
+void* operator new(std::size_t size, std::align_val_t align)
+{
+	return counted_new(size, static_cast<std::size_t>(align));
+}
+
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+	return counted_new(size, static_cast<std::size_t>(align));
+}
+
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+	return counted_alloc(size, static_cast<std::size_t>(align));
+}
+
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+	return counted_alloc(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+#endif
+
+bool heap_allocations_counted()
+{
+	return true;
+}
+
+size_t thread_heap_allocations()
+{
+	return thread_count;
+}
+
+#else
+
+bool heap_allocations_counted()
+{
+	return false;
+}
+
+size_t thread_heap_allocations()
+{
+	return 0;
+}
+
+#endif
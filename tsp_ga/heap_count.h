@@ -0,0 +1,31 @@
+//
+//  heap_count.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__heap_count__
+#define __tsp_ga__heap_count__
+
+#include <cstddef>
+
+/*
+ Heap allocation counting, for checking that the generation loops do not
+ allocate. Built with TSP_GA_COUNT_ALLOCATIONS, heap_count.cpp replaces the
+ global operator new and delete with ones that count every allocation made
+ through them, per thread. That covers new, the standard containers and the
+ scratch arenas, but not direct calls of malloc.
+ 
+ Without TSP_GA_COUNT_ALLOCATIONS nothing is replaced and every count is 0.
+ */
+
+/*
+ Whether allocations are counted in this build
+ */
+bool heap_allocations_counted();
+
+/*
+ Allocations made so far by the calling thread
+ */
+size_t thread_heap_allocations();
+
+#endif /* defined(__tsp_ga__heap_count__) */
@@ -0,0 +1,404 @@
+//
+//  islands.cpp
+//  tsp_ga
+//
+
+#include "islands.h"
+
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <cassert>
+
+#include "ga_cpu.h"
+#include "population.h"
+#include "migration.h"
+#include "seeding.h"
+#include "rng.h"
+#include "heap_count.h"
+
+using namespace std;
+
+// Batches a link holds before the sending island drops its migrants
+static const int link_capacity = 4;
+
+/*
+ State of one island, owned by its thread while it runs
+ */
+struct Island
+{
+	int index;
+	uint32_t seed;					// Seed of the island's random numbers
+	int size;						// Individuals of the island
+	vector<MigrantQueue*> outbox;	// Links to the islands migrants go to
+	vector<MigrantQueue*> inbox;	// Links migrants come from
+	MigrantQueue* exports;			// Link out of the process, sent every migration
+
+	// Counters
+	int sent, dropped, received, mismatches;
+	size_t allocations;
+};
+
+/*
+ The best tour found so far by any island, and how far the islands got,
+ shared by their threads and the thread logging the run
+ */
+struct RunningBest
+{
+	mutex lock;
+	condition_variable progress;	// Signaled when every island finished a generation
+	vector<tour_t> tour;
+	float fitness;
+	int length;						// Its squared length
+	int generation;					// Generation it was found at
+	vector<int> completed;			// Islands done with every generation
+	vector<float> gen_times;		// Time the slowest of them spent on it
+};
+
+/*
+ Islands every island sends migrants to. With the random topology these are
+ all the other islands, and every migration picks one of them.
+ */
+static vector<vector<int>> topology_links(topology_t topology, int num_islands)
+{
+	vector<vector<int>> links(num_islands);
+	if (num_islands < 2)
+		return links;
+
+	// Most square grid for the torus
+	int rows = 1;
+	for (int r = 1; r * r <= num_islands; r++)
+		if (num_islands % r == 0)
+			rows = r;
+	int cols = num_islands / rows;
+
+	for (int i = 0; i < num_islands; i++) {
+		if (topology == topology_t::ring) {
+			links[i].push_back((i + 1) % num_islands);
+		} else if (topology == topology_t::torus) {
+			int r = i / cols, c = i % cols;
+			int next[4] = {
+				r * cols + (c + 1) % cols,
+				r * cols + (c + cols - 1) % cols,
+				((r + 1) % rows) * cols + c,
+				((r + rows - 1) % rows) * cols + c
+			};
+			for (int j : next)
+				if (j != i && find(links[i].begin(), links[i].end(), j) == links[i].end())
+					links[i].push_back(j);
+		} else {
+			for (int j = 0; j < num_islands; j++)
+				if (j != i)
+					links[i].push_back(j);
+		}
+	}
+	return links;
+}
+
+/*
+ Orders the first count entries of order as the count least fit (or
+ fittest) individuals of a population, ties going to the lower index
+ */
+static void rank_individuals(const Population& pop, int* order, int count, bool fittest)
+{
+	if (fittest) {
+		pop.top_k(count, order);
+		return;
+	}
+	iota(order, order + pop.numIndividuals, 0);
+	const float* fitness = pop.fitness;
+	auto less_fit = [fitness](int a, int b) {
+		return fitness[a] < fitness[b] || (fitness[a] == fitness[b] && a < b);
+	};
+	nth_element(order, order + count, order + pop.numIndividuals, less_fit);
+}
+
+/*
+ Replaces the least fit individuals by the migrants waiting on the island's
+ links
+ */
+static void receive_migrants(Island& island, Population& pop, int* order)
+{
+	int n = pop.numCitiesPerWorld;
+	for (MigrantQueue* link : island.inbox) {
+		while (const MigrantBatch* batch = link->front()) {
+			int count = min(batch->count, pop.numIndividuals);
+			rank_individuals(pop, order, count, false);
+			for (int k = 0; k < count; k++) {
+				pop.SetTour(order[k], &batch->tours[static_cast<size_t>(k) * n]);
+				pop.SetLength(order[k], batch->lengths[k]);
+			}
+			link->release();
+			island.received += count;
+		}
+	}
+}
+
+/*
+ Copies the first count individuals of order into a batch of the link, or
+ drops them if the link is full
+ */
+static void publish_migrants(Island& island, MigrantQueue* link, const Population& pop,
+							 const int* order, int count, int generation)
+{
+	int n = pop.numCitiesPerWorld;
+	MigrantBatch* batch = link->slot();
+	if (batch == nullptr) {
+		island.dropped += count;
+		return;
+	}
+	for (int k = 0; k < count; k++) {
+		memcpy(&batch->tours[static_cast<size_t>(k) * n], pop.GetTour(order[k]), n * sizeof(tour_t));
+		batch->lengths[k] = pop.lengths[order[k]];
+	}
+	batch->count = count;
+	batch->generation = generation;
+	link->publish();
+	island.sent += count;
+}
+
+/*
+ Sends copies of the fittest individuals along the island's links, and out
+ of the process if the island exports
+ */
+static void send_migrants(Island& island, const Population& pop, int generation,
+						  const GAOptions& options, int* order)
+{
+	if (island.outbox.empty() && island.exports == nullptr)
+		return;
+
+	int count = min(options.migration_size, pop.numIndividuals);
+	rank_individuals(pop, order, count, true);
+
+	size_t first = 0, last = island.outbox.size();
+	if (options.topology == topology_t::random && last > 0) {
+		philox_block r = philox4x32(island.seed, static_cast<uint32_t>(rng_stream::migration),
+									island.index, generation, 1, 0);
+		first = rng_below(r.v[0], static_cast<int>(last));
+		last = first + 1;
+	}
+
+	for (size_t l = first; l < last; l++)
+		publish_migrants(island, island.outbox[l], pop, order, count, generation);
+	
+	// The other processes get every migration, whatever the topology picked
+	if (island.exports != nullptr)
+		publish_migrants(island, island.exports, pop, order, count, generation);
+}
+
+/*
+ Reports an island's generation: its fittest individual replaces the running
+ best if fitter, and the generation is complete once every island reported it
+ */
+static void report_leader(RunningBest& best, int num_islands, const Population& pop,
+						  int generation, float gen_time)
+{
+	int ix = static_cast<int>(max_element(pop.fitness, pop.fitness + pop.numIndividuals) - pop.fitness);
+	
+	lock_guard<mutex> hold(best.lock);
+	if (pop.fitness[ix] > best.fitness) {
+		memcpy(best.tour.data(), pop.GetTour(ix), pop.numCitiesPerWorld * sizeof(tour_t));
+		best.fitness = pop.fitness[ix];
+		best.length = pop.lengths[ix];
+		best.generation = generation;
+	}
+	best.gen_times[generation] = max(best.gen_times[generation], gen_time);
+	if (++best.completed[generation] == num_islands)
+		best.progress.notify_one();
+}
+
+/*
+ Evolves one island for all generations, on the calling thread
+ */
+static void run_island(Island& island, int max_gen, float prob_mutation, float prob_crossover,
+					   const World& baseWorld, const DistanceTable& distances,
+					   const NeighborLists* neighbors, const GAOptions& options,
+					   RunningBest& best, int num_islands)
+{
+	ThreadPool pool(1);
+	ScratchArena arena;
+	arena.reserve(breed_scratch_bytes(baseWorld.num_cities, options));
+
+	Population* oldPop = new Population(island.size, baseWorld, distances);
+	Population* newPop = new Population(island.size, baseWorld, distances);
+	seed_tours(oldPop->tours, island.size, baseWorld, island.seed,
+			   options.seeding, options.seed_random_fraction, pool);
+	evaluate(*oldPop);
+
+	AliasTable* alias = nullptr;
+	if (options.selection == selection_t::alias)
+		alias = new AliasTable(island.size);
+
+	int* order = new int[island.size];
+	report_leader(best, num_islands, *oldPop, 0, 0.0f);
+
+	for (int g = 1; g <= max_gen; g++) {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		size_t heap_allocations = thread_heap_allocations();
+
+		if (alias != nullptr)
+			alias->build(*oldPop);
+		std::atomic<int> mismatches(0);
+		breed(*oldPop, *newPop, g, prob_mutation, prob_crossover, island.seed, options, alias,
+			  neighbors, pool, &arena, mismatches);
+		if (options.num_elites > 0)
+			preserve_elites(*oldPop, *newPop, min(options.num_elites, island.size), arena);
+		if (options.improve_leader)
+			improve_leader(*newPop, *neighbors, options, arena);
+		island.mismatches += mismatches;
+
+		receive_migrants(island, *newPop, order);
+		if (g % options.migration_interval == 0)
+			send_migrants(island, *newPop, g, options, order);
+
+		calc_fit_prob(*newPop);
+		swap(oldPop, newPop);
+
+		chrono::duration<float, milli> elapsed = chrono::steady_clock::now() - start;
+		report_leader(best, num_islands, *oldPop, g, elapsed.count());
+		
+		// Only the first generation may allocate, while the arena grows
+		size_t gen_allocations = thread_heap_allocations() - heap_allocations;
+		assert(g == 1 || gen_allocations == 0);
+		island.allocations += gen_allocations;
+	}
+
+	delete[] order;
+	delete alias;
+	delete oldPop; delete newPop;
+}
+
+void execute_islands(int pop_size,
+					 int max_gen,
+					 float prob_mutation, float prob_crossover,
+					 const World& baseWorld,
+					 Logger& gen_log,
+					 int seed,
+					 const GAOptions& options,
+					 IslandPort* port)
+{
+	if (!options.valid(pop_size))
+		return;
+
+	int n = baseWorld.num_cities;
+	int num_islands = max(1, min(options.num_islands, pop_size));
+
+	// Shared, read-only data
+	DistanceTable distances(baseWorld, options.distance_budget, options.distance_stats,
+							 options.distance_cache);
+	NeighborLists* neighbors = nullptr;
+	if (options.improve_prob > 0.0f || options.improve_leader)
+		neighbors = new NeighborLists(baseWorld, options.improve_neighbors);
+
+	// The islands; the first one breeds with the run's seed, so a single
+	// island breeds exactly like execute()
+	vector<Island> islands(num_islands);
+	for (int i = 0; i < num_islands; i++) {
+		Island& island = islands[i];
+		island.index = i;
+		island.seed = i == 0 ? static_cast<uint32_t>(seed)
+			: philox4x32(seed, static_cast<uint32_t>(rng_stream::migration), i, 0, 0, 0).v[0];
+		island.size = static_cast<int>(static_cast<long long>(pop_size) * (i + 1) / num_islands
+									 - static_cast<long long>(pop_size) * i / num_islands);
+		island.sent = island.dropped = island.received = island.mismatches = 0;
+		island.allocations = 0;
+		island.exports = nullptr;
+	}
+
+	// One queue per link
+	vector<vector<int>> links = topology_links(options.topology, num_islands);
+	vector<MigrantQueue*> queues;
+	for (int i = 0; i < num_islands; i++) {
+		for (int j : links[i]) {
+			MigrantQueue* queue = new MigrantQueue(link_capacity, options.migration_size, n);
+			queues.push_back(queue);
+			islands[i].outbox.push_back(queue);
+			islands[j].inbox.push_back(queue);
+		}
+	}
+	if (port != nullptr)
+		islands[0].exports = port->exports;
+	if (port != nullptr && port->imports != nullptr)
+		islands[0].inbox.push_back(port->imports);
+
+	// Nothing found yet, no generation done
+	RunningBest running;
+	running.tour.resize(n);
+	running.fitness = -1.0f;
+	running.length = 0;
+	running.generation = 0;
+	running.completed.resize(max_gen + 1);
+	running.gen_times.resize(max_gen + 1);
+
+	// One thread per island; they only meet through the queues
+	vector<thread> threads;
+	for (int i = 0; i < num_islands; i++)
+		threads.push_back(thread([&, i]() {
+			run_island(islands[i], max_gen, prob_mutation, prob_crossover,
+					   baseWorld, distances, neighbors, options, running, num_islands);
+		}));
+
+	// Log the running best as every generation completes
+	int best_generation = 0;
+	float best_fitness;
+	vector<tour_t> tour(n);
+	vector<GenerationSample> samples;
+	samples.reserve(max_gen);
+	for (int g = 0; g <= max_gen; g++) {
+		float gen_time;
+		{
+			unique_lock<mutex> hold(running.lock);
+			running.progress.wait(hold, [&]() { return running.completed[g] == num_islands; });
+			copy(running.tour.begin(), running.tour.end(), tour.begin());
+			best_fitness = running.fitness;
+			best_generation = running.generation;
+			gen_time = running.gen_times[g];
+		}
+
+		print_status(best_fitness, best_fitness, g);
+		gen_log.write_log(g, gen_time, best_fitness, tour.data(), baseWorld.cities, n);
+		if (g > 0)
+			samples.push_back({ gen_time, distances.tour_distance(tour.data(), n) });
+	}
+	for (thread& t : threads)
+		t.join();
+
+	if (port != nullptr) {
+		memcpy(port->best_tour, running.tour.data(), n * sizeof(tour_t));
+		port->best_length = running.length;
+		port->best_generation = running.generation;
+	}
+
+	int sent = 0, dropped = 0, received = 0;
+	size_t allocations = 0;
+	for (const Island& island : islands) {
+		sent += island.sent;
+		dropped += island.dropped;
+		received += island.received;
+		allocations += island.allocations;
+		if (island.mismatches > 0)
+			cerr << "Island " << island.index << ": " << island.mismatches
+				 << " incremental fitness values differ from a full evaluation" << endl;
+	}
+	if (options.stats != nullptr) {
+		*options.stats = RunStats();
+		options.stats->allocations = allocations;
+		options.stats->generations.swap(samples);
+	}
+
+	for (MigrantQueue* queue : queues)
+		delete queue;
+	delete neighbors;
+
+	cout << endl
+		 << "Best generation found at " << best_generation << " generations" << endl
+		 << num_islands << " islands: " << sent << " migrants sent, " << dropped
+		 << " dropped, " << received << " received" << endl;
+	distances.print_stats();
+}
@@ -0,0 +1,64 @@
+//
+//  islands.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__islands__
+#define __tsp_ga__islands__
+
+#include "world.h"
+#include "options.h"
+#include "log.h"
+#include "migration.h"
+
+/*
+ Connects an island run to migrants from outside the process (cluster.h)
+ */
+struct IslandPort
+{
+	MigrantQueue* exports;	// Island 0 also sends every migration here, if not null
+	MigrantQueue* imports;	// Island 0 also receives migrants from here, if not null
+	tour_t* best_tour;		// Set to the best tour of the run, num_cities entries
+	int best_length;		// Set to its squared length
+	int best_generation;	// Set to the generation it was found at
+};
+
+/*
+ Runs the genetic algorithm as an island model on the CPU.
+
+ The population is split into options.num_islands sub-populations, each
+ breeding on its own thread with its own random numbers. Every
+ options.migration_interval generations an island sends copies of its
+ options.migration_size fittest individuals along its links of
+ options.topology, and it replaces its least fit individuals by the migrants
+ it received whenever it finds some. The links are lock-free queues and the
+ islands never wait for each other, so which migrants arrive when depends on
+ the timing of the threads, and runs are not reproducible the way execute()
+ runs are.
+
+ The islands report the fittest individual of every generation, which
+ replaces the run's best if fitter. Each time every island has finished a
+ generation, the calling thread logs that generation with the best tour
+ found so far, which faster islands may have found in later generations,
+ and the time the slowest island spent on it.
+
+ pop_size       : The number of individuals across all islands
+ max_gen        : The number of generations every island runs for
+ prob_mutation  : The probability of a mutation occurring
+ prob_crossover : The probability of a crossover occurring
+ baseWorld      : The seed world, containing all of the desired cities
+ gen_log        : Logger for the generation statistics
+ seed           : Seed for all random numbers
+ options        : Engine settings, including the island model's
+ port           : Links to other processes, or null
+ */
+void execute_islands(int pop_size,
+					 int max_gen,
+					 float prob_mutation, float prob_crossover,
+					 const World& baseWorld,
+					 Logger& gen_log,
+					 int seed,
+					 const GAOptions& options = GAOptions(),
+					 IslandPort* port = nullptr);
+
+#endif /* defined(__tsp_ga__islands__) */
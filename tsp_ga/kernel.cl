@@ -1,14 +1,45 @@
 //  Copyright (c) 2014 James Mnatzaganian
 //  Copyright (c) 2015 waz
 
+//
+// Tours are permutations of indices into the city coordinate table. The host
+// passes the element type matching its own tour_t.
+//
+#ifndef TOUR_T
+#define TOUR_T ushort
+#endif
+typedef TOUR_T tour_t;
+
+//
+// Squared distance between two cities, read from the dense distance table
+// when there is one (dist_stride > 0)
+//
+inline int edge_cost(__global const int2* cities,
+					 __global const int* dist,
+					 int dist_stride,
+					 tour_t a,
+					 tour_t b)
+{
+	if (dist_stride > 0)
+		return dist[a * dist_stride + b];
+	
+	int2 ca = cities[a];
+	int2 cb = cities[b];
+	int dx = ca.x - cb.x;
+	int dy = ca.y - cb.y;
+	return dx*dx + dy*dy;
+}
+
 //
 // Evaluates the fitness function
 //
 __kernel void fitness(int pop_len,
 					  int num_cities,
 					  int WxH,
-					  __global int* x_coord,
-					  __global int* y_coord,
+					  __global const int2* cities,
+					  __global const int* dist,
+					  int dist_stride,
+					  __global const tour_t* tours,
 					  __global float* fitness)
 {
 	int tid = get_global_id(0);
@@ -19,9 +50,8 @@ __kernel void fitness(int pop_len,
 		// Calculate fitnesses
 		int baseOffset = tid * num_cities;
 		for (int i = 0; i < num_cities-1; i++) {
-			int dx = x_coord[baseOffset + i] - x_coord[baseOffset + i + 1];
-			int dy = y_coord[baseOffset + i] - y_coord[baseOffset + i + 1];
-			distance += dx*dx + dy*dy;
+			distance += edge_cost(cities, dist, dist_stride,
+								  tours[baseOffset + i], tours[baseOffset + i + 1]);
 		}
 		
 		fitness[tid] = (float)WxH / (float)distance;
@@ -29,163 +59,429 @@ __kernel void fitness(int pop_len,
 }
 
 //
-// Calculation of fitness probabilities
-// Step 1: Calculate the partial sums of fitness values
+// Calculation of fitness probabilities: work-efficient inclusive prefix sum
+// (Blelloch). Must perform the same additions in the same order as scan()
+// in scan.cpp, so the CPU gets bit-identical probabilities when the program
+// is built with correctly rounded divisions (see opencl_env).
+//
+// Step 1: Scan blocks of 2 * get_local_size(0) elements with an up-sweep /
+//         down-sweep tree, writing every block's total to block_sums. With a
+//         single block the result is also divided by the total.
 //
-__kernel void fit_sum(int pop_len,
-					  __global float* fitness,
-					  __global float* fit_prob,
-					  __global float* accumFit)
+__kernel void scan_block(int n,
+						 __global const float* in,
+						 __global float* out,
+						 __global float* block_sums,
+						 int normalize,
+						 __local float* temp)
 {
-	int tid = get_global_id(0);
+	int lid = get_local_id(0);
+	int block = 2 * get_local_size(0);
+	int base = get_group_id(0) * block;
+	int i0 = base + lid;
+	int i1 = base + lid + block / 2;
 	
-	if (tid < pop_len) {
-		// Sum of all fitness
-		float sum = 0.0f;
-			
-		// Calculate the partial sum
-		for (int i = 0; i <= tid; i++)
-			sum += fitness[i];
-		fit_prob[tid] = sum;
-		
-		// Copy over the final result
-		if (tid == (pop_len - 1))
-			*accumFit = sum;
+	float x0 = i0 < n ? in[i0] : 0.0f;
+	float x1 = i1 < n ? in[i1] : 0.0f;
+	temp[lid] = x0;
+	temp[lid + block / 2] = x1;
+	
+	// Up-sweep
+	int offset = 1;
+	for (int d = block >> 1; d > 0; d >>= 1) {
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (lid < d) {
+			int ai = offset * (2*lid + 1) - 1;
+			int bi = offset * (2*lid + 2) - 1;
+			temp[bi] += temp[ai];
+		}
+		offset *= 2;
 	}
+	
+	// Down-sweep, giving the exclusive scan; the total goes to temp[block]
+	barrier(CLK_LOCAL_MEM_FENCE);
+	if (lid == 0)
+		temp[block - 1] = 0.0f;
+	for (int d = 1; d < block; d *= 2) {
+		offset >>= 1;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (lid < d) {
+			int ai = offset * (2*lid + 1) - 1;
+			int bi = offset * (2*lid + 2) - 1;
+			float tmp = temp[ai];
+			temp[ai] = temp[bi];
+			temp[bi] += tmp;
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+	if (lid == block / 2 - 1)
+		temp[block] = temp[block - 1] + x1;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	
+	float total = temp[block];
+	float v0 = temp[lid] + x0;
+	float v1 = temp[lid + block / 2] + x1;
+	if (normalize) {
+		v0 = v0 / total;
+		v1 = v1 / total;
+	}
+	if (i0 < n)
+		out[i0] = v0;
+	if (i1 < n)
+		out[i1] = v1;
+	if (lid == 0)
+		block_sums[get_group_id(0)] = total;
 }
 
 //
 // Calculation of fitness probabilities
-// Step 2: Divide the sum of the previous kernel between the total sum of
-//         fitness values
+// Step 2: Add the scanned totals of the previous blocks to every block,
+//         dividing by the grand total if requested
 //
-__kernel void fit_prob(int pop_len,
-					   __global float* fit_prob,
-					   float fit_sum)
+__kernel void scan_add(int n,
+					   __global float* data,
+					   __global const float* block_sums,
+					   int num_blocks,
+					   int normalize)
 {
-	int tid = get_global_id(0);
-	if (tid < pop_len) {
-		fit_prob[tid] /= fit_sum;
+	int lid = get_local_id(0);
+	int group = get_group_id(0);
+	int block = 2 * get_local_size(0);
+	float offset = group > 0 ? block_sums[group - 1] : 0.0f;
+	float total = block_sums[num_blocks - 1];
+	
+	for (int k = 0; k < 2; k++) {
+		int i = group * block + lid + k * block / 2;
+		if (i < n) {
+			float v = data[i] + offset;
+			data[i] = normalize ? v / total : v;
+		}
 	}
 }
 
 //
-// Finds the maximum fitness value
-// Step 1
+// Most elites the top-k reduction keeps per work-item; max_elites in
+// population.h
 //
-__kernel void max_fit_phase_0(int pop_len,
-							  __global float* fitness,
-							  __local float* scratch_val,
-							  __local int* scratch_inx,
-							  __global float* result_val,
-							  __global int* result_inx)
+#define MAX_ELITES 16
+
+//
+// Ordering of the top-k reduction: higher fitness first, ties going to the
+// lower index, like Population::top_k
+//
+inline bool fitter(float a_val, int a_inx, float b_val, int b_inx)
 {
-	int ginx = get_global_id(0);
-	int max_index;
-	float accumulator = -INFINITY;
-	
-	while (ginx < pop_len)	{
-		float element = fitness[ginx];
-		if (element > accumulator) {
-			accumulator = element;
-			max_index = ginx;
-		}
-		ginx += get_global_size(0);
+	return a_val > b_val || (a_val == b_val && a_inx < b_inx);
+}
+
+//
+// Adds a candidate to a work-item's list of its k fittest, fittest first
+//
+inline void keep_fittest(float val, int inx, int k, float* best_val, int* best_inx, int* count)
+{
+	if (*count == k && !fitter(val, inx, best_val[k - 1], best_inx[k - 1]))
+		return;
+	int j = *count < k ? (*count)++ : k - 1;
+	while (j > 0 && fitter(val, inx, best_val[j - 1], best_inx[j - 1])) {
+		best_val[j] = best_val[j - 1];
+		best_inx[j] = best_inx[j - 1];
+		j--;
 	}
-	
+	best_val[j] = val;
+	best_inx[j] = inx;
+}
+
+//
+// Merges the lists of the work-items of a group into result_val/inx[0, k),
+// fittest first. One reduction per rank: the fittest head of the lists wins
+// and its work-item moves on to its next candidate.
+//
+inline void merge_fittest(int k,
+						  const float* best_val,
+						  const int* best_inx,
+						  int count,
+						  __local float* scratch_val,
+						  __local int* scratch_inx,
+						  __global float* result_val,
+						  __global int* result_inx)
+{
 	int linx = get_local_id(0);
-	scratch_val[linx] = accumulator;
-	scratch_inx[linx] = max_index;
-	barrier(CLK_LOCAL_MEM_FENCE);
-	
-	// Apply reduction
-	for (int offset = get_local_size(0) / 2;
-		 offset > 0;
-		 offset /= 2)
-	{
-		if (linx < offset) {
-			float other = scratch_val[linx + offset];
-			float mine = scratch_val[linx];
-			if (other > mine) {
-				scratch_val[linx] = other;
+	int head = 0;
+	for (int rank = 0; rank < k; rank++) {
+		scratch_val[linx] = head < count ? best_val[head] : -INFINITY;
+		scratch_inx[linx] = head < count ? best_inx[head] : INT_MAX;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		
+		for (int offset = get_local_size(0) / 2;
+			 offset > 0;
+			 offset /= 2)
+		{
+			if (linx < offset &&
+				fitter(scratch_val[linx + offset], scratch_inx[linx + offset],
+					   scratch_val[linx], scratch_inx[linx])) {
+				scratch_val[linx] = scratch_val[linx + offset];
 				scratch_inx[linx] = scratch_inx[linx + offset];
 			}
-			
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+		
+		int winner = scratch_inx[0];
+		if (head < count && best_inx[head] == winner)
+			head++;
+		if (linx == 0) {
+			result_val[rank] = scratch_val[0];
+			result_inx[rank] = winner;
 		}
 		barrier(CLK_LOCAL_MEM_FENCE);
 	}
-	if (linx == 0) {
-		int gid = get_group_id(0);
-		result_val[gid] = scratch_val[0];
-		result_inx[gid] = scratch_inx[0];
-	}
 }
 
 //
-// Finds the maximum fitness value
-// Step 2
-// Note: It assumes that 'length' is very small (and so doesn't incur into
-//       another reduction)
+// Finds the k fittest individuals
+// Step 1: every group writes its k fittest, fittest first, to
+// result_val/inx[group * k, group * k + k)
+//
+__kernel void max_fit_phase_0(int pop_len,
+							  int k,
+							  __global float* fitness,
+							  __local float* scratch_val,
+							  __local int* scratch_inx,
+							  __global float* result_val,
+							  __global int* result_inx)
+{
+	// The work-item's own k fittest
+	float best_val[MAX_ELITES];
+	int best_inx[MAX_ELITES];
+	int count = 0;
+	for (int ginx = get_global_id(0); ginx < pop_len; ginx += get_global_size(0))
+		keep_fittest(fitness[ginx], ginx, k, best_val, best_inx, &count);
+	
+	int offset = get_group_id(0) * k;
+	merge_fittest(k, best_val, best_inx, count, scratch_val, scratch_inx,
+				  &result_val[offset], &result_inx[offset]);
+}
+
+//
+// Finds the k fittest individuals
+// Step 2: a single group merges the groups' lists into result_inx[0, k),
+// fittest first, the same way
 //
 __kernel void max_fit_phase_1(int length,
+							  int k,
+							  __local float* scratch_val,
+							  __local int* scratch_inx,
 							  __global float* result_val,
 							  __global int* result_inx)
 {
-	int tid = get_global_id(0);
-	if (tid == 0) {
-		float maxval = result_val[0];
-		int maxinx = result_inx[0];
-		
-		for (int i = 1; i < length; i++) {
-			float x = result_val[i];
-			if (x > maxval) {
-				maxval = x;
-				maxinx = result_inx[i];
-			}
-		}
-		result_inx[0] = maxinx;
+	float best_val[MAX_ELITES];
+	int best_inx[MAX_ELITES];
+	int count = 0;
+	for (int i = get_local_id(0); i < length * k; i += get_local_size(0))
+		keep_fittest(result_val[i], result_inx[i], k, best_val, best_inx, &count);
+	
+	// Every candidate is read before the first barrier of the merge, and
+	// only then are the first k overwritten
+	merge_fittest(k, best_val, best_inx, count, scratch_val, scratch_inx, result_val, result_inx);
+}
+
+//
+// Copies the fittest individuals of the old population, found by
+// max_fit_phase_0/1, unchanged into the first slots of the new one
+//
+__kernel void copy_elites(int num_elites,
+						  int num_cities,
+						  __global const int* elite_inx,
+						  __global const tour_t* old_tours,
+						  __global const float* old_fitness,
+						  __global tour_t* new_tours,
+						  __global float* new_fitness)
+{
+	int gid = get_global_id(0);
+	if (gid >= num_elites * num_cities)
+		return;
+	
+	int e = gid / num_cities;
+	int c = gid % num_cities;
+	int src = elite_inx[e];
+	new_tours[e * num_cities + c] = old_tours[src * num_cities + c];
+	if (c == 0)
+		new_fitness[e] = old_fitness[src];
+}
+
+//
+// Copies the fittest individual, found by max_fit_phase_0/1 with k = 1, and
+// its fitness and probability into buffers of their own, so the host can
+// read the leader back without knowing its index
+//
+__kernel void gather_leader(int num_cities,
+							__global const int* top_inx,
+							__global const tour_t* tours,
+							__global const float* fitness,
+							__global const float* fit_prob,
+							__global tour_t* leader_tour,
+							__global float* leader_values)
+{
+	int c = get_global_id(0);
+	if (c >= num_cities)
+		return;
+	
+	int src = top_inx[0];
+	leader_tour[c] = tours[src * num_cities + c];
+	if (c == 0) {
+		leader_values[0] = fitness[src];
+		leader_values[1] = fit_prob[src];
 	}
 }
 
 //
-// Finds the indexes of the selected parents
+// Philox4x32-10 counter-based generator, identical to philox4x32 in rng.h
+//
+inline uint4 philox4x32(uint key0, uint key1, uint4 c)
+{
+	for (int round = 0; round < 10; round++) {
+		uint hi0 = mul_hi(0xD2511F53u, c.x), lo0 = 0xD2511F53u * c.x;
+		uint hi1 = mul_hi(0xCD9E8D57u, c.z), lo1 = 0xCD9E8D57u * c.z;
+		uint4 n;
+		n.x = hi1 ^ c.y ^ key0;
+		n.y = lo1;
+		n.z = hi0 ^ c.w ^ key1;
+		n.w = lo0;
+		c = n;
+		key0 += 0x9E3779B9u;
+		key1 += 0xBB67AE85u;
+	}
+	return c;
+}
+
+// Key of rng_stream::breed
+#define RNG_STREAM_BREED 0u
+
+//
+// One block of the random words of a child: blocks 0 and 1 hold the draws of
+// child_randoms, blocks 2 and 3 the words of selection_words (rng.h)
+//
+inline uint4 child_block(uint seed, int generation, int child, uint block)
+{
+	uint4 c;
+	c.x = (uint)child;
+	c.y = (uint)generation;
+	c.z = block;
+	c.w = 0;
+	return philox4x32(seed, RNG_STREAM_BREED, c);
+}
+
+//
+// Uniform float in [0, 1) and uniform integer in [0, range) from a random
+// word, as rng_uniform and rng_below in rng.h
+//
+inline float rng_uniform(uint x)
+{
+	return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+inline int rng_below(uint x, int range)
+{
+	return (int)mul_hi(x, (uint)range);
+}
+
+//
+// Finds the indexes of the selected parents, with a binary search for the
+// first cumulative probability reaching each random number
 //
 __kernel void select_parents(int pop_size,
 							 __global float* fit_prob,
-							 __global float* rand_nums,
+							 uint seed,
+							 int generation,
 							 __global int* sel_ix)
 {
 	int tid = get_global_id(0);
 	
 	if (tid < (2 * pop_size)) {
-		for (int i = 0; i < pop_size; i++) {
-			if (rand_nums[tid] < fit_prob[i]) {
-				sel_ix[tid] = i;
-				break;
-			}
+		uint4 b = child_block(seed, generation, tid / 2, 0);
+		float prob = rng_uniform((tid & 1) ? b.y : b.x);
+		int lo = 0;
+		int hi = pop_size - 1;
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (fit_prob[mid] < prob)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		sel_ix[tid] = lo;
+	}
+}
+
+//
+// Finds the indexes of the selected parents with the alias table, built on
+// the host by AliasTable; every parent has four random words, of which the
+// first two are used
+//
+__kernel void select_parents_alias(int pop_size,
+								   __global const float* prob,
+								   __global const int* alias,
+								   uint seed,
+								   int generation,
+								   __global int* sel_ix)
+{
+	int tid = get_global_id(0);
+	
+	if (tid < (2 * pop_size)) {
+		uint4 b = child_block(seed, generation, tid / 2, 2 + (tid & 1));
+		int column = rng_below(b.x, pop_size);
+		sel_ix[tid] = rng_uniform(b.y) < prob[column] ? column : alias[column];
+	}
+}
+
+//
+// Finds the indexes of the selected parents by tournament; every parent has
+// four random words, one per competitor, so at most four compete
+//
+__kernel void select_parents_tournament(int pop_size,
+										int size,
+										__global const float* fitness,
+										uint seed,
+										int generation,
+										__global int* sel_ix)
+{
+	int tid = get_global_id(0);
+	
+	if (tid < (2 * pop_size)) {
+		uint4 b = child_block(seed, generation, tid / 2, 2 + (tid & 1));
+		uint words[4] = { b.x, b.y, b.z, b.w };
+		int best = rng_below(words[0], pop_size);
+		for (int i = 1; i < min(size, 4); i++) {
+			int competitor = rng_below(words[i], pop_size);
+			if (fitness[competitor] > fitness[best])
+				best = competitor;
 		}
+		sel_ix[tid] = best;
 	}
 }
 
 //
-// Performs the crossover operation
+// Performs the crossover operation. The cities taken from the first parent
+// are marked in the child's slice of the visited bitmap, one bit per city.
 //
 __kernel void crossover(int pop_len,
 						int num_cities,
-						__global const int* old_x_coord,
-						__global const int* old_y_coord,
-						__global int* new_x_coord,
-						__global int* new_y_coord,
+						__global const tour_t* old_tours,
+						__global tour_t* new_tours,
 						__global int* selected_parents_inx,
 						float prob_crossover,
-						__global float* rnd_prob_cross,
-						__global int* cross_loc)
+						uint seed,
+						int generation,
+						__global uint* visited)
 {
 	int tid = get_global_id(0);
 	
 	if (tid < pop_len) {
-		if (rnd_prob_cross[tid] < prob_crossover) {
-			int cross_location = cross_loc[tid];
+		if (rng_uniform(child_block(seed, generation, tid, 0).z) < prob_crossover) {
+			int cross_location = rng_below(child_block(seed, generation, tid, 1).x, num_cities - 1);
+			int num_words = (num_cities + 31) / 32;
+			__global uint* bits = &visited[tid * num_words];
+			for (int i = 0; i < num_words; i++)
+				bits[i] = 0;
 			
 			// Copy elements from first parent up through crossover point
 			int parent_0_loc = selected_parents_inx[2*tid];
@@ -193,8 +489,9 @@ __kernel void crossover(int pop_len,
 			int new_base_offset = tid * num_cities;
 			
 			for (int i = 0; i <= cross_location; i++) {
-				new_x_coord[new_base_offset + i] = old_x_coord[old_base_offset + i];
-				new_y_coord[new_base_offset + i] = old_y_coord[old_base_offset + i];
+				tour_t city = old_tours[old_base_offset + i];
+				new_tours[new_base_offset + i] = city;
+				bits[city >> 5] |= 1u << (city & 31);
 			}
 			
 			// Add remaining elements from second parent to child, in order
@@ -202,30 +499,15 @@ __kernel void crossover(int pop_len,
 			int count = 0;
 			int parent_1_loc = selected_parents_inx[2 * tid + 1];
 			old_base_offset = parent_1_loc * num_cities;
-			new_base_offset = tid * num_cities;
 			
-			for (int i = 0; i < num_cities; i++) {  // Loop parent
-				bool in_child = false;
-				
-				for (int j = 0; j <= cross_location; j++) {    // Loop child
-					// If the city is in the child, exit
-					if (new_x_coord[new_base_offset + j] == old_x_coord[old_base_offset + i] &&
-						new_y_coord[new_base_offset + j] == old_y_coord[old_base_offset + i])
-					{
-						in_child = true;
-						break;
-					}
-				}
+			for (int i = 0; i < num_cities && count < remaining; i++) {  // Loop parent
+				tour_t city = old_tours[old_base_offset + i];
 				
-				// If the city was not found in the child, add it to the child
-				if (!in_child) {
+				// If the city is not in the child, add it to the child
+				if (!(bits[city >> 5] & (1u << (city & 31)))) {
 					count++;
-					new_x_coord[new_base_offset + cross_location + count] = old_x_coord[old_base_offset + i];
-					new_y_coord[new_base_offset + cross_location + count] = old_y_coord[old_base_offset + i];
+					new_tours[new_base_offset + cross_location + count] = city;
 				}
-				
-				// Stop once all of the cities have been added
-				if (count == remaining) break;
 			}
 		}
 	}
@@ -236,25 +518,23 @@ __kernel void crossover(int pop_len,
 //
 __kernel void clone_parent(int pop_len,
 						   int num_cities,
-						   __global const int* old_x_coord,
-						   __global const int* old_y_coord,
-						   __global int* new_x_coord,
-						   __global int* new_y_coord,
+						   __global const tour_t* old_tours,
+						   __global tour_t* new_tours,
 						   float prob_crossover,
-						   __global const float* rnd_prob_cross,
+						   uint seed,
+						   int generation,
 						   __global const int* selected_parents_inx)
 {
 	int tid = get_global_id(0);
 	
 	if (tid < pop_len) {
-		if (rnd_prob_cross[tid] >= prob_crossover) {
+		if (rng_uniform(child_block(seed, generation, tid, 0).z) >= prob_crossover) {
 			int loc = selected_parents_inx[2*tid];
 			int old_base_offset = loc * num_cities;
 			int new_base_offset = tid * num_cities;
 			
 			for (int i = 0; i < num_cities; i++) {
-				new_x_coord[new_base_offset + i] = old_x_coord[old_base_offset + i];
-				new_y_coord[new_base_offset + i] = old_y_coord[old_base_offset + i];
+				new_tours[new_base_offset + i] = old_tours[old_base_offset + i];
 			}
 		}
 	}
@@ -265,29 +545,106 @@ __kernel void clone_parent(int pop_len,
 //
 __kernel void mutate(int pop_len,
 					 int num_cities,
-					 __global int* x_coord,
-					 __global int* y_coord,
+					 __global tour_t* tours,
 					 float prob_mutation,
-					 __global const float* rnd_prob_mutation,
-					 __global const int* rnd_mutate_loc)
+					 uint seed,
+					 int generation)
 {
 	int tid = get_global_id(0);
 	
 	if (tid < pop_len) {
-		if (rnd_prob_mutation[tid] < prob_mutation) {
-			int loc0 = rnd_mutate_loc[2*tid];
-			int loc1 = rnd_mutate_loc[2*tid+1];
+		if (rng_uniform(child_block(seed, generation, tid, 0).w) < prob_mutation) {
+			uint4 b = child_block(seed, generation, tid, 1);
+			int loc0 = rng_below(b.y, num_cities);
+			int loc1 = (loc0 + 1 + rng_below(b.z, num_cities - 1)) % num_cities;
 			int offset0 = tid*num_cities + loc0;
 			int offset1 = tid*num_cities + loc1;
 			
-			int tmp = x_coord[offset0];
-			x_coord[offset0] = x_coord[offset1];
-			x_coord[offset1] = tmp;
-			
-			tmp = y_coord[offset0];
-			y_coord[offset0] = y_coord[offset1];
-			y_coord[offset1] = tmp;
+			tour_t tmp = tours[offset0];
+			tours[offset0] = tours[offset1];
+			tours[offset1] = tmp;
 		}
 	}
 }
 
+
+//
+// Produces a child and its fitness in a single pass: crossover or cloning,
+// mutation and evaluation, with the child and its visited bitmap kept in
+// local memory until it is complete. Gives the same results as crossover,
+// clone_parent, mutate and fitness run one after the other.
+//
+__kernel void breed(int pop_len,
+					int num_cities,
+					int WxH,
+					__global const int2* cities,
+					__global const int* dist,
+					int dist_stride,
+					__global const tour_t* old_tours,
+					__global tour_t* new_tours,
+					__global const int* selected_parents_inx,
+					float prob_crossover,
+					float prob_mutation,
+					uint seed,
+					int generation,
+					__global float* fitness,
+					__local tour_t* children,
+					__local uint* visited)
+{
+	int tid = get_global_id(0);
+	
+	if (tid < pop_len) {
+		__local tour_t* child = &children[get_local_id(0) * num_cities];
+		int num_words = (num_cities + 31) / 32;
+		__local uint* bits = &visited[get_local_id(0) * num_words];
+		__global const tour_t* parent_0 = &old_tours[selected_parents_inx[2*tid] * num_cities];
+		uint4 b0 = child_block(seed, generation, tid, 0);
+		uint4 b1 = child_block(seed, generation, tid, 1);
+		
+		if (rng_uniform(b0.z) < prob_crossover) {
+			int cross_location = rng_below(b1.x, num_cities - 1);
+			__global const tour_t* parent_1 = &old_tours[selected_parents_inx[2*tid + 1] * num_cities];
+			
+			for (int i = 0; i < num_words; i++)
+				bits[i] = 0;
+			
+			// Copy elements from first parent up through crossover point
+			for (int i = 0; i <= cross_location; i++) {
+				tour_t city = parent_0[i];
+				child[i] = city;
+				bits[city >> 5] |= 1u << (city & 31);
+			}
+			
+			// Add remaining elements from second parent to child, in order
+			int remaining = num_cities - cross_location - 1;
+			int count = 0;
+			for (int i = 0; i < num_cities && count < remaining; i++) {
+				tour_t city = parent_1[i];
+				if (!(bits[city >> 5] & (1u << (city & 31))))
+					child[cross_location + ++count] = city;
+			}
+		} else {
+			for (int i = 0; i < num_cities; i++)
+				child[i] = parent_0[i];
+		}
+		
+		if (rng_uniform(b0.w) < prob_mutation) {
+			int loc0 = rng_below(b1.y, num_cities);
+			int loc1 = (loc0 + 1 + rng_below(b1.z, num_cities - 1)) % num_cities;
+			tour_t tmp = child[loc0];
+			child[loc0] = child[loc1];
+			child[loc1] = tmp;
+		}
+		
+		// Evaluate the child while writing it out
+		int distance = 0;
+		__global tour_t* out = &new_tours[tid * num_cities];
+		out[0] = child[0];
+		for (int i = 0; i < num_cities-1; i++) {
+			out[i + 1] = child[i + 1];
+			distance += edge_cost(cities, dist, dist_stride, child[i], child[i + 1]);
+		}
+		
+		fitness[tid] = (float)WxH / (float)distance;
+	}
+}
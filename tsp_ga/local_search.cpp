@@ -0,0 +1,221 @@
+//
+//  local_search.cpp
+//  tsp_ga
+//
+
+#include "local_search.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+/*
+ State of one local search. Positions outside the tour hold no city, and
+ edges to them cost nothing, since the tour is open.
+ */
+struct Search
+{
+	const DistanceTable& dist;
+	const NeighborLists& neighbors;
+	tour_t* tour;
+	int n;
+	int* pos;		// Position of every city in the tour
+	int* queue;		// Cities to look at, FIFO
+	char* queued;	// Cleared don't-look bits
+	int head, count;
+
+	int at(int p) const
+	{
+		return (p >= 0 && p < n) ? tour[p] : -1;
+	}
+
+	long long d(int a, int b) const
+	{
+		return (a < 0 || b < 0) ? 0 : dist.sq(a, b);
+	}
+
+	void push(int city)
+	{
+		if (city >= 0 && !queued[city]) {
+			queue[(head + count) % n] = city;
+			count++;
+			queued[city] = 1;
+		}
+	}
+
+	int pop()
+	{
+		int city = queue[head];
+		head = (head + 1) % n;
+		count--;
+		queued[city] = 0;
+		return city;
+	}
+
+	void place(int begin, int end)
+	{
+		for (int p = begin; p <= end; p++)
+			pos[tour[p]] = p;
+	}
+
+	// Gain of reversing positions [l, r]
+	long long two_opt_gain(int l, int r) const
+	{
+		return d(at(l - 1), at(l)) + d(at(r), at(r + 1))
+			 - d(at(l - 1), at(r)) - d(at(l), at(r + 1));
+	}
+
+	void two_opt(int l, int r)
+	{
+		push(at(l - 1)); push(at(l)); push(at(r)); push(at(r + 1));
+		std::reverse(tour + l, tour + r + 1);
+		place(l, r);
+	}
+
+	// Gain of taking out positions [s, e]
+	long long removal_gain(int s, int e) const
+	{
+		return d(at(s - 1), at(s)) + d(at(e), at(e + 1)) - d(at(s - 1), at(e + 1));
+	}
+
+	// Cost of putting positions [s, e] between positions q and q + 1
+	long long insertion_cost(int s, int e, int q, bool reversed) const
+	{
+		int first = reversed ? at(e) : at(s);
+		int last  = reversed ? at(s) : at(e);
+		return d(at(q), first) + d(last, at(q + 1)) - d(at(q), at(q + 1));
+	}
+
+	void or_opt(int s, int e, int q, bool reversed)
+	{
+		push(at(s - 1)); push(at(s)); push(at(e)); push(at(e + 1));
+		push(at(q)); push(at(q + 1));
+
+		int len = e - s + 1;
+		if (q > e) {
+			std::rotate(tour + s, tour + e + 1, tour + q + 1);
+			if (reversed)
+				std::reverse(tour + q - len + 1, tour + q + 1);
+			place(s, q);
+		} else {
+			std::rotate(tour + q + 1, tour + s, tour + e + 1);
+			if (reversed)
+				std::reverse(tour + q + 1, tour + q + len + 1);
+			place(q + 1, e);
+		}
+	}
+
+	/*
+	 Applies the first improving move around a city; returns its gain, or 0
+	 if there is none
+	 */
+	long long improve_city(int a)
+	{
+		const tour_t* near = neighbors.of(a);
+		int k = neighbors.size();
+		int i = pos[a];
+
+		// 2-opt: replace the edge to a's successor, then its predecessor, by
+		// an edge to a near city
+		for (int dir = 1; dir >= -1; dir -= 2) {
+			int b = at(i + dir);
+			if (b < 0)
+				continue;
+			long long dab = d(a, b);
+
+			for (int m = 0; m < k; m++) {
+				int c = near[m];
+				if (d(a, c) >= dab)
+					break;
+				int j = pos[c];
+				int l, r;
+				if (dir == 1) {
+					l = i < j ? i + 1 : j + 1;
+					r = i < j ? j : i;
+				} else {
+					l = j < i ? j : i;
+					r = j < i ? i - 1 : j - 1;
+				}
+				if (l >= r)
+					continue;
+				long long gain = two_opt_gain(l, r);
+				if (gain > 0) {
+					two_opt(l, r);
+					return gain;
+				}
+			}
+		}
+
+		// Or-opt: move a segment ending at a next to a near city
+		for (int len = 1; len <= 3; len++) {
+			for (int side = 0; side < 2; side++) {
+				int s = side == 0 ? i : i - len + 1;
+				int e = s + len - 1;
+				if (s < 0 || e >= n || (side == 1 && len == 1))
+					continue;
+				long long removal = removal_gain(s, e);
+				if (removal <= 0)
+					continue;
+
+				for (int m = 0; m < k; m++) {
+					int c = near[m];
+					if (d(a, c) >= removal)
+						break;
+					int j = pos[c];
+					if (j >= s && j <= e)
+						continue;
+					for (int q = j - 1; q <= j; q++) {
+						if (q >= s - 1 && q <= e)
+							continue;
+						for (int reversed = 0; reversed < 2; reversed++) {
+							long long gain = removal - insertion_cost(s, e, q, reversed != 0);
+							if (gain > 0) {
+								or_opt(s, e, q, reversed != 0);
+								return gain;
+							}
+						}
+					}
+				}
+			}
+		}
+
+		return 0;
+	}
+};
+
+} // namespace
+
+size_t improve_scratch_bytes(int num_cities)
+{
+	return 2 * ScratchArena::footprint<int>(num_cities) + ScratchArena::footprint<char>(num_cities);
+}
+
+int improve_tour(const DistanceTable& dist, const NeighborLists& neighbors,
+				 tour_t* tour, int num_cities, int length, int max_moves,
+				 ScratchArena& scratch)
+{
+	if (num_cities < 3 || neighbors.size() == 0)
+		return length;
+
+	Search search = { dist, neighbors, tour, num_cities,
+					  scratch.alloc<int>(num_cities), scratch.alloc<int>(num_cities),
+					  scratch.alloc<char>(num_cities), 0, num_cities };
+	for (int p = 0; p < num_cities; p++) {
+		search.pos[tour[p]] = p;
+		search.queue[p] = tour[p];
+		search.queued[tour[p]] = 1;
+	}
+
+	// Wraps around like the full evaluation, so the result matches it
+	unsigned tracked = static_cast<unsigned>(length);
+	int moves = 0;
+	while (search.count > 0 && moves < max_moves) {
+		long long gain = search.improve_city(search.pop());
+		if (gain > 0) {
+			tracked -= static_cast<unsigned>(gain);
+			moves++;
+		}
+	}
+	return static_cast<int>(tracked);
+}
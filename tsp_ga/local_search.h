@@ -0,0 +1,38 @@
+//
+//  local_search.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__local_search__
+#define __tsp_ga__local_search__
+
+#include "world.h"
+#include "distance.h"
+#include "neighbors.h"
+#include "arena.h"
+
+/*
+ Scratch memory improve_tour needs for a tour of num_cities
+ */
+size_t improve_scratch_bytes(int num_cities);
+
+/*
+ Improves an open tour with 2-opt and Or-opt moves (segments of up to three
+ cities), taking only moves towards a city's nearest neighbors and skipping
+ cities whose neighborhood did not change since they last failed to improve
+ (don't-look bits). The costs are the squared distances of the fitness.
+
+ dist      : Squared distances between the cities
+ neighbors : Candidate lists for the moves
+ tour      : The tour to improve, in place
+ length    : Its current squared length
+ max_moves : The most improving moves to apply
+ scratch   : Memory for the work arrays
+
+ returns the new squared length of the tour
+ */
+int improve_tour(const DistanceTable& dist, const NeighborLists& neighbors,
+				 tour_t* tour, int num_cities, int length, int max_moves,
+				 ScratchArena& scratch);
+
+#endif /* defined(__tsp_ga__local_search__) */
@@ -11,14 +11,31 @@
 //  Copyright (c) 2015 waz
 
 // Native includes
+#include <chrono>
 #include <iostream>
 
 // Program includes
 #include "log.h"
+#include "tour_simd.h"
 
 using namespace std;
 
-void Logger::start(std::string timing_path, std::string generation_path, std::string stats_path)
+Logger::Logger()
+:
+	records(ring_size), num_cities(0), head(0), tail(0), running(false), sleeping(false),
+	timing_buffer(file_buffer_size), generation_buffer(file_buffer_size),
+	format(log_format_t::csv), encoder(nullptr)
+{
+}
+
+Logger::~Logger()
+{
+	if (writer.joinable())
+		end();
+}
+
+void Logger::start(std::string timing_path, std::string generation_path, std::string stats_path,
+				   log_format_t format)
 {
 	/*
 		Starts logging
@@ -26,10 +43,20 @@ void Logger::start(std::string timing_path, std::string generation_path, std::st
 		timing_path     : The full path to where the timing data should be saved.
 		generation_path : The full path to where the generation data should	be saved.
 		stats_path      : The full path to where the overall details should	be saved.
+		format          : Format of the generation data
 	 */
 	
+	assert(!writer.joinable());
+	this->format = format;
+	if (format != log_format_t::csv)
+		encoder = new TraceEncoder(format == log_format_t::trace_delta);
+	
+	// Large buffers, set before opening, batch the writes of the writer
+	timing_data.rdbuf()->pubsetbuf(timing_buffer.data(), timing_buffer.size());
+	generation_data.rdbuf()->pubsetbuf(generation_buffer.data(), generation_buffer.size());
+	
 	timing_data.open(timing_path);
-	generation_data.open(generation_path);
+	generation_data.open(generation_path, format == log_format_t::csv ? ios::out : ios::out | ios::binary);
 	stats_data.open(stats_path);
 	
 	assert(timing_data.is_open());
@@ -40,35 +67,146 @@ void Logger::start(std::string timing_path, std::string generation_path, std::st
 	stats_data << "Iteration,Type,Total Time [ms],Probability of Mutation,"
 	"Probability of Crossover,Population Size,Total Generations,"
 	"World Seed,GA Seed,Width of World,"
-	"Height of World,Number of Cities" << endl;
+	"Height of World,Number of Cities";
+	for (int p = 0; p < num_phases; p++)
+		stats_data << "," << phase_name(static_cast<phase_t>(p)) << " [ms]";
+	for (int p = 0; p < num_phases; p++)
+		stats_data << ",Device " << phase_name(static_cast<phase_t>(p)) << " [ms]";
+	stats_data << endl;
+	
+	running = true;
+	writer = std::thread(&Logger::write_records, this);
 }
 	
-void Logger::write_log(int generation, float gen_time, const World& leader)
+void Logger::write_log(int generation, float gen_time, float fitness,
+					   const tour_t* tour, const City* cities, int num_cities)
 {
 	/*
-		Writes to the log file
+		Writes to the log file, through the writer thread, or on this thread
+		without start() or after end()
 	 
 		generation : The current generation number
 		gen_time   : The execution time for the current generation
-		leader     : The leader for the current generation
+		fitness    : The leader's fitness
+		tour       : The leader's tour, indices into cities
+		cities     : The coordinates of the base world, kept until end()
+		num_cities : The number of cities in the tour
+	 */
+	
+	Record record = { generation, gen_time, fitness, cities };
+	
+	// Size the tours once, for the first leader or a world of another size
+	if (num_cities != this->num_cities) {
+		wait_written();
+		this->num_cities = num_cities;
+		tours.resize(static_cast<size_t>(ring_size) * num_cities);
+		path.resize(num_cities);
+	}
+	
+	if (!running.load(std::memory_order_relaxed)) {
+		write_record(record, tour);
+		return;
+	}
+	
+	// Wait for room if the writer fell a whole ring behind
+	unsigned t = tail.load(std::memory_order_relaxed);
+	while (t - head.load(std::memory_order_acquire) == ring_size)
+		std::this_thread::yield();
+	
+	unsigned slot = t & (ring_size - 1);
+	records[slot] = record;
+	std::copy(tour, tour + num_cities, &tours[static_cast<size_t>(slot) * num_cities]);
+	tail.store(t + 1, std::memory_order_seq_cst);
+	
+	// The writer announces that it sleeps before it last checks the ring, so
+	// either it sees this batch or this sees it sleeping
+	if (t + 1 - head.load(std::memory_order_acquire) >= wake_batch &&
+		sleeping.load(std::memory_order_seq_cst)) {
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		wake.notify_one();
+	}
+}
+
+void Logger::write_record(const Record& record, const tour_t* tour)
+{
+	/*
+		Formats a record into the timing and generation data
 	 */
 	
-	// Timing data
-	timing_data << generation << "," << gen_time << ","
-	<< leader.fitness << "," << leader.calc_distance() << endl;
+	for (int i = 0; i < num_cities; i++)
+		path[i] = record.cities[tour[i]];
+	const City* cities = path.data();
+	
+	write_timing_row(timing_data, record.generation, record.gen_time, record.fitness,
+					 cities, num_cities);
 	
 	// Generation data
-	for (int i=0; i<leader.num_cities-1; i++) {
-		generation_data << leader.cities[i].x << "_" << leader.cities[i].y << ",";
+	if (encoder == nullptr) {
+		write_generation_row(generation_data, cities, num_cities);
+	} else {
+		encoded.clear();
+		if (encoder->add(encoded, record.generation, record.gen_time, record.fitness,
+						 cities, num_cities))
+			generation_data.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+		else
+			cerr << "Generation " << record.generation
+				 << ": the leader does not visit the first leader's cities, left out of the trace" << endl;
+	}
+}
+
+void Logger::write_records()
+{
+	/*
+		Body of the writer thread: formats the records in batches, and flushes
+		the files whenever it runs out of them
+	 */
+	
+	for (;;) {
+		unsigned h = head.load(std::memory_order_relaxed);
+		unsigned t = tail.load(std::memory_order_acquire);
+		if (h == t) {
+			if (!running.load(std::memory_order_acquire) && h == tail.load(std::memory_order_acquire))
+				break;
+			timing_data.flush();
+			generation_data.flush();
+		}
+		
+		// Wait for a batch, or for the records so far to have waited long enough
+		if (t - h < wake_batch && running.load(std::memory_order_acquire)) {
+			std::unique_lock<std::mutex> lock(wake_mutex);
+			sleeping.store(true, std::memory_order_seq_cst);
+			wake.wait_for(lock, std::chrono::milliseconds(idle_wait_ms), [&] {
+				return tail.load(std::memory_order_seq_cst) - h >= wake_batch ||
+					   !running.load(std::memory_order_acquire);
+			});
+			sleeping.store(false, std::memory_order_relaxed);
+			t = tail.load(std::memory_order_acquire);
+		}
+		
+		for (; h != t; h++) {
+			unsigned slot = h & (ring_size - 1);
+			write_record(records[slot], &tours[static_cast<size_t>(slot) * num_cities]);
+		}
+		head.store(h, std::memory_order_release);
 	}
-	generation_data << leader.cities[leader.num_cities-1].x << "_"
-	<< leader.cities[leader.num_cities-1].y << endl;
+}
+
+
+void Logger::wait_written() const
+{
+	/*
+		Waits for the writer to take every record written so far, which may
+		take it idle_wait_ms to come to
+	 */
+	
+	while (head.load(std::memory_order_acquire) != tail.load(std::memory_order_relaxed))
+		std::this_thread::yield();
 }
 	
 void Logger::write_stats(int iteration, const char* type, float total_time,
 						 float prob_mutation, float prob_crossover, int pop_size,
 						 int max_gen, int world_seed, int ga_seed, int world_width,
-						 int world_height, int num_cities)
+						 int world_height, int num_cities, const PhaseTimes* phases)
 {
 	/*
 		Writes the details of this simulation to a log file
@@ -85,37 +223,77 @@ void Logger::write_stats(int iteration, const char* type, float total_time,
 		world_width    : The width of the world
 		world_height   : The height of the world
 		num_cities     : The number of cities in the world
+		phases         : The time of each phase, if the run was profiled
 	 */
 	
 	stats_data << iteration << "," << type << "," << total_time << ","
 	<< prob_mutation << "," << prob_crossover << "," << pop_size
 	<< "," << max_gen << "," << world_seed << "," << ga_seed << ","
-	<< world_width << "," << world_height << "," << num_cities
-	<< endl;
+	<< world_width << "," << world_height << "," << num_cities;
+	
+	// The phases, left empty if not timed
+	bool timed = phases != nullptr && !phases->empty();
+	for (int p = 0; p < num_phases; p++) {
+		stats_data << ",";
+		if (timed)
+			stats_data << phases->host_ms[p];
+	}
+	for (int p = 0; p < num_phases; p++) {
+		stats_data << ",";
+		if (timed)
+			stats_data << phases->device_ms[p];
+	}
+	stats_data << endl;
 }
 
 void Logger::end()
 {
 	/*
-		Closes the log files
+		Writes the remaining records and closes the log files
 	 */
 	
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		running = false;
+	}
+	wake.notify_one();
+	if (writer.joinable())
+		writer.join();
+	
 	timing_data.close();
 	generation_data.close();
 	stats_data.close();
+	delete encoder;
+	encoder = nullptr;
+}
+
+void write_timing_row(ostream& out, int generation, float gen_time, float fitness,
+					  const City* cities, int num_cities)
+{
+	out << generation << "," << gen_time << ","
+	<< fitness << "," << euclid_path_length(cities, num_cities, default_simd()) << '\n';
+}
+
+void write_generation_row(ostream& out, const City* cities, int num_cities)
+{
+	for (int i=0; i<num_cities-1; i++) {
+		out << cities[i].x << "_" << cities[i].y << ",";
+	}
+	out << cities[num_cities-1].x << "_" << cities[num_cities-1].y << '\n';
 }
 
-void print_status(const World& generationLeader, const World& bestLeader, int generation)
+void print_status(float generationFitness, float bestFitness, int generation)
 {
 	/*
 		Prints the current status to stdout
 		
-		generation_leader : The leader for the current generation
-		best_leader       : The leader out of all generations
+		generation_fitness : Fitness of the leader of the current generation
+		best_fitness       : Fitness of the leader out of all generations
 		generation        : The generation index
 	*/
 	
-	cout << "Generation " << generation << ":" << endl;
-	cout << "  Generation Leader's Fitness: "  << generationLeader.fitness << endl;
-	cout << "  Best Leader's Fitness      : "  << bestLeader.fitness << endl;
+	// One write and no flush; the stream flushes as its buffer fills
+	cout << "Generation " << generation << ":\n"
+		 << "  Generation Leader's Fitness: "  << generationFitness << '\n'
+		 << "  Best Leader's Fitness      : "  << bestFitness << '\n';
 }
\ No newline at end of file
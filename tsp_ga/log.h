@@ -15,16 +15,46 @@
 // Native includes
 #include <fstream>
 #include <cassert>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 // Program includes
 #include "world.h"
+#include "trace.h"
+#include "timing.h"
 
 using namespace std;
 
+/*
+	Format of the generation data
+*/
+enum class log_format_t
+{
+	csv,			// Every leader's cities as "x_y" text, one line per generation
+	trace,			// Binary trace of trace.h, tours only when the leader changes
+	trace_delta		// The same, tours as deltas from the previous one when shorter
+};
+
 class Logger
 {
 	/*
-		Handles all logging operations
+		Handles all logging operations.
+	 
+		The generation data goes through a writer thread: write_log only copies
+		the leader's city indices into a lock-free ring of records, and the
+		writer formats the records into the CSV files, in large batches,
+		flushing them whenever it runs out of records. It sleeps while fewer
+		than wake_batch records wait, and write_log wakes it when the ring holds
+		that many, so that the syscall of the wake is paid once per batch; it
+		takes the records left waiting after idle_wait_ms on its own. The files
+		are the same as when they were written directly. Only one thread at a
+		time may log.
+	 
+		The generation data may also be a binary trace (trace.h), written by the
+		same thread. tools/trace_csv.cpp turns it back into the CSV file.
 	*/
 
 private:
@@ -32,27 +62,73 @@ private:
 	ofstream timing_data;
 	ofstream generation_data;
 	ofstream stats_data;
+	
+	// Generation records waiting for the writer
+	struct Record
+	{
+		int generation;
+		float gen_time;
+		float fitness;
+		const City* cities;	// Coordinates the tour indexes
+	};
+	static const unsigned ring_size = 1024;			// Records, a power of two
+	static const size_t file_buffer_size = 1 << 16;	// Bytes buffered per generation file
+	static const unsigned wake_batch = 32;			// Records waiting that wake the writer
+	static const int idle_wait_ms = 100;			// Longest the writer leaves fewer waiting
+	std::vector<Record> records;
+	std::vector<tour_t> tours;		// The leader of every record, num_cities each
+	std::vector<City> path;			// The writer's copy of a leader's cities
+	int num_cities;
+	std::atomic<unsigned> head;		// Next record to write, advanced by the writer
+	char pad[64];					// Keeps head and tail on different cache lines
+	std::atomic<unsigned> tail;		// Next free record, advanced by write_log
+	std::atomic<bool> running;
+	std::atomic<bool> sleeping;		// The writer waits, or is about to, on wake
+	std::mutex wake_mutex;
+	std::condition_variable wake;
+	std::thread writer;
+	std::vector<char> timing_buffer;
+	std::vector<char> generation_buffer;
+	log_format_t format;
+	TraceEncoder* encoder;			// Of the trace, if the format is one
+	std::vector<uint8_t> encoded;
+	
+	void write_records();
+	void write_record(const Record& record, const tour_t* tour);
+	void wait_written() const;
 
 public:
-	void start(std::string timing_path, std::string generation_path, std::string stats_path);
+	Logger();
+	~Logger();
+	
+	void start(std::string timing_path, std::string generation_path, std::string stats_path,
+			   log_format_t format = log_format_t::csv);
 	
-	void write_log(int generation, float gen_time, const World& leader);
+	void write_log(int generation, float gen_time, float fitness,
+				   const tour_t* tour, const City* cities, int num_cities);
 	
 	void write_stats(int iteration, const char* type, float total_time,
 		float prob_mutation, float prob_crossover, int pop_size, int max_gen, 
 		int world_seed, int ga_seed, int world_width, int world_height,       
-					 int num_cities);
+					 int num_cities, const PhaseTimes* phases = nullptr);
 	
 	void end();
 };
 
+/*
+	Formats a line of the timing data and of the CSV generation data
+*/
+void write_timing_row(ostream& out, int generation, float gen_time, float fitness,
+					  const City* cities, int num_cities);
+void write_generation_row(ostream& out, const City* cities, int num_cities);
+
 /*
 	Prints the current status to stdout
 	
-	generation_leader : The leader for the current generation
-	best_leader       : The leader out of all generations
-	generation        : The generation index
+	generation_fitness : Fitness of the leader of the current generation
+	best_fitness       : Fitness of the leader out of all generations
+	generation         : The generation index
 */
-void print_status(const World& generationLeader, const World& bestLeader, int generation);
+void print_status(float generationFitness, float bestFitness, int generation);
 
 #endif
@@ -0,0 +1,54 @@
+//
+//  migration.cpp
+//  tsp_ga
+//
+
+#include "migration.h"
+
+MigrantQueue::MigrantQueue(int capacity, int batch_size, int num_cities)
+:
+	capacity(capacity), cities(num_cities), head(0), tail(0)
+{
+	batches = new MigrantBatch[capacity];
+	lengths = new int[capacity * batch_size];
+	tours = new tour_t[static_cast<size_t>(capacity) * batch_size * num_cities];
+	for (int i = 0; i < capacity; i++) {
+		batches[i].count = 0;
+		batches[i].generation = 0;
+		batches[i].lengths = &lengths[i * batch_size];
+		batches[i].tours = &tours[static_cast<size_t>(i) * batch_size * num_cities];
+	}
+}
+
+MigrantQueue::~MigrantQueue()
+{
+	delete[] batches;
+	delete[] lengths;
+	delete[] tours;
+}
+
+MigrantBatch* MigrantQueue::slot()
+{
+	unsigned t = tail.load(std::memory_order_relaxed);
+	if (t - head.load(std::memory_order_acquire) == static_cast<unsigned>(capacity))
+		return nullptr;
+	return &batches[t % capacity];
+}
+
+void MigrantQueue::publish()
+{
+	tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+const MigrantBatch* MigrantQueue::front() const
+{
+	unsigned h = head.load(std::memory_order_relaxed);
+	if (h == tail.load(std::memory_order_acquire))
+		return nullptr;
+	return &batches[h % capacity];
+}
+
+void MigrantQueue::release()
+{
+	head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
@@ -0,0 +1,81 @@
+//
+//  migration.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__migration__
+#define __tsp_ga__migration__
+
+#include <atomic>
+
+#include "world.h"
+
+/*
+ A batch of migrant tours with their squared lengths
+ */
+struct MigrantBatch
+{
+	int count;			// Tours in the batch
+	int generation;		// Generation the sender was at
+	int* lengths;		// count squared lengths
+	tour_t* tours;		// count tours, back to back
+};
+
+/*
+ Bounded queue of migrant batches between two islands, with exactly one
+ sending and one receiving thread.
+
+ The sender fills the slot after the last published one and publishes it by
+ advancing the tail; the receiver reads the oldest slot and frees it by
+ advancing the head. Neither ever waits for the other: when the queue is
+ full the sender drops its batch, since fresher migrants follow anyway.
+ */
+class MigrantQueue
+{
+public:
+	/*
+	 capacity   : Batches the queue holds
+	 batch_size : Most tours per batch
+	 num_cities : Cities per tour
+	 */
+	MigrantQueue(int capacity, int batch_size, int num_cities);
+	~MigrantQueue();
+
+	/*
+	 Sender side: the slot to fill, or null if the queue is full. publish()
+	 hands the filled slot to the receiver.
+	 */
+	MigrantBatch* slot();
+	void publish();
+
+	/*
+	 Receiver side: the oldest published batch, or null if there is none.
+	 release() frees it for the sender.
+	 */
+	const MigrantBatch* front() const;
+	void release();
+
+	int num_cities() const
+	{
+		return cities;
+	}
+
+private:
+	int capacity;
+	int cities;
+	MigrantBatch* batches;
+	int* lengths;
+	tour_t* tours;
+
+	// Slots are published up to tail and freed up to head, counting up
+	// forever; each index is written by one side only
+	std::atomic<unsigned> head;
+	char pad0[64];
+	std::atomic<unsigned> tail;
+	char pad1[64];
+
+	MigrantQueue(const MigrantQueue&);
+	MigrantQueue& operator=(const MigrantQueue&);
+};
+
+#endif /* defined(__tsp_ga__migration__) */
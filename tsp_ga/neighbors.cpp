@@ -0,0 +1,116 @@
+//
+//  neighbors.cpp
+//  tsp_ga
+//
+
+#include "neighbors.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+CityGrid::CityGrid(const World& world)
+:
+	cities(world.cities), num_cities(world.num_cities)
+{
+	int max_x = 0, max_y = 0;
+	min_x = min_y = 0;
+	for (int i = 0; i < num_cities; i++) {
+		if (i == 0 || cities[i].x < min_x) min_x = cities[i].x;
+		if (i == 0 || cities[i].y < min_y) min_y = cities[i].y;
+		if (i == 0 || cities[i].x > max_x) max_x = cities[i].x;
+		if (i == 0 || cities[i].y > max_y) max_y = cities[i].y;
+	}
+	
+	// Square cells holding two cities on average
+	double w = max_x - min_x + 1.0, h = max_y - min_y + 1.0;
+	cell = std::max(1.0, std::sqrt(2.0 * w * h / std::max(num_cities, 1)));
+	cols = static_cast<int>(std::ceil(w / cell));
+	rows = static_cast<int>(std::ceil(h / cell));
+	
+	// Counting sort of the cities by cell
+	start.assign(static_cast<size_t>(cols) * rows + 1, 0);
+	for (int i = 0; i < num_cities; i++)
+		start[row(cities[i].y) * cols + column(cities[i].x) + 1]++;
+	for (size_t c = 1; c < start.size(); c++)
+		start[c] += start[c - 1];
+	
+	members.resize(num_cities);
+	std::vector<int> fill(start.begin(), start.end() - 1);
+	for (int i = 0; i < num_cities; i++)
+		members[fill[row(cities[i].y) * cols + column(cities[i].x)]++] = i;
+}
+
+int CityGrid::column(int x) const
+{
+	return std::min(cols - 1, static_cast<int>((x - min_x) / cell));
+}
+
+int CityGrid::row(int y) const
+{
+	return std::min(rows - 1, static_cast<int>((y - min_y) / cell));
+}
+
+void CityGrid::nearest(int city, int k, tour_t* nearest) const
+{
+	// Max-heap of the best (squared distance, index) pairs found so far
+	std::vector<std::pair<long long, int>> best;
+	best.reserve(k + 1);
+	
+	const City& c = cities[city];
+	int cx = column(c.x), cy = row(c.y);
+	
+	// Visit rings of cells around the city's cell. Every city in ring r or
+	// beyond is at least r - 1 cells away, so stop once the k-th best is closer.
+	for (int r = 0; ; r++) {
+		double reach = (r - 1) * cell;
+		if (r > 0 && static_cast<int>(best.size()) == k && best.front().first < reach * reach)
+			break;
+		if (cx - r < 0 && cy - r < 0 && cx + r >= cols && cy + r >= rows)
+			break;
+		
+		for (int y = cy - r; y <= cy + r; y++) {
+			if (y < 0 || y >= rows)
+				continue;
+			bool edge_row = (y == cy - r || y == cy + r);
+			for (int x = cx - r; x <= cx + r; x += edge_row ? 1 : 2 * r) {
+				if (x >= 0 && x < cols) {
+					int cell_ix = y * cols + x;
+					for (int m = start[cell_ix]; m < start[cell_ix + 1]; m++) {
+						int other = members[m];
+						if (other == city)
+							continue;
+						long long dx = cities[other].x - c.x;
+						long long dy = cities[other].y - c.y;
+						std::pair<long long, int> entry(dx*dx + dy*dy, other);
+						if (static_cast<int>(best.size()) < k) {
+							best.push_back(entry);
+							std::push_heap(best.begin(), best.end());
+						} else if (entry < best.front()) {
+							std::pop_heap(best.begin(), best.end());
+							best.back() = entry;
+							std::push_heap(best.begin(), best.end());
+						}
+					}
+				}
+			}
+		}
+	}
+	
+	std::sort_heap(best.begin(), best.end());
+	for (size_t i = 0; i < best.size(); i++)
+		nearest[i] = static_cast<tour_t>(best[i].second);
+}
+
+NeighborLists::NeighborLists(const World& world, int k)
+:
+	k(std::max(0, std::min(k, world.num_cities - 1)))
+{
+	lists.resize(static_cast<size_t>(world.num_cities) * this->k);
+	if (this->k == 0)
+		return;
+	
+	CityGrid grid(world);
+	for (int city = 0; city < world.num_cities; city++)
+		grid.nearest(city, this->k, &lists[static_cast<size_t>(city) * this->k]);
+}
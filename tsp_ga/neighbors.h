@@ -0,0 +1,73 @@
+//
+//  neighbors.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__neighbors__
+#define __tsp_ga__neighbors__
+
+#include <vector>
+
+#include "world.h"
+
+/*
+ Uniform grid over the cities of a world, about two cities per cell, for
+ nearest neighbor queries
+ */
+class CityGrid
+{
+public:
+	explicit CityGrid(const World& world);
+	
+	/*
+	 Finds the k cities nearest to a city, excluding itself, nearest first;
+	 ties go to the lower index
+	 
+	 city    : The city to search around
+	 k       : The number of neighbors, at most num_cities - 1
+	 nearest : Receives the k neighbors
+	 */
+	void nearest(int city, int k, tour_t* nearest) const;
+	
+private:
+	const City* cities;
+	int num_cities;
+	int min_x, min_y;
+	int cols, rows;
+	double cell;			// Side of a cell
+	std::vector<int> start;	// First entry of every cell in members, plus an end
+	std::vector<int> members;	// City indices, grouped by cell
+	
+	int column(int x) const;
+	int row(int y) const;
+};
+
+/*
+ The k nearest cities of every city, nearest first. Built with a CityGrid,
+ in O(n k log k) for evenly spread cities.
+ */
+class NeighborLists
+{
+public:
+	/*
+	 world : The world whose cities are indexed
+	 k     : Neighbors per city, at most num_cities - 1
+	 */
+	NeighborLists(const World& world, int k);
+	
+	const tour_t* of(int city) const
+	{
+		return &lists[static_cast<size_t>(city) * k];
+	}
+	
+	int size() const
+	{
+		return k;
+	}
+	
+private:
+	int k;
+	std::vector<tour_t> lists;
+};
+
+#endif /* defined(__tsp_ga__neighbors__) */
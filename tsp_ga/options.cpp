@@ -0,0 +1,34 @@
+//
+//  options.cpp
+//  tsp_ga
+//
+
+#include <iostream>
+#include <algorithm>
+
+#include "options.h"
+#include "population.h"
+
+bool GAOptions::valid(int pop_size) const
+{
+	if (selection == selection_t::tournament &&
+		(tournament_size < 2 || tournament_size > max_tournament_size)) {
+		std::cerr << "Tournament size " << tournament_size << " is not between 2 and "
+				  << max_tournament_size << std::endl;
+		return false;
+	}
+	if (num_elites < 0 || num_elites > max_elites || num_elites > pop_size) {
+		std::cerr << num_elites << " elites are not between 0 and "
+				  << std::min(max_elites, pop_size) << std::endl;
+		return false;
+	}
+	if (pipeline_depth < 1) {
+		std::cerr << "Pipeline depth " << pipeline_depth << " is below 1" << std::endl;
+		return false;
+	}
+	if (migration_interval < 1 || migration_size < 1) {
+		std::cerr << "Migrations need an interval and a size of at least 1" << std::endl;
+		return false;
+	}
+	return true;
+}
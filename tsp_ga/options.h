@@ -0,0 +1,121 @@
+//
+//  options.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__options__
+#define __tsp_ga__options__
+
+#include <cstddef>
+#include <vector>
+
+#include "selection.h"
+#include "seeding.h"
+#include "timing.h"
+#include "distance.h"
+
+/*
+ OpenCL device to run the GPU engine on
+ */
+enum class device_t
+{
+	gpu,
+	cpu,	// CPU OpenCL runtimes, such as PoCL
+	any
+};
+
+/*
+ Which islands of the island model send migrants to which
+ */
+enum class topology_t
+{
+	ring,	// Island i sends to island i + 1
+	torus,	// Islands on a 2D grid, wrapping around, send to their four neighbors
+	random	// Every migration goes to an island drawn at random
+};
+
+/*
+ A bred generation, as logged
+ */
+struct GenerationSample
+{
+	float time_ms;			// Time of the generation, as in the timing log
+	float best_distance;	// Length of the best tour found so far
+};
+
+/*
+ Counters collected during a GA run
+ */
+struct RunStats
+{
+	size_t allocations;				// Heap allocations made while breeding, counted only
+									// if built with TSP_GA_COUNT_ALLOCATIONS (heap_count.h)
+	size_t last_gen_allocations;	// The same, for the last generation only
+	PhaseTimes phases;				// Time in each phase of the generations, if profiled
+	std::vector<GenerationSample> generations;	// Every generation bred, in order
+	
+	RunStats()
+	:
+		allocations(0), last_gen_allocations(0)
+	{
+	}
+};
+
+/*
+ Engine settings of a GA run, beyond the GA parameters themselves
+ */
+struct GAOptions
+{
+	int num_threads;			// Threads of the CPU engine, 0 for one per hardware thread
+	selection_t selection;		// Parent selection method
+	int tournament_size;		// Competitors per tournament, 2 to max_tournament_size
+	device_t device;			// OpenCL device type of the GPU engine
+	bool fused;					// Breed with the single-pass kernel when the tours fit in local memory
+	int pipeline_depth;			// Generations the GPU engine runs ahead of its log, 1 for none
+	bool verify;				// Check incremental and device evaluations against full CPU ones
+	bool profile;				// Time the phases of every generation into stats->phases
+	int num_elites;				// Fittest individuals copied unchanged into the next generation
+	size_t distance_budget;		// Bytes the distance table may use
+	bool distance_stats;		// Count the distance table's lookups and cache hits
+	bool distance_cache;		// Cache distances beyond the budget of a dense table
+	
+	// First generation
+	seeding_t seeding;			// How the first tours are built
+	float seed_random_fraction;	// Fraction of them left random, for diversity
+	
+	// Local search (2-opt and Or-opt) of the CPU engine
+	float improve_prob;			// Probability of improving each child, 0 to disable
+	bool improve_leader;		// Also improve the best child of every generation
+	int improve_moves;			// Most improving moves per tour
+	int improve_neighbors;		// Candidate cities per city
+	
+	// Island model (execute_islands)
+	int num_islands;			// Sub-populations, each evolving on its own thread
+	topology_t topology;		// Which islands send migrants to which
+	int migration_interval;		// Generations between two migrations of an island
+	int migration_size;			// Elites sent along every link at each migration
+	RunStats* stats;			// Filled with the counters of the run, if not null
+	const char* timeline;		// Path of a CSV trace of the GPU engine's pipeline, if not null
+	
+	GAOptions()
+	:
+		num_threads(0),
+		selection(selection_t::roulette), tournament_size(2),
+		device(device_t::gpu), fused(true), pipeline_depth(2), verify(false), profile(false),
+		num_elites(0), distance_budget(DistanceTable::default_budget), distance_stats(false),
+		distance_cache(false),
+		seeding(seeding_t::random), seed_random_fraction(0.5f),
+		improve_prob(0.0f), improve_leader(false), improve_moves(1000), improve_neighbors(8),
+		num_islands(4), topology(topology_t::ring), migration_interval(10), migration_size(2),
+		stats(nullptr), timeline(nullptr)
+	{
+	}
+
+	/*
+	 Checks the settings against what the engines support, for a population
+	 of pop_size. Returns false, printing the reason, if one is out of range.
+	 */
+	bool valid(int pop_size) const;
+};
+
+#endif /* defined(__tsp_ga__options__) */
@@ -7,60 +7,34 @@
 //
 
 #include "population.h"
+#include "scan.h"
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
 #include <algorithm>
 
-Population::Population(int numIndividuals, int numCitiesPerWorld, int height, int width)
-{
-	this->numIndividuals = numIndividuals;
-	this->height = height;
-	this->width = width;
-	this->numCitiesPerWorld = numCitiesPerWorld;
-	int totalCities = numCitiesPerWorld * numIndividuals;
-	this->cities_xcoord = new int[totalCities];
-	this->cities_ycoord = new int[totalCities];
-	this->fitness = new float[numIndividuals];
-	this->fit_prob = new float[numIndividuals];
-}
-
-Population::Population(int numIndividuals, const World& baseWorld, int seed)
+Population::Population(int numIndividuals, const World& baseWorld, const DistanceTable& distances)
 {
 	this->numIndividuals = numIndividuals;
 	this->height = baseWorld.height;
 	this->width = baseWorld.width;
 	this->numCitiesPerWorld = baseWorld.num_cities;
-	int totalCities = numCitiesPerWorld * numIndividuals;
-	this->cities_xcoord = new int[totalCities];
-	this->cities_ycoord = new int[totalCities];
+	this->cities = baseWorld.cities;
+	this->distances = &distances;
+	this->tours = new tour_t[numCitiesPerWorld * numIndividuals];
+	this->lengths = new int[numIndividuals];
 	this->fitness = new float[numIndividuals];
 	this->fit_prob = new float[numIndividuals];
-	
-	// Set the seed for random number generation
-	srand(seed);
-	
-	City* cities = new City[numCitiesPerWorld];
-	memmove(cities, baseWorld.cities, numCitiesPerWorld*sizeof(City));
-	
-	for (int i = 0; i < numIndividuals; i++)
-	{
-		int baseOffset = i * numCitiesPerWorld;
-		random_shuffle(cities, &cities[numCitiesPerWorld]);
-		
-		for (int j = 0; j < numCitiesPerWorld; j++) {
-			cities_xcoord[baseOffset + j] = cities[j].x;
-			cities_ycoord[baseOffset + j] = cities[j].y;
-		}
-	}
-	
-	delete[] cities;
+	this->scan_scratch = new float[scan_scratch_size(numIndividuals)];
 }
 
 Population::~Population()
 {
-	delete[] cities_xcoord;
-	delete[] cities_ycoord;
+	delete[] tours;
+	delete[] lengths;
+	delete[] fitness;
+	delete[] fit_prob;
+	delete[] scan_scratch;
 }
 
 float Population::CalcFitness(int indx)
@@ -71,15 +45,7 @@ float Population::CalcFitness(int indx)
 	
 	assert(0 <= indx && indx < numIndividuals);
 	
-	int baseOffset = indx*numCitiesPerWorld;
-	int distance = 0;
-	for (int i = 0; i < numCitiesPerWorld - 1; i++) {
-		int dy = cities_ycoord[baseOffset + i] - cities_ycoord[baseOffset + i + 1];
-		int dx = cities_xcoord[baseOffset + i] - cities_xcoord[baseOffset + i + 1];
-		
-		distance += dx*dx + dy*dy;
-	}
-	return fitness[indx] = (width * height) / static_cast<float>(distance);
+	return SetLength(indx, distances->tour_length(GetTour(indx), numCitiesPerWorld));
 }
 
 void Population::GetWorld(World& world, int inx) const
@@ -95,34 +61,34 @@ void Population::GetWorld(World& world, int inx) const
 	{
 		world.cities = new City[numCitiesPerWorld];
 	}
-	int baseOffset = inx * numCitiesPerWorld;
+	const tour_t* tour = GetTour(inx);
 	for (int i = 0; i < numCitiesPerWorld; i++) {
-		world.cities[i].x = cities_xcoord[baseOffset + i];
-		world.cities[i].y = cities_ycoord[baseOffset + i];
+		world.cities[i] = cities[tour[i]];
 	}
 }
 
-void Population::GetCities(int* cities_xcoord, int* cities_ycoord, int inx) const
+void Population::SetTour(int inx, const tour_t* tour)
 {
-	memmove(cities_xcoord, &(this->cities_xcoord[inx*numCitiesPerWorld]), numCitiesPerWorld*sizeof(int));
-	memmove(cities_ycoord, &(this->cities_ycoord[inx*numCitiesPerWorld]), numCitiesPerWorld*sizeof(int));
+	memmove(GetTour(inx), tour, numCitiesPerWorld*sizeof(tour_t));
 }
 
-void Population::SetCities(int inx, int* cities_xcoord, int* cities_ycoord)
+int BestTour::update(const tour_t* tour, float fitness, const DistanceTable& distances)
 {
-	memmove(&(this->cities_xcoord[inx*numCitiesPerWorld]), cities_xcoord, numCitiesPerWorld*sizeof(int));
-	memmove(&(this->cities_ycoord[inx*numCitiesPerWorld]), cities_ycoord, numCitiesPerWorld*sizeof(int));
+	if (fitness <= this->fitness)
+		return 0;
+	std::copy(tour, tour + this->tour.size(), this->tour.begin());
+	this->fitness = fitness;
+	distance = distances.tour_distance(tour, static_cast<int>(this->tour.size()));
+	return 1;
 }
 
-int Population::select_leader(World& generationLeader, World& bestLeader) const
+int Population::select_leader(int& generationLeader, BestTour& best) const
 {
 	/*
 		Updates the generation and global best leaders
 		
-		pop               : The population to select from
-		pop_size          : The number of elements in the population
-		generation_leader : The world with the max fitness for this generation
-		best_leader       : The world with the best global fitness across all generations
+		generation_leader : Set to the index of the fittest individual
+		best              : The best tour across all generations
 	 
 		return 1 if this generation is the best, else 0
 	 */
@@ -134,14 +100,40 @@ int Population::select_leader(World& generationLeader, World& bestLeader) const
 			ix = i;
 	}
 	
-	// Store generation leader
-	GetWorld(generationLeader, ix);
+	generationLeader = ix;
 	
 	// Update best leader
-	if (generationLeader.fitness > bestLeader.fitness) {
-		bestLeader = generationLeader;
-		return 1;
+	return best.update(GetTour(ix), fitness[ix], *distances);
+}
+
+void Population::top_k(int count, int* order) const
+{
+	assert(0 <= count && count <= numIndividuals);
+	
+	for (int i = 0; i < numIndividuals; i++)
+		order[i] = i;
+	const float* fit = fitness;
+	auto fitter = [fit](int a, int b) {
+		return fit[a] > fit[b] || (fit[a] == fit[b] && a < b);
+	};
+	std::nth_element(order, order + count, order + numIndividuals, fitter);
+	std::sort(order, order + count, fitter);
+}
+
+void init_tours(tour_t* tours, int numIndividuals, int numCities, int seed)
+{
+	// Set the seed for random number generation
+	srand(seed);
+	
+	tour_t* tour = new tour_t[numCities];
+	for (int i = 0; i < numCities; i++)
+		tour[i] = static_cast<tour_t>(i);
+	
+	for (int i = 0; i < numIndividuals; i++)
+	{
+		random_shuffle(tour, &tour[numCities]);
+		memmove(&tours[i * numCities], tour, numCities*sizeof(tour_t));
 	}
 	
-	return 0;
+	delete[] tour;
 }
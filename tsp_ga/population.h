@@ -9,36 +9,109 @@
 #ifndef __tsp_ga__population__
 #define __tsp_ga__population__
 
+#include <vector>
+
 #include "world.h"
+#include "distance.h"
+
+/*
+ Most individuals elitism carries over, bounded by the device's top-k
+ reduction (MAX_ELITES in kernel.cl)
+ */
+static const int max_elites = 16;
+
+/*
+ Best individual of a run, kept as its tour in a buffer sized once, so that
+ an improvement only copies the city indices
+ */
+struct BestTour
+{
+	std::vector<tour_t> tour;
+	float fitness;
+	float distance;		// Euclidean length of the tour
+	
+	BestTour(int num_cities)
+	:
+		tour(num_cities), fitness(0.0f), distance(0.0f)
+	{
+	}
+	
+	/*
+	 Takes a tour if it is fitter than the best so far
+	 
+	 return 1 if it is, else 0
+	 */
+	int update(const tour_t* tour, float fitness, const DistanceTable& distances);
+};
 
 struct Population
 {
 	int numIndividuals;
 	int numCitiesPerWorld;
 	int height, width;
-	int *cities_xcoord;
-	int *cities_ycoord;
+	const City *cities;	// Coordinate table shared with the base world
+	const DistanceTable *distances;	// Edge costs, shared with the base world
+	tour_t *tours;		// City indices, numCitiesPerWorld per individual
+	int *lengths;		// Squared tour lengths the fitnesses come from
 	float *fitness;
 	float *fit_prob;
+	float *scan_scratch;	// Scratch space for the fitness prefix sum
 	
-	Population(int numIndividuals, int numCitiesPerWorld, int height, int width);
-	Population(int numIndividuals, const World& baseWorld, int seed);
+	Population(int numIndividuals, const World& baseWorld, const DistanceTable& distances);
 	~Population();
 	float CalcFitness(int indx);
+	
+	/*
+	 Sets the squared tour length of an individual, known without evaluating
+	 its tour, and the fitness that follows from it
+	 */
+	float SetLength(int indx, int length)
+	{
+		lengths[indx] = length;
+		return fitness[indx] = (width * height) / static_cast<float>(length);
+	}
 	void GetWorld(World& world, int inx) const;
-	void GetCities(int* cities_xcoord, int* cities_ycoord, int inx) const;
-	void SetCities(int inx, int* cities_xcoord, int* cities_ycoord);
+	void SetTour(int inx, const tour_t* tour);
+	
+	tour_t* GetTour(int inx)
+	{
+		return &tours[inx * numCitiesPerWorld];
+	}
+	
+	const tour_t* GetTour(int inx) const
+	{
+		return &tours[inx * numCitiesPerWorld];
+	}
 	
 	/*
 	 Updates the generation and global best leaders
 	 
-	 generation_leader : The world with the max fitness for this generation
-	 best_leader       : The world with the best global fitness across all generations
+	 generation_leader : Set to the index of the fittest individual
+	 best              : The best tour across all generations
 	 
 	 return 1 if this generation is the best, else 0
 	 */
-	int select_leader(World& generationLeader, World& bestLeader) const;
+	int select_leader(int& generationLeader, BestTour& best) const;
+	
+	/*
+	 Finds the count fittest individuals by partial selection, in
+	 O(numIndividuals), without sorting the population
+	 
+	 order : Receives their indices in [0, count), fittest first, ties going
+	         to the lower index; needs room for numIndividuals entries
+	 */
+	void top_k(int count, int* order) const;
 };
 
+/*
+ Fills a population's tours with random permutations of the city indices.
+ Shared by the CPU and GPU populations so both start from the same tours.
+ 
+ tours          : Destination, numCities entries per individual
+ numIndividuals : The number of individuals to initialize
+ numCities      : The number of cities in the world
+ seed           : Seed for random number generation
+ */
+void init_tours(tour_t* tours, int numIndividuals, int numCities, int seed);
 
 #endif /* defined(__tsp_ga__population__) */
@@ -0,0 +1,128 @@
+//
+//  rng.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__rng__
+#define __tsp_ga__rng__
+
+#include <cstdint>
+
+/*
+ Philox4x32-10 counter-based random number generator (Salmon et al., "Parallel
+ random numbers: as easy as 1, 2, 3", SC 2011).
+ 
+ Every block of four random words is a pure function of a 64 bit key and a
+ 128 bit counter, so any random number of a run can be generated on its own,
+ by any thread, in any order. kernel.cl contains the same generator.
+ */
+struct philox_block
+{
+	uint32_t v[4];
+};
+
+inline philox_block philox4x32(uint32_t key0, uint32_t key1,
+							   uint32_t ctr0, uint32_t ctr1, uint32_t ctr2, uint32_t ctr3)
+{
+	philox_block c = {{ ctr0, ctr1, ctr2, ctr3 }};
+	for (int round = 0; round < 10; round++) {
+		uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c.v[0];
+		uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c.v[2];
+		uint32_t hi0 = static_cast<uint32_t>(p0 >> 32), lo0 = static_cast<uint32_t>(p0);
+		uint32_t hi1 = static_cast<uint32_t>(p1 >> 32), lo1 = static_cast<uint32_t>(p1);
+		c.v[0] = hi1 ^ c.v[1] ^ key0;
+		c.v[1] = lo1;
+		c.v[2] = hi0 ^ c.v[3] ^ key1;
+		c.v[3] = lo0;
+		key0 += 0x9E3779B9u;
+		key1 += 0xBB67AE85u;
+	}
+	return c;
+}
+
+/*
+ Uniform float in [0, 1) from the top 24 bits of a random word. Exact in
+ single precision, so the host and the kernels agree bit for bit.
+ */
+inline float rng_uniform(uint32_t x)
+{
+	return static_cast<float>(x >> 8) * (1.0f / 16777216.0f);
+}
+
+/*
+ Uniform integer in [0, range) from a random word
+ */
+inline int rng_below(uint32_t x, int range)
+{
+	return static_cast<int>((static_cast<uint64_t>(x) * static_cast<uint32_t>(range)) >> 32);
+}
+
+/*
+ Independent random streams of a run; each stream is a different Philox key
+ */
+enum class rng_stream : uint32_t
+{
+	breed = 0,
+	seeding = 1,
+	migration = 2
+};
+
+/*
+ All the random numbers needed to produce one child
+ */
+struct ChildRandoms
+{
+	float prob_select[2];	// Roulette wheel draws for both parents
+	float prob_cross;		// Whether crossover happens
+	int   cross_loc;		// Crossover point, in [0, num_cities - 1)
+	float prob_mutate;		// Whether mutation happens
+	int   mutate_loc[2];	// Two distinct positions to swap
+	float prob_improve;		// Whether the local search runs
+};
+
+/*
+ Generates the random numbers of a child. They only depend on the seed, the
+ generation and the child's slot in the new population.
+ 
+ r          : The random numbers to fill
+ seed       : Seed of the run
+ generation : Index of the generation being produced
+ child      : Index of the child in the new population
+ num_cities : The number of cities in the world
+ */
+inline void child_randoms(ChildRandoms& r, uint32_t seed, int generation, int child, int num_cities)
+{
+	uint32_t key1 = static_cast<uint32_t>(rng_stream::breed);
+	philox_block b0 = philox4x32(seed, key1, child, generation, 0, 0);
+	philox_block b1 = philox4x32(seed, key1, child, generation, 1, 0);
+	
+	r.prob_select[0] = rng_uniform(b0.v[0]);
+	r.prob_select[1] = rng_uniform(b0.v[1]);
+	r.prob_cross     = rng_uniform(b0.v[2]);
+	r.prob_mutate    = rng_uniform(b0.v[3]);
+	r.cross_loc      = rng_below(b1.v[0], num_cities - 1);
+	r.mutate_loc[0]  = rng_below(b1.v[1], num_cities);
+	r.mutate_loc[1]  = (r.mutate_loc[0] + 1 + rng_below(b1.v[2], num_cities - 1)) % num_cities;
+	r.prob_improve   = rng_uniform(b1.v[3]);
+}
+
+/*
+ Random words used by the alias and tournament selection methods: words
+ [0, 4) for the first parent and [4, 8) for the second.
+ 
+ words      : The words to fill
+ seed       : Seed of the run
+ generation : Index of the generation being produced
+ child      : Index of the child in the new population
+ */
+inline void selection_words(uint32_t words[8], uint32_t seed, int generation, int child)
+{
+	uint32_t key1 = static_cast<uint32_t>(rng_stream::breed);
+	for (int parent = 0; parent < 2; parent++) {
+		philox_block b = philox4x32(seed, key1, child, generation, 2 + parent, 0);
+		for (int i = 0; i < 4; i++)
+			words[4 * parent + i] = b.v[i];
+	}
+}
+
+#endif /* defined(__tsp_ga__rng__) */
@@ -0,0 +1,89 @@
+//
+//  scan.cpp
+//  tsp_ga
+//
+
+#include "scan.h"
+
+int scan_scratch_size(int n)
+{
+	int size = 0;
+	do {
+		n = (n + scan_block - 1) / scan_block;
+		size += n;
+	} while (n > 1);
+	return size;
+}
+
+/*
+ Scans one block, as a work-group of the scan_block kernel does
+ */
+static float scan_one_block(const float* in, float* out, int count, bool normalize)
+{
+	float temp[scan_block];
+	for (int i = 0; i < scan_block; i++)
+		temp[i] = i < count ? in[i] : 0.0f;
+	float last = temp[scan_block - 1];
+	float first_x[scan_block];
+	for (int i = 0; i < scan_block; i++)
+		first_x[i] = temp[i];
+	
+	// Up-sweep
+	int offset = 1;
+	for (int d = scan_block >> 1; d > 0; d >>= 1) {
+		for (int t = 0; t < d; t++) {
+			int ai = offset * (2*t + 1) - 1;
+			int bi = offset * (2*t + 2) - 1;
+			temp[bi] += temp[ai];
+		}
+		offset *= 2;
+	}
+	
+	// Down-sweep, giving the exclusive scan
+	temp[scan_block - 1] = 0.0f;
+	for (int d = 1; d < scan_block; d *= 2) {
+		offset >>= 1;
+		for (int t = 0; t < d; t++) {
+			int ai = offset * (2*t + 1) - 1;
+			int bi = offset * (2*t + 2) - 1;
+			float tmp = temp[ai];
+			temp[ai] = temp[bi];
+			temp[bi] += tmp;
+		}
+	}
+	
+	float total = temp[scan_block - 1] + last;
+	for (int i = 0; i < count; i++) {
+		float v = temp[i] + first_x[i];
+		out[i] = normalize ? v / total : v;
+	}
+	return total;
+}
+
+void scan(const float* in, float* out, int n, bool normalize, float* scratch)
+{
+	int groups = (n + scan_block - 1) / scan_block;
+	float* sums = scratch;
+	
+	for (int g = 0; g < groups; g++) {
+		int begin = g * scan_block;
+		int count = n - begin < scan_block ? n - begin : scan_block;
+		sums[g] = scan_one_block(&in[begin], &out[begin], count, normalize && groups == 1);
+	}
+	
+	if (groups > 1) {
+		// Scan the block totals, then add them to the following blocks
+		scan(sums, sums, groups, false, &scratch[groups]);
+		
+		float total = sums[groups - 1];
+		for (int g = 0; g < groups; g++) {
+			float offset = g > 0 ? sums[g - 1] : 0.0f;
+			int begin = g * scan_block;
+			int end = n - begin < scan_block ? n : begin + scan_block;
+			for (int i = begin; i < end; i++) {
+				float v = out[i] + offset;
+				out[i] = normalize ? v / total : v;
+			}
+		}
+	}
+}
@@ -0,0 +1,38 @@
+//
+//  scan.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__scan__
+#define __tsp_ga__scan__
+
+/*
+ Work-efficient inclusive prefix sum (Blelloch, "Prefix sums and their
+ applications", 1990), used to turn fitnesses into cumulative probabilities.
+ 
+ The input is split in blocks of scan_block elements, each scanned with an
+ up-sweep / down-sweep tree; the block totals are scanned the same way and
+ added back. The CPU version performs exactly the same float additions in
+ the same order as the scan_block / scan_add kernels, so both engines get
+ bit-identical probabilities, as long as the device rounds divisions
+ correctly; see opencl_env::hasExactDivide().
+ */
+
+// Work-items per group of the scan kernels, each handling two elements
+static const int scan_group_size = 256;
+static const int scan_block = 2 * scan_group_size;
+
+/*
+ Number of floats of scratch space scan() needs for n elements
+ */
+int scan_scratch_size(int n);
+
+/*
+ Inclusive prefix sum of in[0, n) into out, optionally divided by the total.
+ in and out may be the same array.
+ 
+ scratch : scan_scratch_size(n) floats
+ */
+void scan(const float* in, float* out, int n, bool normalize, float* scratch);
+
+#endif /* defined(__tsp_ga__scan__) */
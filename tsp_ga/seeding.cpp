@@ -0,0 +1,297 @@
+//
+//  seeding.cpp
+//  tsp_ga
+//
+
+#include "seeding.h"
+
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+#include "population.h"
+#include "neighbors.h"
+#include "rng.h"
+
+// Individuals built per work item of the thread pool
+static const int seed_grain = 4;
+
+// Candidate edges per city of the nearest neighbor walks and greedy matching
+static const int seed_neighbors = 10;
+
+// Relative noise on the edge lengths of the greedy matching
+static const double greedy_noise = 0.2;
+
+// Bits per coordinate of the Hilbert curve
+static const int hilbert_order = 16;
+
+static inline long long sq_dist(const City* cities, int a, int b)
+{
+	long long dx = cities[a].x - cities[b].x;
+	long long dy = cities[a].y - cities[b].y;
+	return dx*dx + dy*dy;
+}
+
+// Random words of an individual's seeding
+static inline philox_block seeding_block(int seed, int individual, int block)
+{
+	return philox4x32(static_cast<uint32_t>(seed), static_cast<uint32_t>(rng_stream::seeding),
+					  individual, block, 0, 0);
+}
+
+/*
+	Nearest unvisited city to a city, from its candidate list when possible,
+	otherwise by scanning the unvisited cities
+*/
+static int nearest_unvisited(const City* cities, const NeighborLists& neighbors,
+							 const std::vector<char>& visited, const std::vector<int>& unvisited,
+							 int city)
+{
+	const tour_t* near = neighbors.of(city);
+	for (int m = 0; m < neighbors.size(); m++)
+		if (!visited[near[m]])
+			return near[m];
+
+	int best = -1;
+	long long best_sq = 0;
+	for (int other : unvisited) {
+		long long sq = sq_dist(cities, city, other);
+		if (best < 0 || sq < best_sq || (sq == best_sq && other < best)) {
+			best = other;
+			best_sq = sq;
+		}
+	}
+	return best;
+}
+
+/*
+	Nearest neighbor walk from a random city
+*/
+static void nearest_neighbor_tour(tour_t* tour, const World& world, const NeighborLists& neighbors,
+								  int seed, int individual)
+{
+	int n = world.num_cities;
+	std::vector<char> visited(n, 0);
+	std::vector<int> unvisited(n), where(n);
+	for (int c = 0; c < n; c++)
+		unvisited[c] = where[c] = c;
+
+	int city = rng_below(seeding_block(seed, individual, 0).v[0], n);
+	for (int i = 0; i < n; i++) {
+		tour[i] = static_cast<tour_t>(city);
+		visited[city] = 1;
+
+		// Remove the city from the unvisited list
+		int last = unvisited.back();
+		unvisited[where[city]] = last;
+		where[last] = where[city];
+		unvisited.pop_back();
+
+		if (!unvisited.empty())
+			city = nearest_unvisited(world.cities, neighbors, visited, unvisited, city);
+	}
+}
+
+/*
+	Greedy edge matching: takes candidate edges from shortest to longest when
+	neither end has two edges yet and no cycle forms, then joins the fragments
+	end to end, each time to the nearest free end. Every individual but the
+	first perturbs the edge lengths, to build different tours.
+*/
+static void greedy_tour(tour_t* tour, const World& world, const NeighborLists& neighbors,
+						int seed, int individual)
+{
+	int n = world.num_cities;
+	int k = neighbors.size();
+
+	// Candidate edges (a < b), keyed by their perturbed lengths
+	struct Edge
+	{
+		double key;
+		int a, b;
+		bool operator<(const Edge& other) const
+		{
+			if (key != other.key) return key < other.key;
+			if (a != other.a) return a < other.a;
+			return b < other.b;
+		}
+	};
+	std::vector<Edge> edges;
+	edges.reserve(static_cast<size_t>(n) * k);
+	for (int a = 0; a < n; a++) {
+		const tour_t* near = neighbors.of(a);
+		for (int m = 0; m < k; m++) {
+			Edge e = { static_cast<double>(sq_dist(world.cities, a, near[m])),
+					   std::min<int>(a, near[m]), std::max<int>(a, near[m]) };
+			edges.push_back(e);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	edges.erase(std::unique(edges.begin(), edges.end(), [](const Edge& x, const Edge& y) {
+		return x.a == y.a && x.b == y.b;
+	}), edges.end());
+
+	if (individual > 0) {
+		for (size_t e = 0; e < edges.size(); e++) {
+			philox_block r = seeding_block(seed, individual, static_cast<int>(e / 4));
+			edges[e].key *= 1.0 + greedy_noise * (rng_uniform(r.v[e % 4]) - 0.5);
+		}
+		std::sort(edges.begin(), edges.end());
+	}
+
+	// Match the edges, with a union-find over the fragments
+	std::vector<int> adj(2 * n, -1), degree(n, 0), parent(n);
+	for (int c = 0; c < n; c++)
+		parent[c] = c;
+	auto find = [&parent](int c) {
+		while (parent[c] != c)
+			c = parent[c] = parent[parent[c]];
+		return c;
+	};
+	for (const Edge& e : edges) {
+		if (degree[e.a] == 2 || degree[e.b] == 2)
+			continue;
+		int ra = find(e.a), rb = find(e.b);
+		if (ra == rb)
+			continue;
+		parent[ra] = rb;
+		adj[2 * e.a + degree[e.a]++] = e.b;
+		adj[2 * e.b + degree[e.b]++] = e.a;
+	}
+
+	// Join the fragments, starting from the lowest numbered free end
+	std::vector<char> visited(n, 0);
+	std::vector<int> ends;
+	for (int c = 0; c < n; c++)
+		if (degree[c] < 2)
+			ends.push_back(c);
+
+	int count = 0;
+	int city = ends.front();
+	while (true) {
+		// Walk the fragment
+		int prev = -1;
+		while (city >= 0) {
+			tour[count++] = static_cast<tour_t>(city);
+			visited[city] = 1;
+			int next = adj[2 * city] != prev ? adj[2 * city] : adj[2 * city + 1];
+			prev = city;
+			city = (next >= 0 && !visited[next]) ? next : -1;
+		}
+		if (count == n)
+			break;
+
+		// Nearest free end of another fragment
+		int last = prev;
+		int best = -1;
+		long long best_sq = 0;
+		const tour_t* near = neighbors.of(last);
+		for (int m = 0; m < k && best < 0; m++)
+			if (!visited[near[m]] && degree[near[m]] < 2)
+				best = near[m];
+		if (best < 0) {
+			for (int end : ends) {
+				if (visited[end])
+					continue;
+				long long sq = sq_dist(world.cities, last, end);
+				if (best < 0 || sq < best_sq) {
+					best = end;
+					best_sq = sq;
+				}
+			}
+		}
+		city = best;
+	}
+}
+
+/*
+	Position of a point along a Hilbert curve covering 2^order x 2^order
+*/
+static uint64_t hilbert_index(uint32_t x, uint32_t y, int order)
+{
+	uint32_t n = 1u << order;
+	uint64_t d = 0;
+	for (uint32_t s = n / 2; s > 0; s /= 2) {
+		uint32_t rx = (x & s) > 0;
+		uint32_t ry = (y & s) > 0;
+		d += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+		if (ry == 0) {
+			if (rx == 1) {
+				x = n - 1 - x;
+				y = n - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return d;
+}
+
+/*
+	Cities in Hilbert curve order. Every individual but the first shifts the
+	curve by a random offset, wrapping around, to build different tours.
+*/
+static void hilbert_tour(tour_t* tour, const World& world, int seed, int individual)
+{
+	int n = world.num_cities;
+	const City* cities = world.cities;
+
+	int min_x = cities[0].x, min_y = cities[0].y, max_x = min_x, max_y = min_y;
+	for (int c = 1; c < n; c++) {
+		min_x = std::min(min_x, cities[c].x); max_x = std::max(max_x, cities[c].x);
+		min_y = std::min(min_y, cities[c].y); max_y = std::max(max_y, cities[c].y);
+	}
+	double span = std::max(1, std::max(max_x - min_x, max_y - min_y));
+	uint32_t mask = (1u << hilbert_order) - 1;
+	double scale = mask / span;
+
+	uint32_t dx = 0, dy = 0;
+	if (individual > 0) {
+		philox_block r = seeding_block(seed, individual, 0);
+		dx = r.v[0] & mask;
+		dy = r.v[1] & mask;
+	}
+
+	std::vector<std::pair<uint64_t, int>> order(n);
+	for (int c = 0; c < n; c++) {
+		uint32_t x = (static_cast<uint32_t>((cities[c].x - min_x) * scale) + dx) & mask;
+		uint32_t y = (static_cast<uint32_t>((cities[c].y - min_y) * scale) + dy) & mask;
+		order[c] = std::make_pair(hilbert_index(x, y, hilbert_order), c);
+	}
+	std::sort(order.begin(), order.end());
+	for (int c = 0; c < n; c++)
+		tour[c] = static_cast<tour_t>(order[c].second);
+}
+
+void seed_tours(tour_t* tours, int numIndividuals, const World& world, int seed,
+				seeding_t method, float random_fraction, ThreadPool& pool)
+{
+	int n = world.num_cities;
+	int num_random = static_cast<int>(std::lround(std::min(1.0f, std::max(0.0f, random_fraction)) * numIndividuals));
+	if (method == seeding_t::random)
+		num_random = numIndividuals;
+	int num_built = numIndividuals - num_random;
+
+	// The random tours, the same as a fully random population's first ones
+	init_tours(&tours[static_cast<size_t>(num_built) * n], num_random, n, seed);
+	if (num_built == 0)
+		return;
+
+	NeighborLists* neighbors = nullptr;
+	if (method != seeding_t::hilbert)
+		neighbors = new NeighborLists(world, seed_neighbors);
+
+	pool.parallel_for(0, num_built, seed_grain, [&](int begin, int end, int) {
+		for (int i = begin; i < end; i++) {
+			tour_t* tour = &tours[static_cast<size_t>(i) * n];
+			if (method == seeding_t::nearest_neighbor)
+				nearest_neighbor_tour(tour, world, *neighbors, seed, i);
+			else if (method == seeding_t::greedy)
+				greedy_tour(tour, world, *neighbors, seed, i);
+			else
+				hilbert_tour(tour, world, seed, i);
+		}
+	});
+
+	delete neighbors;
+}
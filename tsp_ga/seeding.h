@@ -0,0 +1,40 @@
+//
+//  seeding.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__seeding__
+#define __tsp_ga__seeding__
+
+#include "world.h"
+#include "thread_pool.h"
+
+/*
+ Ways of building the tours of the first generation
+ */
+enum class seeding_t
+{
+	random,				// Random permutations
+	nearest_neighbor,	// Nearest neighbor walks from random starting cities
+	greedy,				// Greedy edge matching, on randomly perturbed edge lengths
+	hilbert				// Hilbert curve order, with the curve randomly shifted
+};
+
+/*
+ Fills the tours of the first generation. The first individuals are built
+ with the chosen method, the remaining random_fraction of them are random
+ permutations (init_tours), to keep the population diverse. The result
+ only depends on the seed, not on the number of threads.
+
+ tours           : Destination, world.num_cities entries per individual
+ numIndividuals  : The number of individuals to initialize
+ world           : The world whose cities are visited
+ seed            : Seed for random number generation
+ method          : How the non random tours are built
+ random_fraction : Fraction of random tours, in [0, 1]
+ pool            : Threads to build the tours on
+ */
+void seed_tours(tour_t* tours, int numIndividuals, const World& world, int seed,
+				seeding_t method, float random_fraction, ThreadPool& pool);
+
+#endif /* defined(__tsp_ga__seeding__) */
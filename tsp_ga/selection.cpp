@@ -0,0 +1,90 @@
+//
+//  selection.cpp
+//  tsp_ga
+//
+
+#include "selection.h"
+#include "population.h"
+#include "rng.h"
+
+AliasTable::AliasTable(int size)
+:
+	size(size)
+{
+	prob  = new float[size];
+	alias = new int[size];
+	small = new int[size];
+	large = new int[size];
+}
+
+AliasTable::~AliasTable()
+{
+	delete[] prob;
+	delete[] alias;
+	delete[] small;
+	delete[] large;
+}
+
+void AliasTable::build(const Population& pop)
+{
+	build(pop.fitness);
+}
+
+void AliasTable::build(const float* fitness)
+{
+	float sum = 0.0f;
+	for (int i = 0; i < size; i++)
+		sum += fitness[i];
+	float scale = size / sum;
+	
+	// Scale the probabilities to an average of 1 and split them in two groups
+	int num_small = 0, num_large = 0;
+	for (int i = 0; i < size; i++) {
+		prob[i] = fitness[i] * scale;
+		if (prob[i] < 1.0f)
+			small[num_small++] = i;
+		else
+			large[num_large++] = i;
+	}
+	
+	// Fill every small column up with a large one
+	while (num_small > 0 && num_large > 0) {
+		int s = small[--num_small];
+		int l = large[--num_large];
+		alias[s] = l;
+		prob[l] = (prob[l] + prob[s]) - 1.0f;
+		if (prob[l] < 1.0f)
+			small[num_small++] = l;
+		else
+			large[num_large++] = l;
+	}
+	
+	// Whatever is left is full, up to rounding errors
+	while (num_large > 0) {
+		int l = large[--num_large];
+		prob[l] = 1.0f;
+		alias[l] = l;
+	}
+	while (num_small > 0) {
+		int s = small[--num_small];
+		prob[s] = 1.0f;
+		alias[s] = s;
+	}
+}
+
+int AliasTable::draw(const uint32_t words[2]) const
+{
+	int column = rng_below(words[0], size);
+	return rng_uniform(words[1]) < prob[column] ? column : alias[column];
+}
+
+int tournament_selection(const Population& pop, int size, const uint32_t words[])
+{
+	int best = rng_below(words[0], pop.numIndividuals);
+	for (int i = 1; i < size; i++) {
+		int competitor = rng_below(words[i], pop.numIndividuals);
+		if (pop.fitness[competitor] > pop.fitness[best])
+			best = competitor;
+	}
+	return best;
+}
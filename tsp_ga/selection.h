@@ -0,0 +1,77 @@
+//
+//  selection.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__selection__
+#define __tsp_ga__selection__
+
+#include <cstdint>
+
+#include "world.h"
+
+struct Population;
+
+/*
+ Parent selection methods
+ */
+enum class selection_t
+{
+	roulette,	// Binary search over the cumulative fitness probabilities
+	alias,		// Walker/Vose alias table, built once per generation
+	tournament	// Fittest of a few individuals drawn uniformly
+};
+
+// Largest supported tournament, the random words of a parent are one Philox block
+static const int max_tournament_size = 4;
+
+/*
+ Alias table over the fitnesses of a population, giving O(1) roulette
+ wheel draws (Vose, "A linear algorithm for generating random numbers
+ with a given distribution", 1991).
+ */
+struct AliasTable
+{
+	int size;
+	float* prob;	// Probability of keeping the drawn column
+	int* alias;		// Individual to take instead
+	int* small;		// Worklists used while building
+	int* large;
+	
+	explicit AliasTable(int size);
+	~AliasTable();
+	
+	/*
+	 Rebuilds the table for a population's current fitnesses
+	 */
+	void build(const Population& pop);
+	
+	/*
+	 The same from size fitnesses, as read back from the device
+	 */
+	void build(const float* fitness);
+	
+	/*
+	 Draws an individual
+	 
+	 words : Two random words
+	 */
+	int draw(const uint32_t words[2]) const;
+	
+private:
+	AliasTable(const AliasTable&);
+	AliasTable& operator=(const AliasTable&);
+};
+
+/*
+ Perform tournament selection of one parent
+ 
+ pop   : The population to select from
+ size  : The number of competitors, at most max_tournament_size
+ words : One random word per competitor
+ 
+ returns the index of the fittest competitor
+ */
+int tournament_selection(const Population& pop, int size, const uint32_t words[]);
+
+#endif /* defined(__tsp_ga__selection__) */
@@ -0,0 +1,143 @@
+//
+//  thread_pool.cpp
+//  tsp_ga
+//
+
+#include "thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int num_threads)
+:
+	job(nullptr), job_grain(1), job_id(0), busy(0), stop(false)
+{
+	if (num_threads <= 0)
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+	this->num_threads = num_threads;
+	
+	ranges.reset(new Range[num_threads]);
+	for (int i = 0; i < num_threads; i++)
+		ranges[i].begin = ranges[i].end = 0;
+	
+	for (int i = 1; i < num_threads; i++)
+		workers.push_back(std::thread(&ThreadPool::worker_loop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(job_lock);
+		stop = true;
+	}
+	job_start.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+void ThreadPool::parallel_for(int begin, int end, int grain, const loop_body& body)
+{
+	if (end <= begin)
+		return;
+	grain = std::max(grain, 1);
+	
+	// Nothing to share
+	if (num_threads == 1 || end - begin <= grain) {
+		for (int b = begin; b < end; b += grain)
+			body(b, std::min(b + grain, end), 0);
+		return;
+	}
+	
+	// Give every thread an equal share of the range
+	int total = end - begin;
+	for (int i = 0; i < num_threads; i++) {
+		std::lock_guard<std::mutex> guard(ranges[i].lock);
+		ranges[i].begin = begin + static_cast<int>(static_cast<long long>(total) * i / num_threads);
+		ranges[i].end   = begin + static_cast<int>(static_cast<long long>(total) * (i + 1) / num_threads);
+	}
+	
+	{
+		std::lock_guard<std::mutex> guard(job_lock);
+		job = &body;
+		job_grain = grain;
+		busy = num_threads - 1;
+		job_id++;
+	}
+	job_start.notify_all();
+	
+	run(0);
+	
+	std::unique_lock<std::mutex> guard(job_lock);
+	job_done.wait(guard, [this]() { return busy == 0; });
+	job = nullptr;
+}
+
+void ThreadPool::worker_loop(int thread)
+{
+	unsigned long seen = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> guard(job_lock);
+			job_start.wait(guard, [&]() { return stop || job_id != seen; });
+			if (stop)
+				return;
+			seen = job_id;
+		}
+		
+		run(thread);
+		
+		{
+			std::lock_guard<std::mutex> guard(job_lock);
+			busy--;
+		}
+		job_done.notify_one();
+	}
+}
+
+void ThreadPool::run(int thread)
+{
+	int begin, end;
+	while (true) {
+		if (take(thread, begin, end))
+			(*job)(begin, end, thread);
+		else if (!steal(thread))
+			break;
+	}
+}
+
+bool ThreadPool::take(int thread, int& begin, int& end)
+{
+	Range& own = ranges[thread];
+	std::lock_guard<std::mutex> guard(own.lock);
+	if (own.begin >= own.end)
+		return false;
+	begin = own.begin;
+	end = std::min(own.begin + job_grain, own.end);
+	own.begin = end;
+	return true;
+}
+
+bool ThreadPool::steal(int thread)
+{
+	for (int i = 1; i < num_threads; i++) {
+		Range& victim = ranges[(thread + i) % num_threads];
+		int begin, end;
+		{
+			std::lock_guard<std::mutex> guard(victim.lock);
+			int remaining = victim.end - victim.begin;
+			if (remaining <= 0)
+				continue;
+			
+			// Take the back half, or everything that is left of a small range
+			int mid = remaining > job_grain ? victim.begin + remaining / 2 : victim.begin;
+			begin = mid;
+			end = victim.end;
+			victim.end = mid;
+		}
+		
+		Range& own = ranges[thread];
+		std::lock_guard<std::mutex> guard(own.lock);
+		own.begin = begin;
+		own.end = end;
+		return true;
+	}
+	return false;
+}
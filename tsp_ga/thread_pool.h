@@ -0,0 +1,81 @@
+//
+//  thread_pool.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__thread_pool__
+#define __tsp_ga__thread_pool__
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+/*
+ Fixed set of worker threads running parallel loops.
+ 
+ A loop's index range is split evenly between the threads. Each thread
+ takes chunks from the front of its own range and, once that is empty,
+ steals the back half of another thread's range.
+ */
+class ThreadPool
+{
+public:
+	/*
+	 body : Called with [begin, end) and the index of the running thread
+	 */
+	typedef std::function<void(int begin, int end, int thread)> loop_body;
+	
+	/*
+	 num_threads : The number of threads, including the caller's;
+	               0 uses every hardware thread
+	 */
+	explicit ThreadPool(int num_threads);
+	~ThreadPool();
+	
+	int size() const
+	{
+		return num_threads;
+	}
+	
+	/*
+	 Runs body over [begin, end) in chunks of at most grain indices and
+	 returns once the whole range is done. The calling thread works as
+	 thread 0.
+	 */
+	void parallel_for(int begin, int end, int grain, const loop_body& body);
+	
+private:
+	struct Range
+	{
+		std::mutex lock;
+		int begin, end;
+		char pad[64];	// Keep the ranges of different threads apart
+	};
+	
+	int num_threads;
+	std::vector<std::thread> workers;
+	std::unique_ptr<Range[]> ranges;
+	
+	// Current loop
+	std::mutex job_lock;
+	std::condition_variable job_start;
+	std::condition_variable job_done;
+	const loop_body* job;
+	int job_grain;
+	unsigned long job_id;
+	int busy;
+	bool stop;
+	
+	void worker_loop(int thread);
+	void run(int thread);
+	bool take(int thread, int& begin, int& end);
+	bool steal(int thread);
+	
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+};
+
+#endif /* defined(__tsp_ga__thread_pool__) */
@@ -0,0 +1,43 @@
+//
+//  timing.cpp
+//  tsp_ga
+//
+
+#include "timing.h"
+
+float end_clock(wall_clock::time_point start)
+{
+	return std::chrono::duration<float, std::milli>(wall_clock::now() - start).count();
+}
+
+const char* phase_name(phase_t phase)
+{
+	static const char* names[] = {
+		"Select", "Crossover", "Mutate", "Evaluate", "Breed", "Improve", "Elites", "Leader", "Log"
+	};
+	static_assert(sizeof(names) / sizeof(names[0]) == num_phases, "one name per phase_t");
+	return names[static_cast<int>(phase)];
+}
+
+void PhaseTimes::clear()
+{
+	for (int p = 0; p < num_phases; p++)
+		host_ms[p] = device_ms[p] = 0.0;
+}
+
+PhaseTimes& PhaseTimes::operator+=(const PhaseTimes& other)
+{
+	for (int p = 0; p < num_phases; p++) {
+		host_ms[p] += other.host_ms[p];
+		device_ms[p] += other.device_ms[p];
+	}
+	return *this;
+}
+
+bool PhaseTimes::empty() const
+{
+	for (int p = 0; p < num_phases; p++)
+		if (host_ms[p] != 0.0 || device_ms[p] != 0.0)
+			return false;
+	return true;
+}
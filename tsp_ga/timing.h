@@ -0,0 +1,141 @@
+//
+//  timing.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__timing__
+#define __tsp_ga__timing__
+
+#include <chrono>
+
+/*
+ Wall-clock timing. Times come from the monotonic steady_clock rather than
+ clock(), which counts the CPU time of the process: that misses the time the
+ GPU engine spends waiting on the device and adds up the time of every
+ thread of the CPU engine.
+ */
+typedef std::chrono::steady_clock wall_clock;
+
+/*
+ Milliseconds elapsed since start
+ */
+float end_clock(wall_clock::time_point start);
+
+/*
+ Phases of a generation, timed when GAOptions::profile is set
+ */
+enum class phase_t
+{
+	select,			// Parent selection
+	crossover,		// Crossover, or copying the first parent
+	mutate,			// Mutation, with its update of the tour length
+	evaluate,		// Fitnesses and fitness probabilities
+	breed,			// The fused breed kernel: the four phases above in one
+	improve,		// Local search
+	elites,			// Carrying the elites over
+	leader,			// Finding the leader, and reading it back from the device
+	log,			// Printing and logging the leader
+	LENGTH = log+1
+};
+
+static const int num_phases = static_cast<int>(phase_t::LENGTH);
+
+/*
+ Name of a phase, as in the stats columns
+ */
+const char* phase_name(phase_t phase);
+
+/*
+ Time spent in each phase of a run. Host times are summed over the threads
+ that ran the phase; device times come from OpenCL profiling events.
+ */
+struct PhaseTimes
+{
+	double host_ms[num_phases];
+	double device_ms[num_phases];
+
+	PhaseTimes()
+	{
+		clear();
+	}
+
+	void clear();
+
+	void add(phase_t phase, double ms) {
+		host_ms[static_cast<int>(phase)] += ms;
+	}
+	void add_device(phase_t phase, double ms) {
+		device_ms[static_cast<int>(phase)] += ms;
+	}
+
+	PhaseTimes& operator+=(const PhaseTimes& other);
+
+	/*
+	 Whether no time was recorded at all, as when the run was not profiled
+	 */
+	bool empty() const;
+};
+
+/*
+ Adds the time from its construction to its destruction to a phase; does
+ nothing without a PhaseTimes
+ */
+class ScopedPhase
+{
+private:
+	PhaseTimes* times;
+	phase_t phase;
+	wall_clock::time_point start;
+
+	ScopedPhase(const ScopedPhase&);
+	ScopedPhase& operator=(const ScopedPhase&);
+public:
+	ScopedPhase(PhaseTimes* times, phase_t phase)
+	:
+		times(times), phase(phase)
+	{
+		if (times != nullptr)
+			start = wall_clock::now();
+	}
+
+	~ScopedPhase()
+	{
+		if (times != nullptr)
+			times->add(phase, std::chrono::duration<double, std::milli>(wall_clock::now() - start).count());
+	}
+};
+
+/*
+ Times back-to-back phases with one clock read between two: mark() adds the
+ time since the previous mark to a phase. For the tight loops over children,
+ where a scope per phase would read the clock twice as often. Does nothing
+ without a PhaseTimes.
+ */
+class PhaseLap
+{
+private:
+	PhaseTimes* times;
+	wall_clock::time_point last;
+
+	PhaseLap(const PhaseLap&);
+	PhaseLap& operator=(const PhaseLap&);
+public:
+	PhaseLap(PhaseTimes* times)
+	:
+		times(times)
+	{
+		if (times != nullptr)
+			last = wall_clock::now();
+	}
+
+	void mark(phase_t phase)
+	{
+		if (times != nullptr) {
+			wall_clock::time_point now = wall_clock::now();
+			times->add(phase, std::chrono::duration<double, std::milli>(now - last).count());
+			last = now;
+		}
+	}
+};
+
+#endif /* defined(__tsp_ga__timing__) */
@@ -0,0 +1,84 @@
+/* trace_csv.cpp
+
+ Description   : Reads a binary leader trace (trace.h) and writes the
+                 timing and generation CSV files the logger would have
+                 written, or prints a summary of the trace. Build it with
+                 log.cpp, timing.cpp, trace.cpp, tour_simd.cpp and world.cpp.
+
+ Usage         : trace_csv <trace> [timing csv] [generation csv]
+ */
+
+// Native includes
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+// Program includes
+#include "world.h"
+#include "log.h"
+#include "trace.h"
+#include "tour_simd.h"
+
+using namespace std;
+
+int main(int argc, const char * argv[])
+{
+	if (argc != 2 && argc != 4) {
+		cerr << "Usage: trace_csv <trace> [timing csv] [generation csv]" << endl;
+		return 2;
+	}
+
+	TraceReader reader;
+	if (!reader.open(argv[1])) {
+		cerr << argv[1] << " is not a leader trace" << endl;
+		return 1;
+	}
+
+	int n = reader.cities_count();
+	vector<City> cities(n);
+	ofstream timing_csv, generation_csv;
+	if (argc == 4) {
+		timing_csv.open(argv[2]);
+		generation_csv.open(argv[3]);
+		if (!timing_csv.is_open() || !generation_csv.is_open()) {
+			cerr << "Cannot write the CSV files" << endl;
+			return 1;
+		}
+		timing_csv << "Generation,Time [ms],Fitness,Distance" << endl;
+	}
+
+	// The same rows as Logger::write_log, from the cities of each tour
+	TraceRecord record;
+	long long records = 0, changes = 0;
+	float best_fitness = 0.0f, best_distance = 0.0f;
+	int best_generation = 0;
+	while (reader.next(record)) {
+		if (record.changed) {
+			for (int c = 0; c < n; c++)
+				cities[c] = reader.cities()[record.tour[c]];
+			changes++;
+		}
+		records++;
+		if (records == 1 || record.fitness > best_fitness) {
+			best_fitness = record.fitness;
+			best_distance = euclid_path_length(cities.data(), n, default_simd());
+			best_generation = record.generation;
+		}
+		if (argc == 4) {
+			write_timing_row(timing_csv, record.generation, record.gen_time, record.fitness, cities.data(), n);
+			write_generation_row(generation_csv, cities.data(), n);
+		}
+	}
+	if (reader.failed()) {
+		cerr << "Malformed record after " << records << " records" << endl;
+		return 1;
+	}
+
+	if (argc == 2) {
+		cout << "Cities             : " << n << endl
+			 << "Generations logged : " << records << endl
+			 << "Leader changes     : " << changes << endl
+			 << "Best distance      : " << best_distance << " at generation " << best_generation << endl;
+	}
+	return 0;
+}
@@ -0,0 +1,338 @@
+//
+//  tour_simd.cpp
+//  tsp_ga
+//
+
+#include "tour_simd.h"
+
+#include <cmath>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#	define TOUR_SIMD_X86 1
+#	include <immintrin.h>
+#	define TARGET_AVX2   __attribute__((target("avx2")))
+#	define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+// The vector versions read the coordinates as interleaved (x, y) pairs
+static_assert(sizeof(City) == 2 * sizeof(int), "City must be two packed ints");
+
+simd_t detect_simd()
+{
+#ifdef TOUR_SIMD_X86
+	static const simd_t best =
+		__builtin_cpu_supports("avx512f") ? simd_t::avx512 :
+		__builtin_cpu_supports("avx2")    ? simd_t::avx2 :
+		                                    simd_t::scalar;
+	return best;
+#else
+	return simd_t::scalar;
+#endif
+}
+
+simd_t default_simd()
+{
+#ifdef TSP_GA_PREFER_AVX512
+	return detect_simd();
+#else
+	return detect_simd() == simd_t::avx512 ? simd_t::avx2 : detect_simd();
+#endif
+}
+
+const char* simd_name(simd_t simd)
+{
+	static const char* names[] = { "scalar", "avx2", "avx512" };
+	return names[static_cast<int>(simd)];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scalar versions, also used for the tails of the vector loops
+
+static unsigned sq_table_tail(const int* table, int stride, const tour_t* tour, int begin, int edges)
+{
+	// Unsigned, so a long tour wraps around like the vector sums
+	unsigned distance = 0;
+	for (int i = begin; i < edges; i++)
+		distance += table[tour[i] * stride + tour[i + 1]];
+	return distance;
+}
+
+static unsigned sq_coords_tail(const City* cities, const tour_t* tour, int begin, int edges)
+{
+	unsigned distance = 0;
+	for (int i = begin; i < edges; i++) {
+		int dx = cities[tour[i]].x - cities[tour[i + 1]].x;
+		int dy = cities[tour[i]].y - cities[tour[i + 1]].y;
+		distance += static_cast<unsigned>(dx*dx) + static_cast<unsigned>(dy*dy);
+	}
+	return distance;
+}
+
+static float euclid_table_tail(float distance, const int* table, int stride, const tour_t* tour, int begin, int edges)
+{
+	for (int i = begin; i < edges; i++)
+		distance += sqrtf(static_cast<float>(table[tour[i] * stride + tour[i + 1]]));
+	return distance;
+}
+
+static float euclid_path_tail(float distance, const City* path, int begin, int edges)
+{
+	for (int i = begin; i < edges; i++) {
+		int dx = path[i].x - path[i + 1].x;
+		int dy = path[i].y - path[i + 1].y;
+		distance += sqrtf(static_cast<float>(dx*dx + dy*dy));
+	}
+	return distance;
+}
+
+#ifdef TOUR_SIMD_X86
+
+////////////////////////////////////////////////////////////////////////////////
+// AVX2, 8 edges per step
+
+TARGET_AVX2 static inline __m256i load8(const tour_t* p)
+{
+	if (sizeof(tour_t) == 2)
+		return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+	return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+TARGET_AVX2 static inline unsigned hsum8(__m256i v)
+{
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+	return static_cast<unsigned>(_mm_cvtsi128_si32(s));
+}
+
+TARGET_AVX2 static inline __m256i sq_edges8(const int* table, __m256i stride, const tour_t* tour)
+{
+	__m256i ix = _mm256_add_epi32(_mm256_mullo_epi32(load8(tour), stride), load8(tour + 1));
+	return _mm256_i32gather_epi32(table, ix, 4);
+}
+
+TARGET_AVX2 static int sq_table_avx2(const int* table, int stride, const tour_t* tour, int edges)
+{
+	__m256i vstride = _mm256_set1_epi32(stride);
+	__m256i sum = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 8 <= edges; i += 8)
+		sum = _mm256_add_epi32(sum, sq_edges8(table, vstride, &tour[i]));
+	return static_cast<int>(hsum8(sum) + sq_table_tail(table, stride, tour, i, edges));
+}
+
+// Squared lengths of 8 edges, from their two ends as interleaved (x, y)
+// pairs of 4 edges each, returned in edge order
+TARGET_AVX2 static inline __m256i sq_pairs8(__m256i a0, __m256i a1, __m256i b0, __m256i b1)
+{
+	__m256i d0 = _mm256_sub_epi32(a0, b0);
+	__m256i d1 = _mm256_sub_epi32(a1, b1);
+	__m256i sq = _mm256_hadd_epi32(_mm256_mullo_epi32(d0, d0), _mm256_mullo_epi32(d1, d1));
+	return _mm256_permute4x64_epi64(sq, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+// Coordinates of 4 cities as interleaved (x, y) pairs
+TARGET_AVX2 static inline __m256i gather4(const City* cities, __m128i ix)
+{
+	return _mm256_i32gather_epi64(reinterpret_cast<const long long*>(cities), ix, 8);
+}
+
+TARGET_AVX2 static int sq_coords_avx2(const City* cities, const tour_t* tour, int edges)
+{
+	__m256i sum = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 8 <= edges; i += 8) {
+		__m256i a = load8(&tour[i]);
+		__m256i b = load8(&tour[i + 1]);
+		__m256i sq = sq_pairs8(gather4(cities, _mm256_castsi256_si128(a)), gather4(cities, _mm256_extracti128_si256(a, 1)),
+							   gather4(cities, _mm256_castsi256_si128(b)), gather4(cities, _mm256_extracti128_si256(b, 1)));
+		sum = _mm256_add_epi32(sum, sq);
+	}
+	return static_cast<int>(hsum8(sum) + sq_coords_tail(cities, tour, i, edges));
+}
+
+TARGET_AVX2 static float euclid_table_avx2(const int* table, int stride, const tour_t* tour, int edges)
+{
+	__m256i vstride = _mm256_set1_epi32(stride);
+	float roots[8];
+	float distance = 0.0f;
+	int i = 0;
+	for (; i + 8 <= edges; i += 8) {
+		_mm256_storeu_ps(roots, _mm256_sqrt_ps(_mm256_cvtepi32_ps(sq_edges8(table, vstride, &tour[i]))));
+		for (int j = 0; j < 8; j++)
+			distance += roots[j];
+	}
+	return euclid_table_tail(distance, table, stride, tour, i, edges);
+}
+
+TARGET_AVX2 static float euclid_path_avx2(const City* path, int edges)
+{
+	float roots[8];
+	float distance = 0.0f;
+	int i = 0;
+	for (; i + 8 <= edges; i += 8) {
+		// The path is contiguous, each edge ends where the next one starts
+		const __m256i* xy = reinterpret_cast<const __m256i*>(&path[i]);
+		const __m256i* next = reinterpret_cast<const __m256i*>(&path[i + 1]);
+		__m256i sq = sq_pairs8(_mm256_loadu_si256(xy), _mm256_loadu_si256(xy + 1),
+							   _mm256_loadu_si256(next), _mm256_loadu_si256(next + 1));
+		_mm256_storeu_ps(roots, _mm256_sqrt_ps(_mm256_cvtepi32_ps(sq)));
+		for (int j = 0; j < 8; j++)
+			distance += roots[j];
+	}
+	return euclid_path_tail(distance, path, i, edges);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// AVX-512, 16 edges per step
+//
+// GCC 12's avx512fintrin.h implements most plain intrinsics (shifts, inserts,
+// extracts, gathers, reductions) as masked ones with an undefined source,
+// which it then reports as maybe uninitialized once inlined here
+
+#if defined(__GNUC__) && !defined(__clang__)
+#	pragma GCC diagnostic push
+#	pragma GCC diagnostic ignored "-Wuninitialized"
+#	pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+TARGET_AVX512 static inline __m512i load16(const tour_t* p)
+{
+	if (sizeof(tour_t) == 2)
+		return _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+	return _mm512_loadu_si512(p);
+}
+
+TARGET_AVX512 static inline __m512i sq_edges16(const int* table, __m512i stride, const tour_t* tour)
+{
+	__m512i ix = _mm512_add_epi32(_mm512_mullo_epi32(load16(tour), stride), load16(tour + 1));
+	return _mm512_i32gather_epi32(ix, table, 4);
+}
+
+TARGET_AVX512 static int sq_table_avx512(const int* table, int stride, const tour_t* tour, int edges)
+{
+	__m512i vstride = _mm512_set1_epi32(stride);
+	__m512i sum = _mm512_setzero_si512();
+	int i = 0;
+	for (; i + 16 <= edges; i += 16)
+		sum = _mm512_add_epi32(sum, sq_edges16(table, vstride, &tour[i]));
+	unsigned total = static_cast<unsigned>(_mm512_reduce_add_epi32(sum));
+	return static_cast<int>(total + sq_table_tail(table, stride, tour, i, edges));
+}
+
+// Squared lengths of 8 edges, from the interleaved (x, y) pairs of their ends
+TARGET_AVX512 static inline __m256i sq_pairs8x(__m512i a, __m512i b)
+{
+	__m512i d = _mm512_sub_epi32(a, b);
+	__m512i sq = _mm512_mullo_epi32(d, d);
+	return _mm512_cvtepi64_epi32(_mm512_add_epi32(sq, _mm512_srli_epi64(sq, 32)));
+}
+
+// Squared lengths of 16 edges, in edge order
+TARGET_AVX512 static inline __m512i sq_pairs16(__m512i a0, __m512i a1, __m512i b0, __m512i b1)
+{
+	return _mm512_inserti64x4(_mm512_castsi256_si512(sq_pairs8x(a0, b0)), sq_pairs8x(a1, b1), 1);
+}
+
+// Coordinates of 8 cities as interleaved (x, y) pairs
+TARGET_AVX512 static inline __m512i gather8(const City* cities, __m256i ix)
+{
+	return _mm512_i32gather_epi64(ix, reinterpret_cast<const long long*>(cities), 8);
+}
+
+TARGET_AVX512 static int sq_coords_avx512(const City* cities, const tour_t* tour, int edges)
+{
+	__m512i sum = _mm512_setzero_si512();
+	int i = 0;
+	for (; i + 16 <= edges; i += 16) {
+		__m512i a = load16(&tour[i]);
+		__m512i b = load16(&tour[i + 1]);
+		__m512i sq = sq_pairs16(gather8(cities, _mm512_castsi512_si256(a)), gather8(cities, _mm512_extracti64x4_epi64(a, 1)),
+								gather8(cities, _mm512_castsi512_si256(b)), gather8(cities, _mm512_extracti64x4_epi64(b, 1)));
+		sum = _mm512_add_epi32(sum, sq);
+	}
+	unsigned total = static_cast<unsigned>(_mm512_reduce_add_epi32(sum));
+	return static_cast<int>(total + sq_coords_tail(cities, tour, i, edges));
+}
+
+TARGET_AVX512 static float euclid_table_avx512(const int* table, int stride, const tour_t* tour, int edges)
+{
+	__m512i vstride = _mm512_set1_epi32(stride);
+	float roots[16];
+	float distance = 0.0f;
+	int i = 0;
+	for (; i + 16 <= edges; i += 16) {
+		_mm512_storeu_ps(roots, _mm512_sqrt_ps(_mm512_cvtepi32_ps(sq_edges16(table, vstride, &tour[i]))));
+		for (int j = 0; j < 16; j++)
+			distance += roots[j];
+	}
+	return euclid_table_tail(distance, table, stride, tour, i, edges);
+}
+
+TARGET_AVX512 static float euclid_path_avx512(const City* path, int edges)
+{
+	float roots[16];
+	float distance = 0.0f;
+	int i = 0;
+	for (; i + 16 <= edges; i += 16) {
+		__m512i sq = sq_pairs16(_mm512_loadu_si512(&path[i]), _mm512_loadu_si512(&path[i + 8]),
+								_mm512_loadu_si512(&path[i + 1]), _mm512_loadu_si512(&path[i + 9]));
+		_mm512_storeu_ps(roots, _mm512_sqrt_ps(_mm512_cvtepi32_ps(sq)));
+		for (int j = 0; j < 16; j++)
+			distance += roots[j];
+	}
+	return euclid_path_tail(distance, path, i, edges);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#	pragma GCC diagnostic pop
+#endif
+
+#endif /* TOUR_SIMD_X86 */
+
+////////////////////////////////////////////////////////////////////////////////
+// Dispatch
+
+int sq_tour_length(const int* table, int stride, const tour_t* tour, int length, simd_t simd)
+{
+#ifdef TOUR_SIMD_X86
+	if (simd == simd_t::avx512)
+		return sq_table_avx512(table, stride, tour, length - 1);
+	if (simd == simd_t::avx2)
+		return sq_table_avx2(table, stride, tour, length - 1);
+#endif
+	return static_cast<int>(sq_table_tail(table, stride, tour, 0, length - 1));
+}
+
+int sq_tour_length(const City* cities, const tour_t* tour, int length, simd_t simd)
+{
+#ifdef TOUR_SIMD_X86
+	if (simd == simd_t::avx512)
+		return sq_coords_avx512(cities, tour, length - 1);
+	if (simd == simd_t::avx2)
+		return sq_coords_avx2(cities, tour, length - 1);
+#endif
+	return static_cast<int>(sq_coords_tail(cities, tour, 0, length - 1));
+}
+
+float euclid_tour_length(const int* table, int stride, const tour_t* tour, int length, simd_t simd)
+{
+#ifdef TOUR_SIMD_X86
+	if (simd == simd_t::avx512)
+		return euclid_table_avx512(table, stride, tour, length - 1);
+	if (simd == simd_t::avx2)
+		return euclid_table_avx2(table, stride, tour, length - 1);
+#endif
+	return euclid_table_tail(0.0f, table, stride, tour, 0, length - 1);
+}
+
+float euclid_path_length(const City* path, int length, simd_t simd)
+{
+#ifdef TOUR_SIMD_X86
+	if (simd == simd_t::avx512)
+		return euclid_path_avx512(path, length - 1);
+	if (simd == simd_t::avx2)
+		return euclid_path_avx2(path, length - 1);
+#endif
+	return euclid_path_tail(0.0f, path, 0, length - 1);
+}
@@ -0,0 +1,65 @@
+//
+//  tour_simd.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__tour_simd__
+#define __tsp_ga__tour_simd__
+
+#include "world.h"
+
+/*
+ Tour length kernels, vectorized along the tour with gathers.
+
+ Each function has a scalar, an AVX2 and an AVX-512 version, picked at run
+ time. The squared lengths are integer sums, so every version returns the
+ same value. The euclidean lengths compute the square roots in vectors but
+ add them up in tour order, so they also match the scalar version exactly.
+ 
+ The simd argument must be supported by the CPU, see detect_simd().
+ */
+enum class simd_t
+{
+	scalar,
+	avx2,
+	avx512
+};
+
+/*
+ Best instruction set supported by this CPU
+ */
+simd_t detect_simd();
+
+/*
+ Instruction set used by the engine: the best supported one, except that
+ AVX-512 is only used when built with TSP_GA_PREFER_AVX512, as it measured
+ no faster than AVX2 at the usual city counts
+ */
+simd_t default_simd();
+
+const char* simd_name(simd_t simd);
+
+/*
+ Sum of the squared distances along an open tour, looked up in a dense
+ table with rows of stride elements
+ */
+int sq_tour_length(const int* table, int stride, const tour_t* tour, int length, simd_t simd);
+
+/*
+ Sum of the squared distances along an open tour, computed from the city
+ coordinates
+ */
+int sq_tour_length(const City* cities, const tour_t* tour, int length, simd_t simd);
+
+/*
+ Sum of the euclidean distances along an open tour, from a dense table of
+ squared distances
+ */
+float euclid_tour_length(const int* table, int stride, const tour_t* tour, int length, simd_t simd);
+
+/*
+ Sum of the euclidean distances along a path of cities, in order
+ */
+float euclid_path_length(const City* path, int length, simd_t simd);
+
+#endif /* defined(__tsp_ga__tour_simd__) */
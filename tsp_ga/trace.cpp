@@ -0,0 +1,321 @@
+//
+//  trace.cpp
+//  tsp_ga
+//
+
+#include "trace.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const uint8_t tag_tour = 1;
+static const uint8_t tag_delta = 2;
+static const uint16_t flag_delta = 1;
+static const size_t header_bytes = 12;
+
+static void put16(std::vector<uint8_t>& out, uint32_t v)
+{
+	out.push_back(static_cast<uint8_t>(v));
+	out.push_back(static_cast<uint8_t>(v >> 8));
+}
+
+static void put32(std::vector<uint8_t>& out, uint32_t v)
+{
+	for (int i = 0; i < 4; i++)
+		out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+static void put_float(std::vector<uint8_t>& out, float v)
+{
+	uint32_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	put32(out, bits);
+}
+
+static void put_varint(std::vector<uint8_t>& out, uint32_t v)
+{
+	while (v >= 0x80) {
+		out.push_back(static_cast<uint8_t>(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back(static_cast<uint8_t>(v));
+}
+
+static uint32_t get32(const uint8_t* in)
+{
+	return in[0] | (in[1] << 8) | (in[2] << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+static uint64_t location_key(const City& city)
+{
+	return (static_cast<uint64_t>(static_cast<uint32_t>(city.x)) << 32) | static_cast<uint32_t>(city.y);
+}
+
+static size_t packed_bytes(int num_cities)
+{
+	return (static_cast<size_t>(num_cities) * tour_bits(num_cities) + 7) / 8;
+}
+
+TraceEncoder::TraceEncoder(bool delta)
+:
+	delta(delta), num_cities(0), last_generation(0), stamp(0)
+{
+}
+
+bool TraceEncoder::to_indices(const City* cities)
+{
+	// Take the first city of the table at each location not taken yet by
+	// this tour, so that cities sharing a location still make a permutation
+	stamp++;
+	for (int c = 0; c < num_cities; c++) {
+		auto it = first_index.find(location_key(cities[c]));
+		if (it == first_index.end())
+			return false;
+		int i = it->second;
+		while (i >= 0 && taken[i] == stamp)
+			i = same_location[i];
+		if (i < 0)
+			return false;
+		taken[i] = stamp;
+		next_tour[c] = static_cast<tour_t>(i);
+	}
+	return true;
+}
+
+bool TraceEncoder::add(std::vector<uint8_t>& out, int generation, float gen_time, float fitness,
+					   const City* cities, int num_cities)
+{
+	bool first = this->num_cities == 0;
+	if (first) {
+		// The first leader becomes the city table
+		this->num_cities = num_cities;
+		same_location.assign(num_cities, -1);
+		taken.assign(num_cities, 0);
+		next_tour.resize(num_cities);
+		for (int i = num_cities - 1; i >= 0; i--) {
+			auto it = first_index.find(location_key(cities[i]));
+			if (it != first_index.end())
+				same_location[i] = it->second;
+			first_index[location_key(cities[i])] = i;
+		}
+
+		put32(out, trace_magic);
+		put16(out, trace_version);
+		put16(out, delta ? flag_delta : 0);
+		put32(out, static_cast<uint32_t>(num_cities));
+		for (int i = 0; i < num_cities; i++) {
+			put32(out, static_cast<uint32_t>(cities[i].x));
+			put32(out, static_cast<uint32_t>(cities[i].y));
+		}
+	}
+	if (num_cities != this->num_cities || !to_indices(cities))
+		return false;
+
+	bool changed = first || !std::equal(next_tour.begin(), next_tour.end(), tour.begin());
+
+	// The positions that changed, if a delta may be shorter than the full tour
+	std::vector<uint8_t> changes;
+	bool as_delta = false;
+	if (changed && !first && delta) {
+		int count = 0;
+		for (int c = 0; c < num_cities; c++)
+			count += next_tour[c] != tour[c];
+		put_varint(changes, count);
+		int last = -1;
+		for (int c = 0; c < num_cities && changes.size() < packed_bytes(num_cities); c++) {
+			if (next_tour[c] != tour[c]) {
+				put_varint(changes, c - last - 1);
+				put_varint(changes, next_tour[c]);
+				last = c;
+			}
+		}
+		as_delta = changes.size() < packed_bytes(num_cities);
+	}
+
+	int32_t step = generation - last_generation;
+	out.push_back(changed ? (as_delta ? tag_tour | tag_delta : tag_tour) : 0);
+	put_varint(out, (static_cast<uint32_t>(step) << 1) ^ static_cast<uint32_t>(step >> 31));
+	put_float(out, gen_time);
+	put_float(out, fitness);
+	last_generation = generation;
+
+	if (as_delta) {
+		out.insert(out.end(), changes.begin(), changes.end());
+	} else if (changed) {
+		// Pack the indices, lowest bits first
+		int bits = tour_bits(num_cities);
+		uint64_t acc = 0;
+		int held = 0;
+		for (int c = 0; c < num_cities; c++) {
+			acc |= static_cast<uint64_t>(next_tour[c]) << held;
+			held += bits;
+			while (held >= 8) {
+				out.push_back(static_cast<uint8_t>(acc));
+				acc >>= 8;
+				held -= 8;
+			}
+		}
+		if (held > 0)
+			out.push_back(static_cast<uint8_t>(acc));
+	}
+	if (changed)
+		tour.swap(next_tour);
+	if (next_tour.size() != tour.size())
+		next_tour.resize(num_cities);
+	return true;
+}
+
+TraceReader::TraceReader()
+:
+	data(nullptr), size(0), offset(0), error(false), num_cities(0), generation(0)
+{
+}
+
+TraceReader::~TraceReader()
+{
+	close();
+}
+
+bool TraceReader::open(const char* path)
+{
+	close();
+
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(header_bytes)) {
+		::close(fd);
+		return false;
+	}
+	void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED)
+		return false;
+	data = static_cast<const uint8_t*>(mapped);
+	size = st.st_size;
+
+	// The header and the city table
+	uint32_t count = get32(data + 8);
+	if (get32(data) != trace_magic || (data[4] | (data[5] << 8)) != trace_version ||
+		count == 0 || count - 1 > static_cast<tour_t>(~0u) ||
+		size < header_bytes + 8 * static_cast<size_t>(count)) {
+		close();
+		return false;
+	}
+	num_cities = static_cast<int>(count);
+	table.resize(num_cities);
+	const uint8_t* in = data + header_bytes;
+	for (int i = 0; i < num_cities; i++, in += 8) {
+		table[i].x = static_cast<int>(get32(in));
+		table[i].y = static_cast<int>(get32(in + 4));
+	}
+	offset = header_bytes + 8 * static_cast<size_t>(num_cities);
+	return true;
+}
+
+void TraceReader::close()
+{
+	if (data != nullptr)
+		munmap(const_cast<uint8_t*>(data), size);
+	data = nullptr;
+	size = offset = 0;
+	error = false;
+	num_cities = generation = 0;
+	table.clear();
+	tour.clear();
+}
+
+bool TraceReader::next(TraceRecord& record)
+{
+	if (data == nullptr || error || offset == size)
+		return false;
+
+	const uint8_t* in = data + offset;
+	const uint8_t* end = data + size;
+	auto varint = [&](uint32_t& v) {
+		v = 0;
+		for (int shift = 0; shift < 35; shift += 7) {
+			if (in == end)
+				return false;
+			uint8_t byte = *in++;
+			v |= static_cast<uint32_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	};
+
+	error = true;
+	uint8_t tag = *in++;
+	uint32_t step;
+	if ((tag & ~(tag_tour | tag_delta)) != 0 || !varint(step) || end - in < 8)
+		return false;
+	generation += static_cast<int32_t>((step >> 1) ^ (0u - (step & 1)));
+	uint32_t bits = get32(in);
+	memcpy(&record.gen_time, &bits, sizeof(bits));
+	bits = get32(in + 4);
+	memcpy(&record.fitness, &bits, sizeof(bits));
+	in += 8;
+
+	// The first record must carry its tour, in full
+	record.changed = (tag & tag_tour) != 0;
+	if (tour.empty() && (!record.changed || (tag & tag_delta) != 0))
+		return false;
+
+	if (record.changed && (tag & tag_delta) != 0) {
+		uint32_t count, gap, city;
+		if (!varint(count) || count > static_cast<uint32_t>(num_cities))
+			return false;
+		int64_t position = -1;
+		for (uint32_t k = 0; k < count; k++) {
+			if (!varint(gap) || !varint(city))
+				return false;
+			position += static_cast<int64_t>(gap) + 1;
+			if (position >= num_cities || city >= static_cast<uint32_t>(num_cities))
+				return false;
+			tour[position] = static_cast<tour_t>(city);
+		}
+	} else if (record.changed) {
+		if (static_cast<size_t>(end - in) < packed_bytes(num_cities))
+			return false;
+		tour.resize(num_cities);
+		int bits_per_city = tour_bits(num_cities);
+		uint64_t mask = (1ull << bits_per_city) - 1;
+		uint64_t acc = 0;
+		int held = 0;
+		for (int c = 0; c < num_cities; c++) {
+			while (held < bits_per_city) {
+				acc |= static_cast<uint64_t>(*in++) << held;
+				held += 8;
+			}
+			uint64_t city = acc & mask;
+			acc >>= bits_per_city;
+			held -= bits_per_city;
+			if (city >= static_cast<uint64_t>(num_cities))
+				return false;
+			tour[c] = static_cast<tour_t>(city);
+		}
+	}
+
+	// Every tour must visit every city once
+	if (record.changed) {
+		seen.assign(num_cities, 0);
+		for (int c = 0; c < num_cities; c++) {
+			if (seen[tour[c]])
+				return false;
+			seen[tour[c]] = 1;
+		}
+	}
+
+	record.generation = generation;
+	record.tour = tour.data();
+	offset = in - data;
+	error = false;
+	return true;
+}
@@ -0,0 +1,140 @@
+//
+//  trace.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__trace__
+#define __tsp_ga__trace__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+#include "world.h"
+
+/*
+ Binary trace of the leaders of a run, in place of the *_gen.csv text.
+
+ A trace starts with a header, all integers little endian:
+
+   magic u32 | version u16 | flags u16 | num_cities u32
+   num_cities cities, x i32 and y i32 each
+
+ The city table is the first leader's tour, so every tour after it is a
+ permutation of indices into the table. Then comes one record per logged
+ generation:
+
+   tag u8 | generation step zigzag varint | time f32 | fitness f32 | tour
+
+ The generation is the step from the previous record's (from 0 for the
+ first). The tour is only there if bit 0 of the tag is set, when the
+ leader's tour changed. It is either the indices packed with
+ tour_bits(num_cities) bits each, or, with bit 1 of the tag, the positions
+ that differ from the previous tour: a varint count, then for each a varint
+ gap from the previous position and the varint index. The encoder picks
+ the shorter of the two, and only uses deltas if asked to (flag bit 0).
+ */
+
+static const uint32_t trace_magic = 0x54475354;	// "TSGT"
+static const uint16_t trace_version = 1;
+
+/*
+ Encodes the records of a trace
+ */
+class TraceEncoder
+{
+private:
+	bool delta;						// Whether tours may be written as deltas
+	int num_cities;					// 0 until the first record
+	int last_generation;
+	std::unordered_map<uint64_t, int> first_index;	// First city of the table at a location
+	std::vector<int> same_location;	// Next city of the table at the same location, or -1
+	std::vector<unsigned> taken;	// Stamp of the tour a city was last taken by
+	unsigned stamp;
+	std::vector<tour_t> tour;		// The last tour written
+	std::vector<tour_t> next_tour;
+
+	bool to_indices(const City* cities);
+public:
+	TraceEncoder(bool delta);
+
+	/*
+	 Appends the record of a generation, and the header before the first one
+
+	 out    : Receives the encoded bytes
+	 cities : The leader's tour, num_cities cities
+	 returns false, appending nothing, if the tour does not visit the cities
+	 of the first leader, each once
+	 */
+	bool add(std::vector<uint8_t>& out, int generation, float gen_time, float fitness,
+			 const City* cities, int num_cities);
+};
+
+/*
+ A record of a trace, as decoded
+ */
+struct TraceRecord
+{
+	int generation;
+	float gen_time;
+	float fitness;
+	bool changed;			// The tour differs from the previous record's
+	const tour_t* tour;		// The leader's tour, indices into the city table
+};
+
+/*
+ Reads a trace from a memory-mapped file, one record at a time, without
+ loading it into memory
+ */
+class TraceReader
+{
+private:
+	const uint8_t* data;
+	size_t size;
+	size_t offset;			// Of the next record
+	bool error;
+	int num_cities;
+	int generation;
+	std::vector<City> table;
+	std::vector<tour_t> tour;
+	std::vector<uint8_t> seen;
+
+	TraceReader(const TraceReader&);
+	TraceReader& operator=(const TraceReader&);
+public:
+	TraceReader();
+	~TraceReader();
+
+	/*
+	 Maps a trace; returns false if it cannot be read or is not a trace
+	 */
+	bool open(const char* path);
+	void close();
+
+	int cities_count() const {
+		return num_cities;
+	}
+
+	/*
+	 The city table, the first leader's tour
+	 */
+	const City* cities() const {
+		return table.data();
+	}
+
+	/*
+	 Decodes the next record, whose tour stays valid until the next call
+	 returns false at the end of the trace or if it is malformed
+	 */
+	bool next(TraceRecord& record);
+
+	/*
+	 Whether reading stopped at a malformed record rather than at the end
+	 */
+	bool failed() const {
+		return error;
+	}
+};
+
+#endif /* defined(__tsp_ga__trace__) */
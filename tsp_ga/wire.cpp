@@ -0,0 +1,118 @@
+//
+//  wire.cpp
+//  tsp_ga
+//
+
+#include "wire.h"
+
+#include <algorithm>
+
+static const uint32_t message_magic = 0x41475354;	// "TSGA"
+
+static void put32(std::vector<uint8_t>& out, uint32_t v)
+{
+	for (int i = 0; i < 4; i++)
+		out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+static uint32_t get32(const uint8_t* in)
+{
+	return in[0] | (in[1] << 8) | (in[2] << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+static size_t packed_bytes(int count, int num_cities)
+{
+	return (static_cast<size_t>(count) * num_cities * tour_bits(num_cities) + 7) / 8;
+}
+
+void encode_message(std::vector<uint8_t>& out, message_t type, int sender, int generation,
+					const tour_t* tours, const int* lengths, int count, int num_cities)
+{
+	size_t payload = count > 0 ? 4 + 4 * static_cast<size_t>(count) + packed_bytes(count, num_cities) : 0;
+
+	put32(out, message_magic);
+	out.push_back(static_cast<uint8_t>(type));
+	out.push_back(0);
+	out.push_back(static_cast<uint8_t>(sender));
+	out.push_back(static_cast<uint8_t>(sender >> 8));
+	put32(out, static_cast<uint32_t>(generation));
+	put32(out, static_cast<uint32_t>(payload));
+	if (count == 0)
+		return;
+
+	put32(out, static_cast<uint32_t>(count));
+	for (int k = 0; k < count; k++)
+		put32(out, static_cast<uint32_t>(lengths[k]));
+
+	// Pack the indices, lowest bits first
+	int bits = tour_bits(num_cities);
+	size_t total = static_cast<size_t>(count) * num_cities;
+	uint64_t acc = 0;
+	int held = 0;
+	for (size_t i = 0; i < total; i++) {
+		acc |= static_cast<uint64_t>(tours[i]) << held;
+		held += bits;
+		while (held >= 8) {
+			out.push_back(static_cast<uint8_t>(acc));
+			acc >>= 8;
+			held -= 8;
+		}
+	}
+	if (held > 0)
+		out.push_back(static_cast<uint8_t>(acc));
+}
+
+bool decode_header(const uint8_t* in, MessageHeader& header)
+{
+	if (get32(in) != message_magic)
+		return false;
+	header.type = static_cast<message_t>(in[4]);
+	header.sender = in[6] | (in[7] << 8);
+	header.generation = static_cast<int>(get32(in + 8));
+	header.payload_bytes = get32(in + 12);
+	return header.type >= message_t::hello && header.type <= message_t::bye;
+}
+
+long long decode_tour_count(const uint8_t* payload, size_t bytes)
+{
+	return bytes < 4 ? -1 : get32(payload);
+}
+
+int decode_tours(const uint8_t* payload, size_t bytes, int num_cities, int max_count,
+				 tour_t* tours, int* lengths)
+{
+	if (bytes < 4)
+		return -1;
+	uint32_t count = get32(payload);
+	if (count > static_cast<uint32_t>(max_count) ||
+		bytes != 4 + 4 * static_cast<size_t>(count) + packed_bytes(count, num_cities))
+		return -1;
+
+	const uint8_t* in = payload + 4;
+	for (uint32_t k = 0; k < count; k++, in += 4)
+		lengths[k] = static_cast<int>(get32(in));
+
+	// Unpack the indices, checking that every tour visits every city once
+	int bits = tour_bits(num_cities);
+	uint64_t mask = (1ull << bits) - 1;
+	uint64_t acc = 0;
+	int held = 0;
+	std::vector<char> seen(num_cities);
+	for (uint32_t k = 0; k < count; k++) {
+		std::fill(seen.begin(), seen.end(), 0);
+		for (int c = 0; c < num_cities; c++) {
+			while (held < bits) {
+				acc |= static_cast<uint64_t>(*in++) << held;
+				held += 8;
+			}
+			uint64_t city = acc & mask;
+			acc >>= bits;
+			held -= bits;
+			if (city >= static_cast<uint64_t>(num_cities) || seen[city])
+				return -1;
+			seen[city] = 1;
+			tours[static_cast<size_t>(k) * num_cities + c] = static_cast<tour_t>(city);
+		}
+	}
+	return static_cast<int>(count);
+}
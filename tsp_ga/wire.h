@@ -0,0 +1,76 @@
+//
+//  wire.h
+//  tsp_ga
+//
+
+#ifndef __tsp_ga__wire__
+#define __tsp_ga__wire__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "world.h"
+
+/*
+ Binary messages between the processes of an island cluster (cluster.h).
+
+ Every message is a 16 byte header followed by its payload, all integers
+ little endian:
+
+   magic u32 | type u8 | reserved u8 | sender u16 | generation u32 | payload bytes u32
+
+ Tours travel as their count (u32), their squared lengths (u32 each) and the
+ city indices of all tours packed back to back with tour_bits(num_cities)
+ bits each, so 250 cities take a byte per city instead of two.
+ */
+enum class message_t : uint8_t
+{
+	hello = 1,		// First message of a worker; no payload
+	migrants = 2,	// Tours for another process's islands
+	leader = 3,		// Best tour of a finished worker
+	bye = 4			// Last message of a worker; no payload
+};
+
+struct MessageHeader
+{
+	message_t type;
+	int sender;			// Rank of the worker
+	int generation;		// Generation the tours come from
+	uint32_t payload_bytes;
+};
+
+static const size_t message_header_bytes = 16;
+
+/*
+ Appends a message to a buffer
+
+ tours   : count tours of num_cities cities, for migrants and leader messages
+ lengths : Their squared lengths
+ */
+void encode_message(std::vector<uint8_t>& out, message_t type, int sender, int generation,
+					const tour_t* tours = nullptr, const int* lengths = nullptr,
+					int count = 0, int num_cities = 0);
+
+/*
+ Reads a message header; returns false if it is not one
+ */
+bool decode_header(const uint8_t* in, MessageHeader& header);
+
+/*
+ Reads the number of tours of a migrants or leader payload, before decoding
+ them, to size the buffers they go to; returns -1 if the payload is too
+ short to hold it
+ */
+long long decode_tour_count(const uint8_t* payload, size_t bytes);
+
+/*
+ Reads the tours of a migrants or leader payload, at most max_count of them
+
+ returns the number of tours, or -1 if the payload is malformed or holds
+ something other than permutations of the cities
+ */
+int decode_tours(const uint8_t* payload, size_t bytes, int num_cities, int max_count,
+				 tour_t* tours, int* lengths);
+
+#endif /* defined(__tsp_ga__wire__) */
@@ -15,9 +15,12 @@
 #include <random>
 #include <functional>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
 
 // Program Includes
 #include "world.h"
+#include "tour_simd.h"
 #include "common.h"
 
 World::World(int num_cities, int height, int width, int seed)
@@ -68,6 +71,12 @@ World::~World()
 
 void World::init(int num_cities, int height, int width)
 {
+	if (num_cities > max_cities) {
+		cerr << num_cities << " cities do not fit the " << max_cities
+			 << " tour indices; build with TSP_GA_WIDE_INDEX" << endl;
+		exit(1);
+	}
+	
 	this->width      = width;
 	this->height     = height;
 	this->num_cities = num_cities;
@@ -103,13 +112,7 @@ float World::calc_distance() const
 	 Calculates the distance travelled
 		*/
 	
-	float distance = 0.0f;
-	for (int i = 0; i < num_cities - 1; i++) {
-		int dx = cities[i].x - cities[i + 1].x;
-		int dy = cities[i].y - cities[i + 1].y;
-		distance += sqrtf(dx*dx + dy*dy);
-	}
-	return distance;
+	return euclid_path_length(cities, num_cities, default_simd());
 }
 
 World* World::initializePopulation(int pop_size, int seed) const
@@ -154,6 +157,14 @@ World& World::operator=(const World& src)
 	return *this;
 }
 
+int tour_bits(int num_cities)
+{
+	int bits = 1;
+	while ((1u << bits) < static_cast<unsigned>(num_cities))
+		bits++;
+	return bits;
+}
+
 void clone_cities(City* src, City* dst, int num_cities)
 {
 	/*
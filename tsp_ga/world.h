@@ -15,6 +15,8 @@
 // Native Includes
 #include <iostream>
 #include <cmath>
+#include <cstdint>
+#include <limits>
 
 using namespace std;
 
@@ -22,6 +24,26 @@ using namespace std;
 ////////// Shared
 ///////////////////////////////////////////////////////////////////////////////
 
+/*
+	Index of a city in the base world's coordinate table. Individuals store
+	their tours as permutations of these indices. Define TSP_GA_WIDE_INDEX for
+	worlds with more than 65535 cities.
+*/
+#ifdef TSP_GA_WIDE_INDEX
+typedef uint32_t tour_t;
+#else
+typedef uint16_t tour_t;
+#endif
+
+// Most cities a world can have with these indices
+static const int max_cities = static_cast<int>(numeric_limits<tour_t>::max());
+
+/*
+	Bits a city index of a world of num_cities cities needs, at least 1; the
+	width of the packed tours of wire.h and trace.h
+*/
+int tour_bits(int num_cities);
+
 struct City
 {
 	/*
@@ -66,7 +88,8 @@ struct World
 	~World();
 	
 	/*
-	 Initialize a world struct
+	 Initialize a world struct. Exits if there are more than max_cities
+	 cities, which tour_t cannot index.
 	 
 	 num_cities : The number of cities in the world
 	 height     : The height of the world